@@ -25,6 +25,8 @@ LOCAL_SRC_FILES := third_party/stringencoders/src/modp_b64w.cpp \
     $(CORE_SRC_DIR)/properties.cpp \
     $(CORE_SRC_DIR)/string_conversions.cpp \
     $(SRC_DIR)/clock.cpp \
+    $(SRC_DIR)/crypto_session_pool.cpp \
+    $(SRC_DIR)/event_dispatcher.cpp \
     $(SRC_DIR)/file_store.cpp \
     $(SRC_DIR)/lock.cpp \
     $(SRC_DIR)/log.cpp \
@@ -32,6 +32,7 @@ LOCAL_SRC_FILES := \
     $(CORE_SRC_DIR)/oemcrypto_adapter_dynamic.cpp \
     $(CORE_SRC_DIR)/policy_engine.cpp \
     $(CORE_SRC_DIR)/privacy_crypto.cpp \
+    $(CORE_SRC_DIR)/service_certificate_cache.cpp \
     $(SRC_DIR)/wv_content_decryption_module.cpp
 
 LOCAL_MODULE := libcdm
@@ -15,7 +15,7 @@ class CdmClientPropertySet {
 
   virtual std::string security_level() const = 0;
   virtual bool use_privacy_mode() const = 0;
-  virtual std::vector<uint8_t> service_certificate() const = 0;
+  virtual const std::vector<uint8_t>& service_certificate() const = 0;
   virtual bool is_session_sharing_enabled() const = 0;
   virtual uint32_t session_sharing_id() const = 0;
   virtual void set_session_sharing_id(uint32_t id) = 0;
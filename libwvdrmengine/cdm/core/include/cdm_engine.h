@@ -4,7 +4,10 @@
 #define CDM_BASE_CDM_ENGINE_H_
 
 #include "certificate_provisioning.h"
+#include "crypto_session_pool.h"
+#include "event_dispatcher.h"
 #include "oemcrypto_adapter.h"
+#include "scoped_ptr.h"
 #include "timer.h"
 #include "wv_cdm_types.h"
 
@@ -13,6 +16,8 @@ namespace wvcdm {
 class CdmClientPropertySet;
 class CdmSession;
 class CryptoEngine;
+class DeviceFiles;
+class File;
 class WvCdmEventListener;
 
 typedef std::map<CdmSessionId, CdmSession*> CdmSessionMap;
@@ -43,6 +48,17 @@ class CdmEngine : public TimerHandler {
                                              CdmKeyMessage* key_request,
                                              std::string* server_url);
 
+  // Construct a single license request for several pieces of content, one
+  // PSSH per entry of |init_data|. Adding the response loads the keys of
+  // every entry into |session_id|; FindSessionForKey locates them by key id.
+  // Streaming and offline licenses only.
+  virtual CdmResponseType GenerateKeyRequest(const CdmSessionId& session_id,
+                                             const CdmInitDataList& init_data,
+                                             const CdmLicenseType license_type,
+                                             CdmAppParameterMap& app_parameters,
+                                             CdmKeyMessage* key_request,
+                                             std::string* server_url);
+
   // Accept license response and extract key info.
   virtual CdmResponseType AddKey(const CdmSessionId& session_id,
                                  const CdmKeyResponse& key_data,
@@ -53,6 +69,28 @@ class CdmEngine : public TimerHandler {
 
   CdmResponseType CancelKeyRequest(const CdmSessionId& session_id);
 
+  // Bulk offline license methods. Each call scans the license store once.
+  // An empty |key_set_ids| selects every stored license. Per key set
+  // results are returned in |results| or |states|.
+
+  // Opens a session for each key set and restores its keys. The device
+  // certificate is read once and shared by the new sessions. Restored
+  // sessions are returned in |sessions|.
+  virtual CdmResponseType RestoreKeys(const CdmClientPropertySet* property_set,
+                                      const CdmKeySetIdList& key_set_ids,
+                                      CdmKeySetSessionMap* sessions,
+                                      CdmKeySetResponseMap* results);
+
+  virtual CdmResponseType QueryOfflineLicenseStates(
+      const CdmClientPropertySet* property_set,
+      const CdmKeySetIdList& key_set_ids,
+      CdmOfflineLicenseStateMap* states);
+
+  virtual CdmResponseType DeleteOfflineLicenses(
+      const CdmClientPropertySet* property_set,
+      const CdmKeySetIdList& key_set_ids,
+      CdmKeySetResponseMap* results);
+
   // Construct valid renewal request for the current session keys.
   virtual CdmResponseType GenerateRenewalRequest(const CdmSessionId& session_id,
                                                  CdmKeyMessage* key_request,
@@ -73,6 +111,11 @@ class CdmEngine : public TimerHandler {
   virtual CdmResponseType QueryKeyStatus(const CdmSessionId& session_id,
                                          CdmQueryMap* key_info);
 
+  // Query license information without string conversion. Cheap enough to be
+  // polled for player UI updates.
+  virtual CdmResponseType QueryKeyStatus(const CdmSessionId& session_id,
+                                         CdmKeyStatus* key_status);
+
   // Query seesion control information
   virtual CdmResponseType QueryKeyControlInfo(const CdmSessionId& session_id,
                                               CdmQueryMap* key_info);
@@ -116,6 +159,12 @@ class CdmEngine : public TimerHandler {
   virtual bool CancelSessions();
   virtual bool ValidateKeySystem(const CdmKeySystem& key_system);
 
+  // Initializes |handle| for the security level requested by |property_set|
+  // and lists the stored licenses
+  bool ListOfflineLicenses(const CdmClientPropertySet* property_set,
+                           File* file, DeviceFiles* handle,
+                           CdmKeySetIdList* key_set_ids);
+
   // timer related methods to drive policy decisions
   virtual void EnablePolicyTimer();
   virtual void DisablePolicyTimer(bool force);
@@ -123,16 +172,27 @@ class CdmEngine : public TimerHandler {
 
   virtual void OnKeyReleaseEvent(const CdmKeySetId& key_set_id);
 
+  // Once no CDM session is open, closes the pooled OEMCrypto sessions after
+  // the OEMCrypto idle grace period, so that they neither hold OEMCrypto
+  // sessions nor keep it initialized while the CDM is unused
+  void ReleaseCryptoSessionPoolIfIdle();
+
   // instance variables
   CdmSessionMap sessions_;
   CdmReleaseKeySetMap release_key_sets_;
 
+  // OEMCrypto sessions opened ahead of OpenSession, NULL if disabled
+  scoped_ptr<CryptoSessionPool> crypto_session_pool_;
+
   CertificateProvisioning cert_provisioning_;
   SecurityLevel cert_provisioning_requested_security_level_;
 
   // policy timer
   Timer policy_timer_;
 
+  // delivers session events to listeners off the policy timer thread
+  EventDispatcher event_dispatcher_;
+
   CORE_DISALLOW_COPY_AND_ASSIGN(CdmEngine);
 };
 
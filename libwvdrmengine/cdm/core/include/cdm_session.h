@@ -16,14 +16,26 @@
 namespace wvcdm {
 
 class CdmClientPropertySet;
+class CryptoSessionPool;
+class EventDispatcher;
 class WvCdmEventListener;
 
 class CdmSession {
  public:
-  explicit CdmSession(const CdmClientPropertySet* cdm_client_property_set);
+  // Listener events are delivered through |event_dispatcher|, or by the
+  // calling thread if it is NULL. The crypto session is taken from
+  // |crypto_session_pool| when it has one, otherwise it is opened on Init,
+  // through the pool if there is one.
+  CdmSession(const CdmClientPropertySet* cdm_client_property_set,
+             EventDispatcher* event_dispatcher,
+             CryptoSessionPool* crypto_session_pool);
   ~CdmSession();
 
   CdmResponseType Init();
+  // Initializes the session with a device certificate that has already been
+  // retrieved, avoiding a read of the certificate file.
+  CdmResponseType Init(const std::string& certificate,
+                       const std::string& wrapped_key);
 
   CdmResponseType RestoreOfflineSession(const CdmKeySetId& key_set_id,
                                         const CdmLicenseType license_type);
@@ -42,6 +54,14 @@ class CdmSession {
                                      CdmKeyMessage* key_request,
                                      std::string* server_url);
 
+  // Generates one key request covering every entry of |init_data|. The keys
+  // of all entries are loaded into this session when the response is added.
+  CdmResponseType GenerateKeyRequest(const CdmInitDataList& init_data,
+                                     const CdmLicenseType license_type,
+                                     const CdmAppParameterMap& app_parameters,
+                                     CdmKeyMessage* key_request,
+                                     std::string* server_url);
+
   // AddKey() - Accept license response and extract key info.
   CdmResponseType AddKey(const CdmKeyResponse& key_response,
                          CdmKeySetId* key_set_id);
@@ -54,6 +74,7 @@ class CdmSession {
 
   // Query license information
   CdmResponseType QueryKeyStatus(CdmQueryMap* key_info);
+  CdmResponseType QueryKeyStatus(CdmKeyStatus* key_status);
 
   // Query session control info
   CdmResponseType QueryKeyControlInfo(CdmQueryMap* key_info);
@@ -89,7 +110,14 @@ class CdmSession {
 
   SecurityLevel GetRequestedSecurityLevel();
 
+  // Retrieves the device certificate the session was initialized with.
+  // Returns false if certificates are not used for identification.
+  bool GetDeviceCertificate(std::string* certificate,
+                            std::string* wrapped_key);
+
  private:
+  CdmResponseType InitInternal(const std::string* certificate,
+                               const std::string* wrapped_key);
 
   // Generate unique ID for each new session.
   CdmSessionId GenerateSessionId();
@@ -97,6 +125,10 @@ class CdmSession {
 
   bool StoreLicense(DeviceFiles::LicenseState state);
 
+  // Delivers the key status events raised by the policy engine
+  void NotifyEvent(CdmEventType event);
+  void DispatchKeyStatusEvents();
+
   // instance variables
   const CdmSessionId session_id_;
   CdmKeySystem key_system_;
@@ -109,7 +141,7 @@ class CdmSession {
   CdmLicenseType license_type_;
 
   // license type offline related information
-  CdmInitData offline_pssh_data_;
+  CdmInitDataList offline_pssh_data_;
   CdmKeyMessage offline_key_request_;
   CdmKeyResponse offline_key_response_;
   CdmKeyMessage offline_key_renewal_request_;
@@ -122,10 +154,13 @@ class CdmSession {
   KeyId key_id_;
 
   // Used for certificate based licensing
+  std::string certificate_;
   std::string wrapped_key_;
   bool is_certificate_loaded_;
 
   std::set<WvCdmEventListener*> listeners_;
+  EventDispatcher* event_dispatcher_;
+  CryptoSessionPool* crypto_session_pool_;
 
   CORE_DISALLOW_COPY_AND_ASSIGN(CdmSession);
 };
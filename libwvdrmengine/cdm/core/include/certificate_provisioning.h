@@ -10,12 +10,19 @@
 namespace wvcdm {
 
 class CdmSession;
+class CryptoSessionPool;
 
 class CertificateProvisioning {
  public:
-  CertificateProvisioning() {};
+  CertificateProvisioning() : crypto_session_pool_(NULL) {};
   ~CertificateProvisioning() {};
 
+  // The provisioning session is opened through |crypto_session_pool| when
+  // there is one, so that sessions held by the pool cannot starve it
+  void set_crypto_session_pool(CryptoSessionPool* crypto_session_pool) {
+    crypto_session_pool_ = crypto_session_pool;
+  }
+
   // Provisioning related methods
   CdmResponseType GetProvisioningRequest(SecurityLevel requested_security_level,
                                          CdmProvisioningRequest* request,
@@ -30,6 +37,7 @@ class CertificateProvisioning {
                          const std::string& end_substr,
                          std::string* result);
   CryptoSession crypto_session_;
+  CryptoSessionPool* crypto_session_pool_;
 
   CORE_DISALLOW_COPY_AND_ASSIGN(CertificateProvisioning);
 };
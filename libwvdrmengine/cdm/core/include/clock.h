@@ -18,6 +18,11 @@ class Clock {
 
   // Provides the number of seconds since an epoch - 01/01/1970 00:00 UTC
   virtual int64_t GetCurrentTime();
+
+  // Provides the number of seconds since an unspecified starting point.
+  // This time is cheap to read and is not affected by changes to the wall
+  // clock, so it is suited to measuring durations.
+  virtual int64_t GetMonotonicTime();
 };
 
 };  // namespace wvcdm
@@ -11,6 +11,7 @@
 #include "lock.h"
 #include "oemcrypto_adapter.h"
 #include "OEMCryptoCENC.h"
+#include "timer.h"
 #include "wv_cdm_types.h"
 
 namespace wvcdm {
@@ -21,11 +22,14 @@ typedef std::map<CryptoKeyId, CryptoKey*> CryptoKeyMap;
 class CryptoSession {
  public:
   CryptoSession();
-  ~CryptoSession();
+  virtual ~CryptoSession();
 
   bool ValidateKeybox();
   bool GetToken(std::string* token);
   CdmSecurityLevel GetSecurityLevel();
+  // Security level reported for |requested_security_level|, does not
+  // require an open session
+  CdmSecurityLevel GetSecurityLevel(SecurityLevel requested_security_level);
   bool GetDeviceUniqueId(std::string* device_id);
   bool GetSystemId(uint32_t* system_id);
   bool GetProvisioningId(std::string* provisioning_id);
@@ -66,11 +70,23 @@ class CryptoSession {
   bool SelectKey(const std::string& key_id);
   CdmResponseType Decrypt(const CdmDecryptionParameters& parameters);
 
-  bool GetRandom(size_t data_length, uint8_t* random_data);
+  virtual bool GetRandom(size_t data_length, uint8_t* random_data);
+
+  // OEMCrypto is terminated once no CryptoSession has existed for the idle
+  // grace period, see Properties::oem_crypto_idle_termination_seconds.
+  // Shutdown terminates it right away. Returns false if sessions remain.
+  static bool Shutdown();
+
+  // For testing only
+  static bool IsOEMCryptoInitialized();
 
  private:
+  class IdleTimerHandler;
+
   void Init();
   void Terminate();
+  static void TerminateOEMCrypto();
+  static void OnIdleTimerEvent();
   void GenerateMacContext(const std::string& input_context,
                           std::string* deriv_context);
   void GenerateEncryptContext(const std::string& input_context,
@@ -84,6 +100,9 @@ class CryptoSession {
   static Lock crypto_lock_;
   static bool initialized_;
   static int session_count_;
+  static int64_t idle_since_;
+  static IdleTimerHandler idle_timer_handler_;
+  static Timer idle_timer_;
 
   bool open_;
   CryptoSessionId oec_session_id_;
@@ -0,0 +1,70 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// CryptoSessionPool - Platform independent interface for a pool of opened
+// crypto sessions.
+//
+#ifndef CDM_BASE_CRYPTO_SESSION_POOL_H_
+#define CDM_BASE_CRYPTO_SESSION_POOL_H_
+
+#include "oemcrypto_adapter.h"
+#include "wv_cdm_types.h"
+
+namespace wvcdm {
+
+class CryptoSession;
+
+// Crypto session pool class. The implementation is platform dependent.
+//
+// Opening an OEMCrypto session can take a noticeable amount of time. The
+// pool keeps a few sessions at the default security level opened ahead of
+// time, so that opening a CDM session only has to take one. Sessions taken
+// from the pool are replaced on a background thread.
+//
+// OEMCrypto cannot clear the nonces, keys and derived keys of a session
+// short of closing it, so the pool only holds sessions that have never been
+// used. A session is closed rather than returned to the pool once it is no
+// longer needed.
+//
+// Pooled sessions count against the OEMCrypto session limit and keep
+// OEMCrypto initialized. Sessions opened outside the pool should go through
+// Open, and the owner calls ReleaseWhenIdle once no CDM session is open.
+class CryptoSessionPool {
+ public:
+  // At most |max_sessions| opened sessions are held, this should be kept
+  // well below the number of sessions OEMCrypto supports
+  explicit CryptoSessionPool(size_t max_sessions);
+  ~CryptoSessionPool();
+
+  // Returns an opened, unused session and starts replacing it. Returns NULL
+  // if the pool is empty or does not hold sessions at
+  // |requested_security_level|. The caller takes ownership.
+  CryptoSession* Acquire(SecurityLevel requested_security_level);
+
+  // Opens |session| at |requested_security_level| directly. If OEMCrypto is
+  // out of sessions, the pool is cleared and the open is retried.
+  CdmResponseType Open(CryptoSession* session,
+                       SecurityLevel requested_security_level);
+
+  // Closes the sessions held and cancels any pending refill, so that their
+  // OEMCrypto resources can be used by sessions opened directly
+  void Clear();
+
+  // Closes the sessions held once |idle_seconds| pass without a call to
+  // Acquire, so that a session closed and opened again in quick succession
+  // still finds the pool filled. Clears the pool right away if
+  // |idle_seconds| is 0.
+  void ReleaseWhenIdle(uint32_t idle_seconds);
+
+  // For testing only
+  size_t Size();
+
+ private:
+  class Impl;
+  Impl *impl_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(CryptoSessionPool);
+};
+
+}  // namespace wvcdm
+
+#endif  // CDM_BASE_CRYPTO_SESSION_POOL_H_
@@ -3,6 +3,7 @@
 #ifndef CDM_BASE_DEVICE_FILES_H_
 #define CDM_BASE_DEVICE_FILES_H_
 
+#include "lock.h"
 #include "wv_cdm_types.h"
 
 namespace wvcdm {
@@ -23,6 +24,12 @@ class DeviceFiles {
 
   virtual bool Init(const File* handle, CdmSecurityLevel security_level);
 
+  // Store calls return once the file data has been flushed to storage with
+  // File::DataSync. A license marked for release must not reappear as active
+  // after a power loss, and an offline license or certificate must not be
+  // lost once the server has issued it. Stores happen when a license or
+  // certificate is received, renewed or released, never during playback,
+  // so the cost of the flush stays off the decrypt path.
   virtual bool StoreCertificate(const std::string& certificate,
                                 const std::string& wrapped_private_key);
   virtual bool RetrieveCertificate(std::string* certificate,
@@ -36,6 +43,16 @@ class DeviceFiles {
                             const CdmKeyMessage& key_renewal_request,
                             const CdmKeyResponse& key_renewal_response,
                             const std::string& release_server_url);
+  // Stores a license requested for each entry of |pssh_data|
+  virtual bool StoreLicense(const std::string& key_set_id,
+                            const LicenseState state,
+                            const CdmInitDataList& pssh_data,
+                            const CdmKeyMessage& key_request,
+                            const CdmKeyResponse& key_response,
+                            const CdmKeyMessage& key_renewal_request,
+                            const CdmKeyResponse& key_renewal_response,
+                            const std::string& release_server_url);
+  // Retrieves the first PSSH of a license
   virtual bool RetrieveLicense(const std::string& key_set_id,
                                LicenseState* state,
                                CdmInitData* pssh_data,
@@ -44,22 +61,46 @@ class DeviceFiles {
                                CdmKeyMessage* key_renewal_request,
                                CdmKeyResponse* key_renewal_response,
                                std::string* release_server_url);
+  virtual bool RetrieveLicense(const std::string& key_set_id,
+                               LicenseState* state,
+                               CdmInitDataList* pssh_data,
+                               CdmKeyMessage* key_request,
+                               CdmKeyResponse* key_response,
+                               CdmKeyMessage* key_renewal_request,
+                               CdmKeyResponse* key_renewal_response,
+                               std::string* release_server_url);
   virtual bool DeleteLicense(const std::string& key_set_id);
   virtual bool DeleteAllFiles();
   virtual bool DeleteAllLicenses();
   virtual bool LicenseExists(const std::string& key_set_id);
+  // Returns the key set ids of all stored licenses with a single directory
+  // scan.
+  virtual bool ListLicenses(std::vector<std::string>* key_set_ids);
+
+  // Moves device files stored before the introduction of security level
+  // specific directories into each of those directories. The migration runs
+  // once per device: files are copied and synced, a versioned marker file is
+  // written and only then are the originals removed. Once the marker is
+  // found, later calls in the process return without touching the store.
+  static bool MigrateSecurityLevelPath(File* file);
 
   // For testing only
   static std::string GetCertificateFileName();
   static std::string GetLicenseFileNameExtension();
+  static std::string GetSecurityLevelPathMigrationFileName();
+  static void ResetSecurityLevelPathMigration();
 
  protected:
-  bool Hash(const std::string& data, std::string* hash);
   bool StoreFile(const char* name, const std::string& data);
   bool RetrieveFile(const char* name, std::string* data);
 
  private:
-  virtual void SecurityLevelPathBackwardCompatibility();
+  static bool IsSecurityLevelPathMigrated(File* file,
+                                          const std::string& marker_path);
+  static bool StoreMigrationMarker(File* file, const std::string& marker_path);
+
+  static Lock migration_lock_;
+  static bool security_level_path_migrated_;
 
   File* file_;
   CdmSecurityLevel security_level_;
@@ -0,0 +1,55 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// EventDispatcher - Platform independent interface for delivering CDM
+// events to listeners on a dedicated thread.
+//
+#ifndef CDM_BASE_EVENT_DISPATCHER_H_
+#define CDM_BASE_EVENT_DISPATCHER_H_
+
+#include "wv_cdm_types.h"
+
+namespace wvcdm {
+
+class WvCdmEventListener;
+
+// Event dispatcher class. The implementation is platform dependent.
+//
+// Events are queued by Post and delivered on the dispatcher thread, which
+// is started on first use. Post never waits for a listener. Each listener
+// receives its events in the order they were posted, and listeners with
+// queued events are served in turn. Listeners share the dispatcher thread
+// and must return from their callbacks promptly, a blocked callback delays
+// events for all listeners.
+//
+// An event that is already queued for the same listener and session is
+// not queued again. A key status event replaces the queued event of the
+// same type and is queued last, so that the listener receives only the
+// latest status and the last status delivered is the current one. The
+// queue of each listener is bounded. When it is full, the oldest queued
+// key status event other than a renewal or expiry is discarded to make
+// room. If there is none, a new key status event of another type is
+// dropped. Other events are always queued, at most one of each per session.
+class EventDispatcher {
+ public:
+  EventDispatcher();
+  ~EventDispatcher();
+
+  void Post(WvCdmEventListener* listener, const CdmSessionId& session_id,
+            CdmEventType event);
+  void Post(WvCdmEventListener* listener, const CdmSessionId& session_id,
+            const CdmKeyStatusEvent& event);
+
+  // Discards events queued for |listener| and |session_id|, and waits for
+  // a delivery to them that is in progress on another thread to return.
+  void Cancel(WvCdmEventListener* listener, const CdmSessionId& session_id);
+
+ private:
+  class Impl;
+  Impl *impl_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(EventDispatcher);
+};
+
+}  // namespace wvcdm
+
+#endif  // CDM_BASE_EVENT_DISPATCHER_H_
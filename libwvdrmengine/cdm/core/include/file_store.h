@@ -5,11 +5,32 @@
 #ifndef CDM_BASE_FILE_STORE_H_
 #define CDM_BASE_FILE_STORE_H_
 
+#include <sys/types.h>
+
 #include "wv_cdm_types.h"
 
 namespace wvcdm {
 
+// File I/O completion handler.
+//
+// Derive from this class if you wish to receive the result of reads and
+// writes submitted through File::SubmitReadAt and File::SubmitWriteAt.
+// The handler is called from a worker thread, |result| is the number of
+// bytes transferred or -1 on failure.
+class FileIoHandler {
+ public:
+  FileIoHandler() {};
+  virtual ~FileIoHandler() {};
+
+  virtual void OnFileIoComplete(void* context, ssize_t result) = 0;
+};
+
 // File class. The implementation is platform dependent.
+//
+// File is also the storage backend of DeviceFiles, which performs all of
+// its I/O through the File passed to DeviceFiles::Init. Every method is
+// virtual, so a different store is plugged in by deriving from File and
+// overriding the calls it needs, as the device files tests and benchmark do.
 class File {
  public:
   // defines as bit flag
@@ -18,7 +39,17 @@ class File {
     kBinary = 1,
     kCreate = 2,
     kReadOnly = 4,  // defaults to read and write access
-    kTruncate = 8
+    kTruncate = 8,
+    kDirect = 16  // bypass the page cache, buffers, sizes and offsets must be
+                  // multiples of kDirectIoAlignment
+  };
+
+  static const size_t kDirectIoAlignment = 4096;
+
+  // Buffer descriptor for vectored reads and writes
+  struct IoVector {
+    void* data;
+    size_t size;
   };
 
   File();
@@ -29,9 +60,36 @@ class File {
   virtual ssize_t Write(const char* buffer, size_t bytes);
   virtual void Close();
 
+  // Positional reads and writes. These do not move the offset used by
+  // Read and Write.
+  virtual ssize_t ReadAt(char* buffer, size_t bytes, off_t offset);
+  virtual ssize_t WriteAt(const char* buffer, size_t bytes, off_t offset);
+
+  // Vectored reads and writes at the current offset
+  virtual ssize_t ReadV(const IoVector* vectors, size_t count);
+  virtual ssize_t WriteV(const IoVector* vectors, size_t count);
+
+  // Reserves |bytes| of storage for the open file
+  virtual bool Allocate(size_t bytes);
+  // Flushes file data and metadata to storage
+  virtual bool Sync();
+  // Flushes file data, and only the metadata needed to read it back
+  virtual bool DataSync();
+
+  // Asynchronous positional reads and writes. Requests are run by a pool of
+  // worker threads shared by all File objects. |buffer| must remain valid
+  // until |handler| is called. Close waits for outstanding requests.
+  virtual bool SubmitReadAt(char* buffer, size_t bytes, off_t offset,
+                            FileIoHandler* handler, void* context);
+  virtual bool SubmitWriteAt(const char* buffer, size_t bytes, off_t offset,
+                             FileIoHandler* handler, void* context);
+  virtual void WaitForPendingIo();
+
   virtual bool Exists(const std::string& file_path);
   virtual bool Remove(const std::string& file_path);
   virtual bool Copy(const std::string& old_path, const std::string& new_path);
+  virtual bool Rename(const std::string& old_path,
+                      const std::string& new_path);
   virtual bool List(const std::string& path, std::vector<std::string>* files);
   virtual bool CreateDirectory(const std::string dir_path);
   virtual bool IsDirectory(const std::string& dir_path);
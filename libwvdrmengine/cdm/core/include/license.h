@@ -33,6 +33,13 @@ class CdmLicense {
                          const CdmSessionId& session_id,
                          CdmKeyMessage* signed_request,
                          std::string* server_url);
+  // Prepares a single request carrying a PSSH for each entry of |init_data|
+  bool PrepareKeyRequest(const CdmInitDataList& init_data,
+                         const CdmLicenseType license_type,
+                         const CdmAppParameterMap& app_parameters,
+                         const CdmSessionId& session_id,
+                         CdmKeyMessage* signed_request,
+                         std::string* server_url);
   bool PrepareKeyUpdateRequest(bool is_renewal, CdmKeyMessage* signed_request,
                                std::string* server_url);
   CdmResponseType HandleKeyResponse(const CdmKeyResponse& license_response);
@@ -45,7 +52,18 @@ class CdmLicense {
   bool HasInitData() { return !init_data_.empty(); }
   bool IsKeyLoaded(const KeyId& key_id);
 
+  // For testing only
+  static size_t GetCachedMessageCount();
+
  private:
+  // Serializes the client identification for a key request. The device
+  // specific part is built once per security level and shared by sessions.
+  bool SerializeClientIdentification(const CdmAppParameterMap& app_parameters,
+                                     std::string* serialized_client_id);
+  // Serializes the fields that precede and follow the app parameters
+  bool BuildClientIdentificationTemplate(std::string* prefix,
+                                         std::string* suffix);
+
   bool PrepareServiceCertificateRequest(CdmKeyMessage* signed_request,
                                         std::string* server_url);
   CdmResponseType HandleServiceCertificateResponse(
@@ -59,7 +77,7 @@ class CdmLicense {
   std::string server_url_;
   std::string token_;
   std::string service_certificate_;
-  std::string init_data_;
+  CdmInitDataList init_data_;
   bool initialized_;
   std::set<KeyId> loaded_keys_;
 
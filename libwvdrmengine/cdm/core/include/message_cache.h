@@ -0,0 +1,115 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// MessageCache - Pool of reusable protobuf messages.
+//
+// The bundled protobuf-lite has no arena support. A cleared message keeps
+// its sub-messages, repeated field elements and string buffers, so parsing
+// or building a message of similar shape in a recycled object reuses that
+// storage instead of allocating it again. License and device file handling
+// take their messages from a cache so that, once warm, an operation does a
+// constant number of allocations regardless of how many fields and keys
+// the messages hold. A cleared message still holds the bytes it was parsed
+// from, so owners supply a function that overwrites the key material and
+// license bytes of a message before it is recycled.
+//
+#ifndef CDM_BASE_MESSAGE_CACHE_H_
+#define CDM_BASE_MESSAGE_CACHE_H_
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "lock.h"
+#include "wv_cdm_types.h"
+
+namespace wvcdm {
+
+// Overwrites the contents of |value| in place, keeping its buffer for reuse
+inline void WipeString(std::string* value) {
+  if (!value->empty()) memset(&(*value)[0], 0, value->size());
+}
+
+template <class T>
+class MessageCache {
+ public:
+  typedef void (*WipeFunction)(T* message);
+
+  // Up to |max_messages| released messages are kept for reuse. |wipe|, if
+  // not NULL, is applied to each released message before it is cleared.
+  MessageCache(size_t max_messages, WipeFunction wipe)
+      : max_messages_(max_messages), wipe_(wipe) {
+    messages_.reserve(max_messages);
+  }
+
+  ~MessageCache() {
+    for (size_t i = 0; i < messages_.size(); ++i) delete messages_[i];
+  }
+
+  // Returns a cleared message, recycled if one is available
+  T* Acquire() {
+    {
+      AutoLock auto_lock(lock_);
+      if (!messages_.empty()) {
+        T* message = messages_.back();
+        messages_.pop_back();
+        return message;
+      }
+    }
+    return new T;
+  }
+
+  // Wipes and clears |message| and returns it to the cache, or deletes it
+  // when the cache is full
+  void Release(T* message) {
+    if (message == NULL) return;
+    if (wipe_ != NULL) wipe_(message);
+    message->Clear();
+    {
+      AutoLock auto_lock(lock_);
+      if (messages_.size() < max_messages_) {
+        messages_.push_back(message);
+        return;
+      }
+    }
+    delete message;
+  }
+
+  // For testing only
+  size_t Size() {
+    AutoLock auto_lock(lock_);
+    return messages_.size();
+  }
+
+ private:
+  size_t max_messages_;
+  WipeFunction wipe_;
+  std::vector<T*> messages_;
+  Lock lock_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(MessageCache);
+};
+
+// Holds a message acquired from a MessageCache and releases it back to the
+// cache when it goes out of scope.
+template <class T>
+class CachedMessage {
+ public:
+  explicit CachedMessage(MessageCache<T>* cache)
+      : cache_(cache), message_(cache->Acquire()) {}
+  ~CachedMessage() { cache_->Release(message_); }
+
+  T& operator*() const { return *message_; }
+  T* operator->() const { return message_; }
+  T* get() const { return message_; }
+
+ private:
+  MessageCache<T>* cache_;
+  T* message_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(CachedMessage);
+};
+
+}  // namespace wvcdm
+
+#endif  // CDM_BASE_MESSAGE_CACHE_H_
@@ -4,6 +4,7 @@
 #define CDM_BASE_POLICY_ENGINE_H_
 
 #include <string>
+#include <vector>
 
 #include "license_protocol.pb.h"
 #include "wv_cdm_types.h"
@@ -11,6 +12,7 @@
 namespace wvcdm {
 
 class Clock;
+class CryptoSession;
 class PolicyEngineTest;
 
 // This acts as an oracle that basically says "Yes(true) you may still decrypt
@@ -48,14 +50,40 @@ class PolicyEngine {
   void UpdateLicense(const video_widevine_server::sdk::License& license);
 
   CdmResponseType Query(CdmQueryMap* key_info);
+  CdmResponseType Query(CdmKeyStatus* key_status);
+
+  // Records that a renewal response was rejected
+  void OnRenewalFailure();
+
+  // Key status events raised since the last call are appended to |events|.
+  // Only the latest event of each type is kept between calls.
+  bool has_key_status_events() { return !key_status_events_.empty(); }
+  void GetKeyStatusEvents(std::vector<CdmKeyStatusEvent>* events);
 
   const video_widevine_server::sdk::LicenseIdentification& license_id() {
     return license_id_;
   }
 
+  // Delays each renewal deadline by a random amount of up to
+  // |max_jitter_seconds|, drawn from the OEMCrypto random number generator
+  // of |crypto_session|. The deadline never moves past license expiry.
+  void SetRenewalJitter(int64_t max_jitter_seconds,
+                        CryptoSession* crypto_session) {
+    renewal_jitter_seconds_ = max_jitter_seconds;
+    crypto_session_ = crypto_session;
+  }
+
   bool IsLicenseDurationExpired(int64_t current_time);
   bool IsPlaybackDurationExpired(int64_t current_time);
 
+  // Returns true once the license or playback duration has run out. The
+  // deadline is computed when a license or renewal is applied or playback
+  // begins, and is measured on the monotonic clock so that changes to the
+  // wall clock neither extend nor cut playback. OnTimerEvent expires the
+  // license against the same deadline. This is cheap enough to be called
+  // for each sample and may be called from any thread.
+  bool IsDecryptionDeadlinePassed();
+
  private:
   typedef enum {
     kLicenseStateInitial,
@@ -68,11 +96,19 @@ class PolicyEngine {
 
   void Init(Clock* clock);
 
+  bool IsDeadlinePassed(int64_t monotonic_time);
   bool IsRenewalDelayExpired(int64_t current_time);
   bool IsRenewalRecoveryDurationExpired(int64_t current_time);
   bool IsRenewalRetryIntervalExpired(int64_t current_time);
 
   void UpdateRenewalRequest(int64_t current_time);
+  int64_t GetRenewalJitter();
+  void UpdateExpiryTimes(int64_t current_time);
+
+  void GetKeyStatus(int64_t current_time, CdmKeyStatus* key_status);
+  void AddKeyStatusEvent(CdmKeyStatusEventType type, int64_t current_time,
+                         int64_t threshold_seconds);
+  void CheckExpiryWarning(int64_t current_time, int64_t monotonic_time);
 
   LicenseState license_state_;
   bool can_decrypt_;
@@ -101,6 +137,24 @@ class PolicyEngine {
   // calculate the time where renewal retries should occur.
   int64_t next_renewal_time_;
   int64_t policy_max_duration_seconds_;
+  int64_t renewal_jitter_seconds_;
+  // Not owned, source of the renewal jitter
+  CryptoSession* crypto_session_;
+
+  // Times at which the license and playback durations expire, precomputed
+  // whenever the policy or playback start time changes. 0 if unlimited.
+  int64_t license_expiry_time_;
+  int64_t playback_expiry_time_;
+
+  // Monotonic time at which decryption must stop, 0 if unlimited. Read
+  // without a lock by IsDecryptionDeadlinePassed.
+  int64_t decryption_deadline_;
+
+  // Smallest expiry warning threshold reported for the current expiry
+  // times, 0 if none
+  int64_t expiry_warning_seconds_;
+
+  std::vector<CdmKeyStatusEvent> key_status_events_;
 
   Clock* clock_;
 
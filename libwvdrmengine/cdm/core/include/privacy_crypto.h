@@ -55,6 +55,8 @@ class RsaPublicKey {
 
   // Initializes an RsaPublicKey object using a DER encoded PKCS#1 RSAPublicKey
   bool Init(const std::string& serialized_key);
+  // Initializes an RsaPublicKey object that shares |key| with its owner
+  bool Init(RSA* key);
 
   // Encrypt a message using RSA-OAEP. Caller retains ownership of all
   // parameters. Returns true if successful, false otherwise.
@@ -51,6 +51,15 @@ class Properties {
   static inline bool security_level_path_backward_compatibility_support() {
     return security_level_path_backward_compatibility_support_;
   }
+  static inline uint32_t renewal_jitter_seconds() {
+    return renewal_jitter_seconds_;
+  }
+  static inline uint32_t crypto_session_pool_size() {
+    return crypto_session_pool_size_;
+  }
+  static inline uint32_t oem_crypto_idle_termination_seconds() {
+    return oem_crypto_idle_termination_seconds_;
+  }
   static bool GetCompanyName(std::string* company_name);
   static bool GetModelName(std::string* model_name);
   static bool GetArchitectureName(std::string* arch_name);
@@ -63,7 +72,7 @@ class Properties {
   static bool GetOEMCryptoPath(std::string* library_name);
   static bool GetSecurityLevelDirectories(std::vector<std::string>* dirs);
   static const std::string GetSecurityLevel(const CdmSessionId& session_id);
-  static const std::vector<uint8_t> GetServiceCertificate(
+  static const std::vector<uint8_t>& GetServiceCertificate(
        const CdmSessionId& session_id);
   static bool UsePrivacyMode(const CdmSessionId& session_id);
   static uint32_t GetSessionSharingId(const CdmSessionId& session_id);
@@ -103,6 +112,15 @@ class Properties {
   static void set_security_level_path_backward_compatibility_support(bool flag) {
     security_level_path_backward_compatibility_support_ = flag;
   }
+  static void set_renewal_jitter_seconds(uint32_t seconds) {
+    renewal_jitter_seconds_ = seconds;
+  }
+  static void set_crypto_session_pool_size(uint32_t size) {
+    crypto_session_pool_size_ = size;
+  }
+  static void set_oem_crypto_idle_termination_seconds(uint32_t seconds) {
+    oem_crypto_idle_termination_seconds_ = seconds;
+  }
 
   static bool begin_license_usage_when_received_;
   static bool require_explicit_renew_request_;
@@ -113,8 +131,14 @@ class Properties {
   static bool extract_pssh_data_;
   static bool decrypt_with_empty_session_support_;
   static bool security_level_path_backward_compatibility_support_;
+  static uint32_t renewal_jitter_seconds_;
+  static uint32_t crypto_session_pool_size_;
+  static uint32_t oem_crypto_idle_termination_seconds_;
   static scoped_ptr<CdmClientPropertySetMap> session_property_set_;
 
+  // For testing
+  friend class CryptoSessionTest;
+
   CORE_DISALLOW_COPY_AND_ASSIGN(Properties);
 };
 
@@ -0,0 +1,84 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// ServiceCertificateCache - Process wide cache of parsed service
+// certificates used to encrypt the client identification in privacy mode.
+// Entries hold the serialized DeviceCertificate with its service id, serial
+// number and decoded RSA public key, so sessions do not repeat the protobuf
+// parse and DER decode for a certificate that has already been seen. The
+// few entries are looked up by comparing the certificate bytes, most
+// recently used first, and the least recently used one is evicted. Lookups
+// always start from the certificate bytes a session holds; the cache never
+// hands a certificate to a session that was not given one.
+//
+#ifndef CDM_BASE_SERVICE_CERTIFICATE_CACHE_H_
+#define CDM_BASE_SERVICE_CERTIFICATE_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "lock.h"
+#include "openssl/rsa.h"
+#include "wv_cdm_types.h"
+
+namespace wvcdm {
+
+class RsaPublicKey;
+
+class ServiceCertificateCache {
+ public:
+  // Parses |certificate| and adds it to the cache. |verified| marks a
+  // certificate whose signature was checked against the service certificate
+  // root.
+  static bool Add(const std::string& certificate, bool verified);
+
+  // Returns true if |certificate| is cached and was verified
+  static bool IsVerified(const std::string& certificate);
+
+  // Retrieves the parsed fields of |certificate|, parsing and caching it
+  // on a miss. |public_key| shares the cached RSA key.
+  static bool Get(const std::string& certificate, std::string* service_id,
+                  std::string* serial_number, RsaPublicKey* public_key);
+  static bool Get(const std::vector<uint8_t>& certificate,
+                  std::string* service_id, std::string* serial_number,
+                  RsaPublicKey* public_key);
+
+  // For testing only
+  static void Clear();
+  static size_t Size();
+
+ private:
+  struct Entry {
+    Entry() : key(NULL), verified(false) {}
+    ~Entry();
+
+    std::string certificate;
+    std::string service_id;
+    std::string serial_number;
+    RSA* key;
+    bool verified;
+  };
+  // Most recently used first
+  typedef std::list<Entry*> EntryList;
+
+  static bool Get(const char* certificate, size_t size,
+                  std::string* service_id, std::string* serial_number,
+                  RsaPublicKey* public_key);
+  static bool Parse(Entry* entry);
+  // Returns the entry for |certificate| and marks it most recently used,
+  // NULL if absent. Caller must hold lock_.
+  static Entry* Find(const char* certificate, size_t size);
+  // Adds an entry for |certificate| if absent, caller must hold lock_
+  static Entry* Insert(const char* certificate, size_t size);
+
+  static Lock lock_;
+  static EntryList entries_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(ServiceCertificateCache);
+};
+
+}  // namespace wvcdm
+
+#endif  // CDM_BASE_SERVICE_CERTIFICATE_CACHE_H_
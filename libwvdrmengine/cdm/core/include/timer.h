@@ -27,7 +27,8 @@ class TimerHandler {
 // This class provides a simple recurring timer API. The class receiving
 // timer expiry events should derive from TimerHandler.
 // Specify the receiver class and the periodicty of timer events when
-// the timer is initiated by calling Start.
+// the timer is initiated by calling Start. Stop may be called from the
+// handler, in which case no further events are delivered.
 
 class Timer {
  public:
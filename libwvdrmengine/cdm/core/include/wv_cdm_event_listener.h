@@ -11,6 +11,8 @@ namespace wvcdm {
 // The caller of the CDM API must provide an implementation for onEvent
 // and signal its intent by using the Attach/DetachEventListener methods
 // in the WvContentDecryptionModule class.
+// Events are delivered on the CDM's event dispatcher thread, never from
+// within a CDM call, so a listener may call back into the CDM.
 class WvCdmEventListener {
  public:
   WvCdmEventListener() {}
@@ -19,6 +21,10 @@ class WvCdmEventListener {
   virtual void onEvent(const CdmSessionId& session_id,
                        CdmEventType cdm_event) = 0;
 
+  // Called when the key status of a session changes
+  virtual void onKeyStatusEvent(const CdmSessionId& session_id,
+                                const CdmKeyStatusEvent& event) {}
+
  private:
   CORE_DISALLOW_COPY_AND_ASSIGN(WvCdmEventListener);
 };
@@ -12,6 +12,7 @@ namespace wvcdm {
 
 typedef std::string CdmKeySystem;
 typedef std::string CdmInitData;
+typedef std::vector<CdmInitData> CdmInitDataList;
 typedef std::string CdmKeyMessage;
 typedef std::string CdmKeyResponse;
 typedef std::string KeyId;
@@ -27,6 +28,7 @@ typedef std::vector<std::string> CdmSecureStops;
 typedef std::vector<uint8_t> CdmSecureStopReleaseMessage;
 typedef std::string CdmProvisioningRequest;
 typedef std::string CdmProvisioningResponse;
+typedef std::vector<CdmKeySetId> CdmKeySetIdList;
 
 enum CdmResponseType {
   NO_ERROR,
@@ -64,6 +66,61 @@ enum CdmSecurityLevel {
   kSecurityLevelUnknown
 };
 
+enum CdmOfflineLicenseState {
+  kOfflineLicenseStateActive,
+  kOfflineLicenseStateReleasing,
+  kOfflineLicenseStateUnknown,
+  kOfflineLicenseStateNotFound
+};
+
+// Key status of a session, see CdmEngine::QueryKeyStatus. Durations are in
+// seconds. Expiry times are absolute times of the CDM clock, a value of 0
+// indicates that the license places no limit.
+struct CdmKeyStatus {
+  CdmKeyStatus()
+      : license_type(kLicenseTypeStreaming),
+        play_allowed(false),
+        persist_allowed(false),
+        renew_allowed(false),
+        license_duration_remaining(0),
+        playback_duration_remaining(0),
+        license_expiry_time(0),
+        playback_expiry_time(0) {}
+
+  CdmLicenseType license_type;
+  bool play_allowed;
+  bool persist_allowed;
+  bool renew_allowed;
+  int64_t license_duration_remaining;
+  int64_t playback_duration_remaining;
+  int64_t license_expiry_time;
+  int64_t playback_expiry_time;
+  std::string renewal_server_url;
+};
+
+enum CdmKeyStatusEventType {
+  kKeyStatusUsable,          // keys became usable for decryption
+  kKeyStatusExpiring,        // remaining time fell below a warning threshold
+  kKeyStatusExpired,         // license or playback duration expired
+  kKeyStatusRenewed,         // a renewal response was accepted
+  kKeyStatusRenewalFailed    // a renewal response was rejected
+};
+
+// Key status change of a session, see WvCdmEventListener::onKeyStatusEvent
+struct CdmKeyStatusEvent {
+  CdmKeyStatusEvent() : type(kKeyStatusUsable), threshold_seconds(0) {}
+
+  CdmKeyStatusEventType type;
+  // Key status at the time of the change
+  CdmKeyStatus status;
+  // For kKeyStatusExpiring, the warning threshold that was crossed
+  int64_t threshold_seconds;
+};
+
+typedef std::map<CdmKeySetId, CdmResponseType> CdmKeySetResponseMap;
+typedef std::map<CdmKeySetId, CdmSessionId> CdmKeySetSessionMap;
+typedef std::map<CdmKeySetId, CdmOfflineLicenseState> CdmOfflineLicenseStateMap;
+
 struct CdmDecryptionParameters {
   bool is_encrypted;
   bool is_secure;
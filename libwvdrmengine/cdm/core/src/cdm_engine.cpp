@@ -3,10 +3,15 @@
 #include "cdm_engine.h"
 
 #include <iostream>
+#include <set>
 #include <sstream>
 
 #include "buffer_reader.h"
+#include "cdm_client_property_set.h"
 #include "cdm_session.h"
+#include "crypto_session.h"
+#include "device_files.h"
+#include "file_store.h"
 #include "license_protocol.pb.h"
 #include "log.h"
 #include "properties.h"
@@ -24,6 +29,11 @@ namespace wvcdm {
 CdmEngine::CdmEngine()
     : cert_provisioning_requested_security_level_(kLevelDefault) {
   Properties::Init();
+  if (Properties::crypto_session_pool_size() > 0) {
+    crypto_session_pool_.reset(
+        new CryptoSessionPool(Properties::crypto_session_pool_size()));
+    cert_provisioning_.set_crypto_session_pool(crypto_session_pool_.get());
+  }
 }
 
 CdmEngine::~CdmEngine() {
@@ -52,7 +62,8 @@ CdmResponseType CdmEngine::OpenSession(
     return KEY_ERROR;
   }
 
-  scoped_ptr<CdmSession> new_session(new CdmSession(property_set));
+  scoped_ptr<CdmSession> new_session(new CdmSession(
+      property_set, &event_dispatcher_, crypto_session_pool_.get()));
   if (new_session->session_id().empty()) {
     LOGE("CdmEngine::OpenSession: failure to generate session ID");
     return UNKNOWN_ERROR;
@@ -65,6 +76,7 @@ CdmResponseType CdmEngine::OpenSession(
           new_session->GetRequestedSecurityLevel();
     }
     LOGE("CdmEngine::OpenSession: bad session init: %u", sts);
+    ReleaseCryptoSessionPoolIfIdle();
     return sts;
   }
   *session_id = new_session->session_id();
@@ -103,6 +115,7 @@ CdmResponseType CdmEngine::CloseSession(const CdmSessionId& session_id) {
   sessions_.erase(session_id);
   DisablePolicyTimer(false);
   delete session;
+  ReleaseCryptoSessionPoolIfIdle();
   return NO_ERROR;
 }
 
@@ -200,6 +213,57 @@ CdmResponseType CdmEngine::GenerateKeyRequest(
   return KEY_MESSAGE;
 }
 
+CdmResponseType CdmEngine::GenerateKeyRequest(
+    const CdmSessionId& session_id,
+    const CdmInitDataList& init_data,
+    const CdmLicenseType license_type,
+    CdmAppParameterMap& app_parameters,
+    CdmKeyMessage* key_request,
+    std::string* server_url) {
+  LOGI("CdmEngine::GenerateKeyRequest: %d init data entries",
+       init_data.size());
+
+  if (license_type == kLicenseTypeRelease) {
+    LOGE("CdmEngine::GenerateKeyRequest: release of multiple init data "
+         "not supported");
+    return UNKNOWN_ERROR;
+  }
+
+  if (init_data.empty()) {
+    LOGE("CdmEngine::GenerateKeyRequest: no init data provided");
+    return KEY_ERROR;
+  }
+
+  CdmSessionMap::iterator iter = sessions_.find(session_id);
+  if (iter == sessions_.end()) {
+    LOGE("CdmEngine::GenerateKeyRequest: session_id not found = %s",
+        session_id.c_str());
+    return KEY_ERROR;
+  }
+
+  if (!key_request) {
+    LOGE("CdmEngine::GenerateKeyRequest: no key request destination provided");
+    return KEY_ERROR;
+  }
+
+  key_request->clear();
+
+  CdmResponseType sts = iter->second->GenerateKeyRequest(
+      init_data, license_type, app_parameters, key_request, server_url);
+
+  if (KEY_MESSAGE != sts) {
+    if (sts == NEED_PROVISIONING) {
+      cert_provisioning_requested_security_level_ =
+          iter->second->GetRequestedSecurityLevel();
+    }
+    LOGE("CdmEngine::GenerateKeyRequest: key request generation failed, "
+        "sts = %d", (int)sts);
+    return sts;
+  }
+
+  return KEY_MESSAGE;
+}
+
 CdmResponseType CdmEngine::AddKey(
     const CdmSessionId& session_id,
     const CdmKeyResponse& key_data,
@@ -281,6 +345,188 @@ CdmResponseType CdmEngine::RestoreKey(
   return sts;
 }
 
+CdmResponseType CdmEngine::RestoreKeys(
+    const CdmClientPropertySet* property_set,
+    const CdmKeySetIdList& key_set_ids,
+    CdmKeySetSessionMap* sessions,
+    CdmKeySetResponseMap* results) {
+  LOGI("CdmEngine::RestoreKeys");
+
+  if (!sessions || !results) {
+    LOGE("CdmEngine::RestoreKeys: no result destination provided");
+    return KEY_ERROR;
+  }
+
+  File file;
+  DeviceFiles handle;
+  CdmKeySetIdList stored_key_set_ids;
+  if (!ListOfflineLicenses(property_set, &file, &handle,
+                           &stored_key_set_ids)) {
+    return UNKNOWN_ERROR;
+  }
+
+  std::set<CdmKeySetId> stored(stored_key_set_ids.begin(),
+                               stored_key_set_ids.end());
+  const CdmKeySetIdList& requested =
+      key_set_ids.empty() ? stored_key_set_ids : key_set_ids;
+
+  std::string certificate;
+  std::string wrapped_key;
+  bool certificate_loaded = false;
+
+  for (size_t i = 0; i < requested.size(); ++i) {
+    const CdmKeySetId& key_set_id = requested[i];
+    if (stored.find(key_set_id) == stored.end()) {
+      LOGW("CdmEngine::RestoreKeys: key set id not found = %s",
+           key_set_id.c_str());
+      (*results)[key_set_id] = KEY_ERROR;
+      continue;
+    }
+
+    scoped_ptr<CdmSession> new_session(new CdmSession(
+        property_set, &event_dispatcher_, crypto_session_pool_.get()));
+    if (new_session->session_id().empty()) {
+      LOGE("CdmEngine::RestoreKeys: failure to generate session ID");
+      (*results)[key_set_id] = UNKNOWN_ERROR;
+      continue;
+    }
+
+    CdmResponseType sts = certificate_loaded
+        ? new_session->Init(certificate, wrapped_key)
+        : new_session->Init();
+    if (sts == NO_ERROR) {
+      if (!certificate_loaded) {
+        certificate_loaded =
+            new_session->GetDeviceCertificate(&certificate, &wrapped_key);
+      }
+      sts = new_session->RestoreOfflineSession(key_set_id,
+                                               kLicenseTypeOffline);
+    }
+
+    (*results)[key_set_id] = sts;
+    if (sts == NEED_PROVISIONING) {
+      cert_provisioning_requested_security_level_ =
+          new_session->GetRequestedSecurityLevel();
+      ReleaseCryptoSessionPoolIfIdle();
+      return NEED_PROVISIONING;
+    }
+    if (sts != KEY_ADDED) {
+      LOGW("CdmEngine::RestoreKeys: unable to restore key set id = %s, "
+           "sts = %d", key_set_id.c_str(), (int)sts);
+      continue;
+    }
+
+    (*sessions)[key_set_id] = new_session->session_id();
+    sessions_[new_session->session_id()] = new_session.release();
+  }
+  ReleaseCryptoSessionPoolIfIdle();
+  return NO_ERROR;
+}
+
+CdmResponseType CdmEngine::QueryOfflineLicenseStates(
+    const CdmClientPropertySet* property_set,
+    const CdmKeySetIdList& key_set_ids,
+    CdmOfflineLicenseStateMap* states) {
+  LOGI("CdmEngine::QueryOfflineLicenseStates");
+
+  if (!states) {
+    LOGE("CdmEngine::QueryOfflineLicenseStates: no state destination "
+         "provided");
+    return KEY_ERROR;
+  }
+
+  File file;
+  DeviceFiles handle;
+  CdmKeySetIdList stored_key_set_ids;
+  if (!ListOfflineLicenses(property_set, &file, &handle,
+                           &stored_key_set_ids)) {
+    return UNKNOWN_ERROR;
+  }
+
+  std::set<CdmKeySetId> stored(stored_key_set_ids.begin(),
+                               stored_key_set_ids.end());
+  const CdmKeySetIdList& requested =
+      key_set_ids.empty() ? stored_key_set_ids : key_set_ids;
+
+  DeviceFiles::LicenseState license_state;
+  CdmInitData pssh_data;
+  CdmKeyMessage key_request;
+  CdmKeyResponse key_response;
+  CdmKeyMessage key_renewal_request;
+  CdmKeyResponse key_renewal_response;
+  std::string release_server_url;
+
+  for (size_t i = 0; i < requested.size(); ++i) {
+    const CdmKeySetId& key_set_id = requested[i];
+    if (stored.find(key_set_id) == stored.end()) {
+      (*states)[key_set_id] = kOfflineLicenseStateNotFound;
+      continue;
+    }
+
+    if (!handle.RetrieveLicense(key_set_id, &license_state, &pssh_data,
+                                &key_request, &key_response,
+                                &key_renewal_request, &key_renewal_response,
+                                &release_server_url)) {
+      (*states)[key_set_id] = kOfflineLicenseStateUnknown;
+      continue;
+    }
+
+    switch (license_state) {
+      case DeviceFiles::kLicenseStateActive:
+        (*states)[key_set_id] = kOfflineLicenseStateActive;
+        break;
+      case DeviceFiles::kLicenseStateReleasing:
+        (*states)[key_set_id] = kOfflineLicenseStateReleasing;
+        break;
+      default:
+        (*states)[key_set_id] = kOfflineLicenseStateUnknown;
+        break;
+    }
+  }
+  return NO_ERROR;
+}
+
+CdmResponseType CdmEngine::DeleteOfflineLicenses(
+    const CdmClientPropertySet* property_set,
+    const CdmKeySetIdList& key_set_ids,
+    CdmKeySetResponseMap* results) {
+  LOGI("CdmEngine::DeleteOfflineLicenses");
+
+  if (!results) {
+    LOGE("CdmEngine::DeleteOfflineLicenses: no result destination provided");
+    return KEY_ERROR;
+  }
+
+  File file;
+  DeviceFiles handle;
+  CdmKeySetIdList stored_key_set_ids;
+  if (!ListOfflineLicenses(property_set, &file, &handle,
+                           &stored_key_set_ids)) {
+    return UNKNOWN_ERROR;
+  }
+
+  std::set<CdmKeySetId> stored(stored_key_set_ids.begin(),
+                               stored_key_set_ids.end());
+  const CdmKeySetIdList& requested =
+      key_set_ids.empty() ? stored_key_set_ids : key_set_ids;
+
+  for (size_t i = 0; i < requested.size(); ++i) {
+    const CdmKeySetId& key_set_id = requested[i];
+    if (stored.find(key_set_id) == stored.end()) {
+      (*results)[key_set_id] = KEY_ERROR;
+    } else if (release_key_sets_.find(key_set_id) !=
+               release_key_sets_.end()) {
+      LOGW("CdmEngine::DeleteOfflineLicenses: release pending for key set "
+           "id = %s", key_set_id.c_str());
+      (*results)[key_set_id] = KEY_ERROR;
+    } else {
+      (*results)[key_set_id] =
+          handle.DeleteLicense(key_set_id) ? NO_ERROR : UNKNOWN_ERROR;
+    }
+  }
+  return NO_ERROR;
+}
+
 CdmResponseType CdmEngine::CancelKeyRequest(const CdmSessionId& session_id) {
   LOGI("CdmEngine::CancelKeyRequest");
 
@@ -425,6 +671,18 @@ CdmResponseType CdmEngine::QueryKeyStatus(
   return iter->second->QueryKeyStatus(key_info);
 }
 
+CdmResponseType CdmEngine::QueryKeyStatus(
+    const CdmSessionId& session_id,
+    CdmKeyStatus* key_status) {
+  CdmSessionMap::iterator iter = sessions_.find(session_id);
+  if (iter == sessions_.end()) {
+    LOGE("CdmEngine::QueryKeyStatus: session_id not found = %s",
+         session_id.c_str());
+    return KEY_ERROR;
+  }
+  return iter->second->QueryKeyStatus(key_status);
+}
+
 CdmResponseType CdmEngine::QueryKeyControlInfo(
     const CdmSessionId& session_id,
     CdmQueryMap* key_info) {
@@ -684,6 +942,29 @@ bool CdmEngine::ExtractWidevinePssh(
   return false;
 }
 
+bool CdmEngine::ListOfflineLicenses(const CdmClientPropertySet* property_set,
+                                    File* file, DeviceFiles* handle,
+                                    CdmKeySetIdList* key_set_ids) {
+  SecurityLevel requested_security_level = kLevelDefault;
+  if (property_set && property_set->security_level().compare(
+                          QUERY_VALUE_SECURITY_LEVEL_L3) == 0) {
+    requested_security_level = kLevel3;
+  }
+
+  CryptoSession crypto_session;
+  if (!handle->Init(file, crypto_session.GetSecurityLevel(
+                              requested_security_level))) {
+    LOGE("CdmEngine::ListOfflineLicenses: unable to initialize device files");
+    return false;
+  }
+
+  if (!handle->ListLicenses(key_set_ids)) {
+    LOGE("CdmEngine::ListOfflineLicenses: unable to list licenses");
+    return false;
+  }
+  return true;
+}
+
 void CdmEngine::EnablePolicyTimer() {
   if (!policy_timer_.IsRunning())
     policy_timer_.Start(this, kCdmPolicyTimerDurationSeconds);
@@ -709,4 +990,11 @@ void CdmEngine::OnKeyReleaseEvent(const CdmKeySetId& key_set_id) {
   }
 }
 
+void CdmEngine::ReleaseCryptoSessionPoolIfIdle() {
+  if (crypto_session_pool_.get() && sessions_.empty()) {
+    crypto_session_pool_->ReleaseWhenIdle(
+        Properties::oem_crypto_idle_termination_seconds());
+  }
+}
+
 }  // namespace wvcdm
@@ -8,9 +8,10 @@
 #include <stdlib.h>
 
 #include "cdm_engine.h"
-#include "clock.h"
 #include "crypto_session.h"
+#include "crypto_session_pool.h"
 #include "device_files.h"
+#include "event_dispatcher.h"
 #include "file_store.h"
 #include "log.h"
 #include "properties.h"
@@ -26,40 +27,77 @@ namespace wvcdm {
 
 typedef std::set<WvCdmEventListener*>::iterator CdmEventListenerIter;
 
-CdmSession::CdmSession(const CdmClientPropertySet* cdm_client_property_set)
+CdmSession::CdmSession(const CdmClientPropertySet* cdm_client_property_set,
+                       EventDispatcher* event_dispatcher,
+                       CryptoSessionPool* crypto_session_pool)
     : session_id_(GenerateSessionId()),
       crypto_session_(NULL),
       license_received_(false),
       reinitialize_session_(false),
       license_type_(kLicenseTypeStreaming),
-      is_certificate_loaded_(false) {
+      is_certificate_loaded_(false),
+      event_dispatcher_(event_dispatcher),
+      crypto_session_pool_(crypto_session_pool) {
   if (cdm_client_property_set) {
     Properties::AddSessionPropertySet(session_id_, cdm_client_property_set);
   }
 }
 
-CdmSession::~CdmSession() { Properties::RemoveSessionPropertySet(session_id_); }
+CdmSession::~CdmSession() {
+  if (event_dispatcher_) {
+    for (CdmEventListenerIter iter = listeners_.begin();
+         iter != listeners_.end(); ++iter) {
+      event_dispatcher_->Cancel(*iter, session_id_);
+    }
+  }
+  Properties::RemoveSessionPropertySet(session_id_);
+}
 
-CdmResponseType CdmSession::Init() {
-  scoped_ptr<CryptoSession> session(new CryptoSession());
+CdmResponseType CdmSession::Init() { return InitInternal(NULL, NULL); }
 
-  CdmResponseType sts = session->Open(GetRequestedSecurityLevel());
-  if (NO_ERROR != sts) return sts;
+CdmResponseType CdmSession::Init(const std::string& certificate,
+                                 const std::string& wrapped_key) {
+  return InitInternal(&certificate, &wrapped_key);
+}
+
+CdmResponseType CdmSession::InitInternal(const std::string* certificate,
+                                         const std::string* wrapped_key) {
+  SecurityLevel security_level = GetRequestedSecurityLevel();
+  scoped_ptr<CryptoSession> session;
+  if (crypto_session_pool_)
+    session.reset(crypto_session_pool_->Acquire(security_level));
+
+  if (session.get() == NULL) {
+    session.reset(new CryptoSession());
+    CdmResponseType sts =
+        crypto_session_pool_
+            ? crypto_session_pool_->Open(session.get(), security_level)
+            : session->Open(security_level);
+    if (NO_ERROR != sts) return sts;
+  }
 
   std::string token;
   if (Properties::use_certificates_as_identification()) {
-    File file;
-    DeviceFiles handle;
-    if (!handle.Init(&file, session.get()->GetSecurityLevel()) ||
-        !handle.RetrieveCertificate(&token, &wrapped_key_)) {
-      return NEED_PROVISIONING;
+    if (certificate && wrapped_key && !certificate->empty()) {
+      token = *certificate;
+      wrapped_key_ = *wrapped_key;
+    } else {
+      File file;
+      DeviceFiles handle;
+      if (!handle.Init(&file, session.get()->GetSecurityLevel()) ||
+          !handle.RetrieveCertificate(&token, &wrapped_key_)) {
+        return NEED_PROVISIONING;
+      }
     }
+    certificate_ = token;
   } else {
     if (!session->GetToken(&token)) return UNKNOWN_ERROR;
   }
 
   if (!license_parser_.Init(token, session.get(), &policy_engine_))
     return UNKNOWN_ERROR;
+  policy_engine_.SetRenewalJitter(Properties::renewal_jitter_seconds(),
+                                  session.get());
 
   crypto_session_.reset(session.release());
   license_received_ = false;
@@ -108,6 +146,7 @@ CdmResponseType CdmSession::RestoreOfflineSession(
 
   license_received_ = true;
   license_type_ = license_type;
+  DispatchKeyStatusEvents();
   return KEY_ADDED;
 }
 
@@ -122,6 +161,16 @@ CdmResponseType CdmSession::GenerateKeyRequest(
     const CdmInitData& init_data, const CdmLicenseType license_type,
     const CdmAppParameterMap& app_parameters, CdmKeyMessage* key_request,
     std::string* server_url) {
+  CdmInitDataList init_data_list;
+  if (!init_data.empty()) init_data_list.push_back(init_data);
+  return GenerateKeyRequest(init_data_list, license_type, app_parameters,
+                            key_request, server_url);
+}
+
+CdmResponseType CdmSession::GenerateKeyRequest(
+    const CdmInitDataList& init_data, const CdmLicenseType license_type,
+    const CdmAppParameterMap& app_parameters, CdmKeyMessage* key_request,
+    std::string* server_url) {
   if (reinitialize_session_) {
     CdmResponseType sts = Init();
     if (sts != NO_ERROR) {
@@ -154,10 +203,12 @@ CdmResponseType CdmSession::GenerateKeyRequest(
       return KEY_ERROR;
     }
 
-    CdmInitData pssh_data = init_data;
+    CdmInitDataList pssh_data = init_data;
     if (Properties::extract_pssh_data()) {
-      if (!CdmEngine::ExtractWidevinePssh(init_data, &pssh_data)) {
-        return KEY_ERROR;
+      for (size_t i = 0; i < init_data.size(); ++i) {
+        if (!CdmEngine::ExtractWidevinePssh(init_data[i], &pssh_data[i])) {
+          return KEY_ERROR;
+        }
       }
     }
 
@@ -213,6 +264,7 @@ CdmResponseType CdmSession::AddKey(const CdmKeyResponse& key_response,
     if (sts != KEY_ADDED) return sts;
 
     license_received_ = true;
+    DispatchKeyStatusEvents();
 
     if (license_type_ == kLicenseTypeOffline) {
       offline_key_response_ = key_response;
@@ -274,6 +326,10 @@ CdmResponseType CdmSession::QueryKeyStatus(CdmQueryMap* key_info) {
   return policy_engine_.Query(key_info);
 }
 
+CdmResponseType CdmSession::QueryKeyStatus(CdmKeyStatus* key_status) {
+  return policy_engine_.Query(key_status);
+}
+
 CdmResponseType CdmSession::QueryKeyControlInfo(CdmQueryMap* key_info) {
   if (crypto_session_.get() == NULL) {
     LOGW("CdmSession::QueryKeyControlInfo: Invalid crypto session");
@@ -303,16 +359,13 @@ CdmResponseType CdmSession::Decrypt(const CdmDecryptionParameters& params) {
   if (crypto_session_.get() == NULL || !crypto_session_->IsOpen())
     return UNKNOWN_ERROR;
 
+  if (policy_engine_.IsDecryptionDeadlinePassed())
+    return NEED_KEY;
+
   CdmResponseType status = crypto_session_->Decrypt(params);
   // TODO(rfrias): Remove after support for OEMCrypto_ERROR_KEY_EXPIRED is in
-  if (UNKNOWN_ERROR == status) {
-    Clock clock;
-    int64_t current_time = clock.GetCurrentTime();
-    if (policy_engine_.IsLicenseDurationExpired(current_time) ||
-        policy_engine_.IsPlaybackDurationExpired(current_time)) {
-      return NEED_KEY;
-    }
-  }
+  if (UNKNOWN_ERROR == status && policy_engine_.IsDecryptionDeadlinePassed())
+    return NEED_KEY;
   return status;
 }
 
@@ -334,6 +387,8 @@ CdmResponseType CdmSession::GenerateRenewalRequest(CdmKeyMessage* key_request,
 CdmResponseType CdmSession::RenewKey(const CdmKeyResponse& key_response) {
   CdmResponseType sts =
       license_parser_.HandleKeyUpdateResponse(true, key_response);
+  if (sts != KEY_ADDED) policy_engine_.OnRenewalFailure();
+  DispatchKeyStatusEvents();
   if (sts != KEY_ADDED) return sts;
 
   if (license_type_ == kLicenseTypeOffline) {
@@ -421,7 +476,11 @@ bool CdmSession::AttachEventListener(WvCdmEventListener* listener) {
 }
 
 bool CdmSession::DetachEventListener(WvCdmEventListener* listener) {
-  return (listeners_.erase(listener) == 1);
+  if (listeners_.erase(listener) != 1) return false;
+
+  // No events are delivered to the listener once detached
+  if (event_dispatcher_) event_dispatcher_->Cancel(listener, session_id_);
+  return true;
 }
 
 void CdmSession::OnTimerEvent() {
@@ -429,24 +488,60 @@ void CdmSession::OnTimerEvent() {
   CdmEventType event;
 
   policy_engine_.OnTimerEvent(event_occurred, event);
+  DispatchKeyStatusEvents();
 
-  if (event_occurred) {
-    for (CdmEventListenerIter iter = listeners_.begin();
-         iter != listeners_.end(); ++iter) {
+  if (event_occurred) NotifyEvent(event);
+}
+
+void CdmSession::NotifyEvent(CdmEventType event) {
+  for (CdmEventListenerIter iter = listeners_.begin();
+       iter != listeners_.end(); ++iter) {
+    if (event_dispatcher_) {
+      event_dispatcher_->Post(*iter, session_id_, event);
+    } else {
       (*iter)->onEvent(session_id_, event);
     }
   }
 }
 
 void CdmSession::OnKeyReleaseEvent(const CdmKeySetId& key_set_id) {
-  if (key_set_id_ == key_set_id) {
-    for (CdmEventListenerIter iter = listeners_.begin();
-         iter != listeners_.end(); ++iter) {
-      (*iter)->onEvent(session_id_, LICENSE_EXPIRED_EVENT);
+  if (key_set_id_ == key_set_id) NotifyEvent(LICENSE_EXPIRED_EVENT);
+}
+
+void CdmSession::DispatchKeyStatusEvents() {
+  if (!policy_engine_.has_key_status_events()) return;
+
+  std::vector<CdmKeyStatusEvent> events;
+  policy_engine_.GetKeyStatusEvents(&events);
+  for (CdmEventListenerIter iter = listeners_.begin();
+       iter != listeners_.end(); ++iter) {
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (event_dispatcher_) {
+        event_dispatcher_->Post(*iter, session_id_, events[i]);
+      } else {
+        (*iter)->onKeyStatusEvent(session_id_, events[i]);
+      }
     }
   }
 }
 
+bool CdmSession::GetDeviceCertificate(std::string* certificate,
+                                      std::string* wrapped_key) {
+  if (!Properties::use_certificates_as_identification() ||
+      certificate_.empty()) {
+    return false;
+  }
+
+  if (!certificate || !wrapped_key) {
+    LOGE("CdmSession::GetDeviceCertificate: no destination provided");
+    return false;
+  }
+
+  *certificate = certificate_;
+  *wrapped_key = wrapped_key_;
+  return true;
+}
+
 SecurityLevel CdmSession::GetRequestedSecurityLevel() {
   if (Properties::GetSecurityLevel(session_id_)
           .compare(QUERY_VALUE_SECURITY_LEVEL_L3) == 0) {
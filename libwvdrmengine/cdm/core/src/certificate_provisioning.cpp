@@ -1,6 +1,7 @@
 // Copyright 2013 Google Inc. All Rights Reserved.
 
 #include "certificate_provisioning.h"
+#include "crypto_session_pool.h"
 #include "device_files.h"
 #include "file_store.h"
 #include "license_protocol.pb.h"
@@ -58,7 +59,11 @@ CdmResponseType CertificateProvisioning::GetProvisioningRequest(
     std::string* default_url) {
   default_url->assign(kDefaultProvisioningServerUrl);
 
-  CdmResponseType sts = crypto_session_.Open(requested_security_level);
+  CdmResponseType sts =
+      crypto_session_pool_
+          ? crypto_session_pool_->Open(&crypto_session_,
+                                       requested_security_level)
+          : crypto_session_.Open(requested_security_level);
   if (NO_ERROR != sts) {
     LOGE("GetProvisioningRequest: fails to create a crypto session");
     return sts;
@@ -8,6 +8,7 @@
 #include <arpa/inet.h>  // TODO(fredgc): Add ntoh to wv_cdm_utilities.h
 #include <iostream>
 
+#include "clock.h"
 #include "crypto_key.h"
 #include "log.h"
 #include "properties.h"
@@ -24,13 +25,23 @@ std::string EncodeUint32(unsigned int u) {
   s.append(1, (u >> 0) & 0xFF);
   return s;
 }
+
+const uint32_t kIdleTimerPeriodSeconds = 1;
 }
 
 namespace wvcdm {
 
+class CryptoSession::IdleTimerHandler : public TimerHandler {
+ public:
+  virtual void OnTimerEvent() { CryptoSession::OnIdleTimerEvent(); }
+};
+
 Lock CryptoSession::crypto_lock_;
 bool CryptoSession::initialized_ = false;
 int CryptoSession::session_count_ = 0;
+int64_t CryptoSession::idle_since_ = 0;
+CryptoSession::IdleTimerHandler CryptoSession::idle_timer_handler_;
+Timer CryptoSession::idle_timer_;
 
 CryptoSession::CryptoSession()
     : open_(false),
@@ -64,6 +75,36 @@ void CryptoSession::Terminate() {
   AutoLock auto_lock(crypto_lock_);
   session_count_ -= 1;
   if (session_count_ > 0 || !initialized_) return;
+
+  // Short lived sessions, such as those opened to query the device, would
+  // otherwise initialize OEMCrypto again each time
+  if (Properties::oem_crypto_idle_termination_seconds() > 0) {
+    Clock clock;
+    idle_since_ = clock.GetMonotonicTime();
+    if (idle_timer_.IsRunning() ||
+        idle_timer_.Start(&idle_timer_handler_, kIdleTimerPeriodSeconds)) {
+      return;
+    }
+    LOGW("CryptoSession::Terminate: unable to start idle timer");
+  }
+  TerminateOEMCrypto();
+}
+
+bool CryptoSession::Shutdown() {
+  AutoLock auto_lock(crypto_lock_);
+  if (session_count_ > 0) return false;
+  // The idle timer stops itself on its next event
+  if (initialized_) TerminateOEMCrypto();
+  return true;
+}
+
+bool CryptoSession::IsOEMCryptoInitialized() {
+  AutoLock auto_lock(crypto_lock_);
+  return initialized_;
+}
+
+// Caller must hold crypto_lock_
+void CryptoSession::TerminateOEMCrypto() {
   OEMCryptoResult sts = OEMCrypto_Terminate();
   if (OEMCrypto_SUCCESS != sts) {
     LOGE("OEMCrypto_Terminate failed: %d", sts);
@@ -71,6 +112,19 @@ void CryptoSession::Terminate() {
   initialized_ = false;
 }
 
+void CryptoSession::OnIdleTimerEvent() {
+  AutoLock auto_lock(crypto_lock_);
+  if (session_count_ == 0 && initialized_) {
+    Clock clock;
+    if (clock.GetMonotonicTime() - idle_since_ <
+        static_cast<int64_t>(Properties::oem_crypto_idle_termination_seconds()))
+      return;
+    TerminateOEMCrypto();
+  }
+  // Started again by the next Terminate that leaves OEMCrypto idle
+  idle_timer_.Stop();
+}
+
 bool CryptoSession::ValidateKeybox() {
   LOGV("CryptoSession::ValidateKeybox: Lock");
   AutoLock auto_lock(crypto_lock_);
@@ -103,6 +157,11 @@ bool CryptoSession::GetToken(std::string* token) {
 }
 
 CdmSecurityLevel CryptoSession::GetSecurityLevel() {
+  return GetSecurityLevel(requested_security_level_);
+}
+
+CdmSecurityLevel CryptoSession::GetSecurityLevel(
+    SecurityLevel requested_security_level) {
   LOGV("CryptoSession::GetSecurityLevel: Lock");
   AutoLock auto_lock(crypto_lock_);
   if (!initialized_) {
@@ -110,7 +169,7 @@ CdmSecurityLevel CryptoSession::GetSecurityLevel() {
   }
 
   std::string security_level =
-      OEMCrypto_SecurityLevel(requested_security_level_);
+      OEMCrypto_SecurityLevel(requested_security_level);
 
   if ((security_level.size() != 2) || (security_level.at(0) != 'L')) {
     return kSecurityLevelUnknown;
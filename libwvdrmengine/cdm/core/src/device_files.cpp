@@ -7,11 +7,17 @@
 
 #include "device_files.pb.h"
 #include "file_store.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
 #include "log.h"
+#include "message_cache.h"
 #include "openssl/sha.h"
 #include "properties.h"
 
 // Protobuf generated classes.
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
 using video_widevine_client::sdk::DeviceCertificate;
 using video_widevine_client::sdk::HashedFile;
 using video_widevine_client::sdk::License;
@@ -19,15 +25,159 @@ using video_widevine_client::sdk::License_LicenseState_ACTIVE;
 using video_widevine_client::sdk::License_LicenseState_RELEASING;
 
 namespace {
+const size_t kMaxCachedFiles = 2;
 const char kCertificateFileName[] = "cert.bin";
 const char kLicenseFileNameExt[] = ".lic";
 const char kWildcard[] = "*";
 const char kPathDelimiter[] = "/";
-const char *kSecurityLevelPathCompatibilityExclusionList[] = { "ay64.dat" };
+const char kSecurityLevelPathMigrationFileName[] = "migration.ver";
+const char kSecurityLevelPathMigrationTempFileName[] = "migration.ver.tmp";
+const char kSecurityLevelPathMigrationVersion[] = "1";
+const char *kSecurityLevelPathCompatibilityExclusionList[] = {
+    "ay64.dat", kSecurityLevelPathMigrationFileName,
+    kSecurityLevelPathMigrationTempFileName };
+
+// Serializes |file| into |output| as a HashedFile record in a single pass.
+// The File is serialized directly behind the HashedFile framing and hashed
+// in place, so the record is neither serialized twice nor copied.
+bool SerializeHashedFile(const video_widevine_client::sdk::File& file,
+                         std::string* output) {
+  const uint32_t file_tag = WireFormatLite::MakeTag(
+      HashedFile::kFileFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  const uint32_t hash_tag = WireFormatLite::MakeTag(
+      HashedFile::kHashFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+  int file_size = file.ByteSize();
+  size_t size = CodedOutputStream::VarintSize32(file_tag) +
+                CodedOutputStream::VarintSize32(file_size) + file_size +
+                CodedOutputStream::VarintSize32(hash_tag) +
+                CodedOutputStream::VarintSize32(SHA256_DIGEST_LENGTH) +
+                SHA256_DIGEST_LENGTH;
+  output->resize(size);
+
+  uint8_t* ptr = reinterpret_cast<uint8_t*>(&(*output)[0]);
+  ptr = CodedOutputStream::WriteVarint32ToArray(file_tag, ptr);
+  ptr = CodedOutputStream::WriteVarint32ToArray(file_size, ptr);
+  uint8_t* file_data = ptr;
+  ptr = file.SerializeWithCachedSizesToArray(ptr);
+  if (ptr != file_data + file_size) {
+    LOGW("SerializeHashedFile: File serialization size mismatch");
+    return false;
+  }
+
+  ptr = CodedOutputStream::WriteVarint32ToArray(hash_tag, ptr);
+  ptr = CodedOutputStream::WriteVarint32ToArray(SHA256_DIGEST_LENGTH, ptr);
+  SHA256_CTX sha256;
+  SHA256_Init(&sha256);
+  SHA256_Update(&sha256, file_data, file_size);
+  SHA256_Final(ptr, &sha256);
+  return true;
+}
+
+// Parses a HashedFile record. The hash is verified over the embedded File
+// bytes where they lie in |data|, and those bytes are parsed into |file|
+// without first being copied out.
+bool ParseHashedFile(const std::string& data,
+                     video_widevine_client::sdk::File* file) {
+  const uint8_t* file_data = NULL;
+  const uint8_t* hash = NULL;
+  uint32_t file_size = 0;
+  uint32_t hash_size = 0;
+
+  CodedInputStream input(reinterpret_cast<const uint8_t*>(data.data()),
+                         data.size());
+  uint32_t tag;
+  while ((tag = input.ReadTag()) != 0) {
+    if (WireFormatLite::GetTagWireType(tag) !=
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!WireFormatLite::SkipField(&input, tag)) return false;
+      continue;
+    }
+
+    uint32_t length;
+    if (!input.ReadVarint32(&length)) return false;
+
+    const void* field_data = NULL;
+    int available = 0;
+    if (length > 0 &&
+        (!input.GetDirectBufferPointer(&field_data, &available) ||
+         static_cast<uint32_t>(available) < length)) {
+      return false;
+    }
+
+    switch (WireFormatLite::GetTagFieldNumber(tag)) {
+      case HashedFile::kFileFieldNumber:
+        file_data = static_cast<const uint8_t*>(field_data);
+        file_size = length;
+        break;
+      case HashedFile::kHashFieldNumber:
+        hash = static_cast<const uint8_t*>(field_data);
+        hash_size = length;
+        break;
+      default:
+        break;
+    }
+    if (!input.Skip(length)) return false;
+  }
+
+  if (!input.ConsumedEntireMessage()) {
+    LOGW("ParseHashedFile: Unable to parse hash file");
+    return false;
+  }
+
+  uint8_t computed_hash[SHA256_DIGEST_LENGTH];
+  SHA256_CTX sha256;
+  SHA256_Init(&sha256);
+  SHA256_Update(&sha256, file_data, file_size);
+  SHA256_Final(computed_hash, &sha256);
+
+  if (hash_size != SHA256_DIGEST_LENGTH ||
+      memcmp(computed_hash, hash, SHA256_DIGEST_LENGTH) != 0) {
+    LOGW("ParseHashedFile: Hash mismatch");
+    return false;
+  }
+
+  if (!file->ParseFromArray(file_data, file_size)) {
+    LOGW("ParseHashedFile: Unable to parse file");
+    return false;
+  }
+  return true;
+}
 }  // namespace
 
 namespace wvcdm {
 
+// Overwrites the certificate and license bytes a recycled file retains
+static void WipeFile(video_widevine_client::sdk::File* file) {
+  if (file->has_device_certificate()) {
+    DeviceCertificate* device_certificate = file->mutable_device_certificate();
+    if (device_certificate->has_certificate())
+      WipeString(device_certificate->mutable_certificate());
+    if (device_certificate->has_wrapped_private_key())
+      WipeString(device_certificate->mutable_wrapped_private_key());
+  }
+  if (file->has_license()) {
+    License* license = file->mutable_license();
+    for (int i = 0; i < license->pssh_data_size(); ++i)
+      WipeString(license->mutable_pssh_data(i));
+    if (license->has_license_request())
+      WipeString(license->mutable_license_request());
+    if (license->has_license()) WipeString(license->mutable_license());
+    if (license->has_renewal_request())
+      WipeString(license->mutable_renewal_request());
+    if (license->has_renewal()) WipeString(license->mutable_renewal());
+  }
+}
+
+// File messages are recycled so the license and certificate buffers of a
+// record are reused by the next store or retrieve. Their contents are wiped
+// whenever they are returned to the cache.
+static MessageCache<video_widevine_client::sdk::File> file_cache(
+    kMaxCachedFiles, WipeFile);
+
+Lock DeviceFiles::migration_lock_;
+bool DeviceFiles::security_level_path_migrated_ = false;
+
 bool DeviceFiles::Init(const File* handle, CdmSecurityLevel security_level) {
   if (handle == NULL) {
     LOGW("DeviceFiles::Init: Invalid file handle parameter");
@@ -56,33 +206,22 @@ bool DeviceFiles::StoreCertificate(const std::string& certificate,
   }
 
   // Fill in file information
-  video_widevine_client::sdk::File file;
+  CachedMessage<video_widevine_client::sdk::File> file(&file_cache);
 
-  file.set_type(video_widevine_client::sdk::File::DEVICE_CERTIFICATE);
-  file.set_version(video_widevine_client::sdk::File::VERSION_1);
+  file->set_type(video_widevine_client::sdk::File::DEVICE_CERTIFICATE);
+  file->set_version(video_widevine_client::sdk::File::VERSION_1);
 
-  DeviceCertificate* device_certificate = file.mutable_device_certificate();
+  DeviceCertificate* device_certificate = file->mutable_device_certificate();
   device_certificate->set_certificate(certificate);
   device_certificate->set_wrapped_private_key(wrapped_private_key);
 
-  std::string serialized_string;
-  file.SerializeToString(&serialized_string);
-
-  // calculate SHA hash
-  std::string hash;
-  if (!Hash(serialized_string, &hash)) {
-    LOGW("DeviceFiles::StoreCertificate: Hash computation failed");
+  std::string serialized_hashed_file;
+  if (!SerializeHashedFile(*file, &serialized_hashed_file)) {
+    LOGW("DeviceFiles::StoreCertificate: Serialization failed");
     return false;
   }
 
-  // Fill in hashed file data
-  HashedFile hashed_file;
-  hashed_file.set_file(serialized_string);
-  hashed_file.set_hash(hash);
-
-  hashed_file.SerializeToString(&serialized_string);
-
-  return StoreFile(kCertificateFileName, serialized_string);
+  return StoreFile(kCertificateFileName, serialized_hashed_file);
 }
 
 bool DeviceFiles::RetrieveCertificate(std::string* certificate,
@@ -93,52 +232,35 @@ bool DeviceFiles::RetrieveCertificate(std::string* certificate,
   }
 
   if (Properties::security_level_path_backward_compatibility_support()) {
-    SecurityLevelPathBackwardCompatibility();
+    MigrateSecurityLevelPath(file_);
   }
 
   std::string serialized_hashed_file;
   if (!RetrieveFile(kCertificateFileName, &serialized_hashed_file))
     return false;
 
-  HashedFile hashed_file;
-  if (!hashed_file.ParseFromString(serialized_hashed_file)) {
-    LOGW("DeviceFiles::RetrieveCertificate: Unable to parse hash file");
-    return false;
-  }
-
-  std::string hash;
-  if (!Hash(hashed_file.file(), &hash)) {
-    LOGW("DeviceFiles::RetrieveCertificate: Hash computation failed");
-    return false;
-  }
-
-  if (hash.compare(hashed_file.hash())) {
-    LOGW("DeviceFiles::RetrieveCertificate: Hash mismatch");
-    return false;
-  }
-
-  video_widevine_client::sdk::File file;
-  if (!file.ParseFromString(hashed_file.file())) {
+  CachedMessage<video_widevine_client::sdk::File> file(&file_cache);
+  if (!ParseHashedFile(serialized_hashed_file, file.get())) {
     LOGW("DeviceFiles::RetrieveCertificate: Unable to parse file");
     return false;
   }
 
-  if (file.type() != video_widevine_client::sdk::File::DEVICE_CERTIFICATE) {
+  if (file->type() != video_widevine_client::sdk::File::DEVICE_CERTIFICATE) {
     LOGW("DeviceFiles::RetrieveCertificate: Incorrect file type");
     return false;
   }
 
-  if (file.version() != video_widevine_client::sdk::File::VERSION_1) {
+  if (file->version() != video_widevine_client::sdk::File::VERSION_1) {
     LOGW("DeviceFiles::RetrieveCertificate: Incorrect file version");
     return false;
   }
 
-  if (!file.has_device_certificate()) {
+  if (!file->has_device_certificate()) {
     LOGW("DeviceFiles::RetrieveCertificate: Certificate not present");
     return false;
   }
 
-  DeviceCertificate device_certificate = file.device_certificate();
+  const DeviceCertificate& device_certificate = file->device_certificate();
 
   *certificate = device_certificate.certificate();
   *wrapped_private_key = device_certificate.wrapped_private_key();
@@ -153,18 +275,32 @@ bool DeviceFiles::StoreLicense(const std::string& key_set_id,
                                const CdmKeyMessage& license_renewal_request,
                                const CdmKeyResponse& license_renewal,
                                const std::string& release_server_url) {
+  return StoreLicense(key_set_id, state, CdmInitDataList(1, pssh_data),
+                      license_request, license_message,
+                      license_renewal_request, license_renewal,
+                      release_server_url);
+}
+
+bool DeviceFiles::StoreLicense(const std::string& key_set_id,
+                               const LicenseState state,
+                               const CdmInitDataList& pssh_data,
+                               const CdmKeyMessage& license_request,
+                               const CdmKeyResponse& license_message,
+                               const CdmKeyMessage& license_renewal_request,
+                               const CdmKeyResponse& license_renewal,
+                               const std::string& release_server_url) {
   if (!initialized_) {
     LOGW("DeviceFiles::StoreLicense: not initialized");
     return false;
   }
 
   // Fill in file information
-  video_widevine_client::sdk::File file;
+  CachedMessage<video_widevine_client::sdk::File> file(&file_cache);
 
-  file.set_type(video_widevine_client::sdk::File::LICENSE);
-  file.set_version(video_widevine_client::sdk::File::VERSION_1);
+  file->set_type(video_widevine_client::sdk::File::LICENSE);
+  file->set_version(video_widevine_client::sdk::File::VERSION_1);
 
-  License* license = file.mutable_license();
+  License* license = file->mutable_license();
   switch (state) {
     case kLicenseStateActive:
       license->set_state(License_LicenseState_ACTIVE);
@@ -177,32 +313,22 @@ bool DeviceFiles::StoreLicense(const std::string& key_set_id,
       return false;
       break;
   }
-  license->set_pssh_data(pssh_data);
+  for (size_t i = 0; i < pssh_data.size(); ++i)
+    license->add_pssh_data(pssh_data[i]);
   license->set_license_request(license_request);
   license->set_license(license_message);
   license->set_renewal_request(license_renewal_request);
   license->set_renewal(license_renewal);
   license->set_release_server_url(release_server_url);
 
-  std::string serialized_string;
-  file.SerializeToString(&serialized_string);
-
-  // calculate SHA hash
-  std::string hash;
-  if (!Hash(serialized_string, &hash)) {
-    LOGW("DeviceFiles::StoreLicense: Hash computation failed");
+  std::string serialized_hashed_file;
+  if (!SerializeHashedFile(*file, &serialized_hashed_file)) {
+    LOGW("DeviceFiles::StoreLicense: Serialization failed");
     return false;
   }
 
-  // File in hashed file data
-  HashedFile hashed_file;
-  hashed_file.set_file(serialized_string);
-  hashed_file.set_hash(hash);
-
-  hashed_file.SerializeToString(&serialized_string);
-
   std::string file_name = key_set_id + kLicenseFileNameExt;
-  return StoreFile(file_name.c_str(), serialized_string);
+  return StoreFile(file_name.c_str(), serialized_hashed_file);
 }
 
 bool DeviceFiles::RetrieveLicense(const std::string& key_set_id,
@@ -212,6 +338,27 @@ bool DeviceFiles::RetrieveLicense(const std::string& key_set_id,
                                   CdmKeyMessage* license_renewal_request,
                                   CdmKeyResponse* license_renewal,
                                   std::string* release_server_url) {
+  CdmInitDataList pssh_data_list;
+  if (!RetrieveLicense(key_set_id, state, &pssh_data_list, license_request,
+                       license_message, license_renewal_request,
+                       license_renewal, release_server_url)) {
+    return false;
+  }
+  if (pssh_data_list.empty())
+    pssh_data->clear();
+  else
+    *pssh_data = pssh_data_list[0];
+  return true;
+}
+
+bool DeviceFiles::RetrieveLicense(const std::string& key_set_id,
+                                  LicenseState* state,
+                                  CdmInitDataList* pssh_data,
+                                  CdmKeyMessage* license_request,
+                                  CdmKeyResponse* license_message,
+                                  CdmKeyMessage* license_renewal_request,
+                                  CdmKeyResponse* license_renewal,
+                                  std::string* release_server_url) {
   if (!initialized_) {
     LOGW("DeviceFiles::RetrieveLicense: not initialized");
     return false;
@@ -221,45 +368,28 @@ bool DeviceFiles::RetrieveLicense(const std::string& key_set_id,
   std::string file_name = key_set_id + kLicenseFileNameExt;
   if (!RetrieveFile(file_name.c_str(), &serialized_hashed_file)) return false;
 
-  HashedFile hashed_file;
-  if (!hashed_file.ParseFromString(serialized_hashed_file)) {
-    LOGW("DeviceFiles::RetrieveLicense: Unable to parse hash file");
-    return false;
-  }
-
-  std::string hash;
-  if (!Hash(hashed_file.file(), &hash)) {
-    LOGW("DeviceFiles::RetrieveLicense: Hash computation failed");
-    return false;
-  }
-
-  if (hash.compare(hashed_file.hash())) {
-    LOGW("DeviceFiles::RetrieveLicense: Hash mismatch");
-    return false;
-  }
-
-  video_widevine_client::sdk::File file;
-  if (!file.ParseFromString(hashed_file.file())) {
+  CachedMessage<video_widevine_client::sdk::File> file(&file_cache);
+  if (!ParseHashedFile(serialized_hashed_file, file.get())) {
     LOGW("DeviceFiles::RetrieveLicense: Unable to parse file");
     return false;
   }
 
-  if (file.type() != video_widevine_client::sdk::File::LICENSE) {
+  if (file->type() != video_widevine_client::sdk::File::LICENSE) {
     LOGW("DeviceFiles::RetrieveLicense: Incorrect file type");
     return false;
   }
 
-  if (file.version() != video_widevine_client::sdk::File::VERSION_1) {
+  if (file->version() != video_widevine_client::sdk::File::VERSION_1) {
     LOGW("DeviceFiles::RetrieveLicense: Incorrect file version");
     return false;
   }
 
-  if (!file.has_license()) {
+  if (!file->has_license()) {
     LOGW("DeviceFiles::RetrieveLicense: License not present");
     return false;
   }
 
-  License license = file.license();
+  const License& license = file->license();
 
   switch (license.state()) {
     case License_LicenseState_ACTIVE:
@@ -274,7 +404,7 @@ bool DeviceFiles::RetrieveLicense(const std::string& key_set_id,
       *state = kLicenseStateUnknown;
       break;
   }
-  *pssh_data = license.pssh_data();
+  pssh_data->assign(license.pssh_data().begin(), license.pssh_data().end());
   *license_request = license.license_request();
   *license_message = license.license();
   *license_renewal_request = license.renewal_request();
@@ -349,17 +479,46 @@ bool DeviceFiles::LicenseExists(const std::string& key_set_id) {
   return file_->Exists(path);
 }
 
-bool DeviceFiles::Hash(const std::string& data, std::string* hash) {
-  if (!hash) return false;
+bool DeviceFiles::ListLicenses(std::vector<std::string>* key_set_ids) {
+  if (!initialized_) {
+    LOGW("DeviceFiles::ListLicenses: not initialized");
+    return false;
+  }
 
-  hash->resize(SHA256_DIGEST_LENGTH);
-  SHA256_CTX sha256;
-  SHA256_Init(&sha256);
-  SHA256_Update(&sha256, data.data(), data.size());
-  SHA256_Final(reinterpret_cast<unsigned char*>(&(*hash)[0]), &sha256);
+  if (!key_set_ids) {
+    LOGW("DeviceFiles::ListLicenses: Unspecified key set id parameter");
+    return false;
+  }
+
+  std::string path;
+  if (!Properties::GetDeviceFilesBasePath(security_level_, &path)) {
+    LOGW("DeviceFiles::ListLicenses: Unable to get base path");
+    return false;
+  }
+
+  key_set_ids->clear();
+  if (!file_->IsDirectory(path)) return true;
+
+  std::vector<std::string> files;
+  if (!file_->List(path, &files)) {
+    LOGW("DeviceFiles::ListLicenses: Unable to list %s", path.c_str());
+    return false;
+  }
+
+  const size_t ext_length = strlen(kLicenseFileNameExt);
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string& name = files[i];
+    if (name.size() > ext_length &&
+        name.compare(name.size() - ext_length, ext_length,
+                     kLicenseFileNameExt) == 0) {
+      key_set_ids->push_back(name.substr(0, name.size() - ext_length));
+    }
+  }
   return true;
 }
 
+// Flushes the file data before returning, see the comment on the Store calls
+// in device_files.h
 bool DeviceFiles::StoreFile(const char* name, const std::string& data) {
   if (!file_) {
     LOGW("DeviceFiles::StoreFile: Invalid file handle");
@@ -389,6 +548,8 @@ bool DeviceFiles::StoreFile(const char* name, const std::string& data) {
   }
 
   ssize_t bytes = file_->Write(data.data(), data.size());
+  bool synced = bytes == static_cast<ssize_t>(data.size()) &&
+                file_->DataSync();
   file_->Close();
 
   if (bytes != static_cast<ssize_t>(data.size())) {
@@ -396,6 +557,11 @@ bool DeviceFiles::StoreFile(const char* name, const std::string& data) {
     return false;
   }
 
+  if (!synced) {
+    LOGW("DeviceFiles::StoreFile: sync failed: %s", path.c_str());
+    return false;
+  }
+
   LOGV("DeviceFiles::StoreFile: success: %s (%db)", path.c_str(), data.size());
   return true;
 }
@@ -454,19 +620,26 @@ bool DeviceFiles::RetrieveFile(const char* name, std::string* data) {
   return true;
 }
 
-void DeviceFiles::SecurityLevelPathBackwardCompatibility() {
+bool DeviceFiles::MigrateSecurityLevelPath(File* file) {
+  if (!file) {
+    LOGW("DeviceFiles::MigrateSecurityLevelPath: Invalid file handle");
+    return false;
+  }
+
+  AutoLock auto_lock(migration_lock_);
+  if (security_level_path_migrated_) return true;
+
   std::string path;
-  if (!Properties::GetDeviceFilesBasePath(security_level_, &path)) {
-    LOGW("DeviceFiles::SecurityLevelPathBackwardCompatibility: Unable to "
-        "get base path");
-    return;
+  if (!Properties::GetDeviceFilesBasePath(kSecurityLevelL1, &path)) {
+    LOGW("DeviceFiles::MigrateSecurityLevelPath: Unable to get base path");
+    return false;
   }
 
   std::vector<std::string> security_dirs;
   if (!Properties::GetSecurityLevelDirectories(&security_dirs)) {
-    LOGW("DeviceFiles::SecurityLevelPathBackwardCompatibility: Unable to "
-        "get security directories");
-    return;
+    LOGW("DeviceFiles::MigrateSecurityLevelPath: Unable to get security "
+        "directories");
+    return false;
   }
 
   size_t pos = std::string::npos;
@@ -477,40 +650,126 @@ void DeviceFiles::SecurityLevelPathBackwardCompatibility() {
   }
 
   if (pos == std::string::npos) {
-    LOGV("DeviceFiles::SecurityLevelPathBackwardCompatibility: Security level "
-        "specific path not found. Check properties?");
-    return;
+    LOGV("DeviceFiles::MigrateSecurityLevelPath: Security level specific "
+        "path not found. Check properties?");
+    security_level_path_migrated_ = true;
+    return true;
   }
 
   std::string from_dir(path, 0, pos);
+  std::string marker_path = from_dir + kSecurityLevelPathMigrationFileName;
 
-  std::vector<std::string> files;
-  file_->List(from_dir, &files);
+  if (IsSecurityLevelPathMigrated(file, marker_path)) {
+    security_level_path_migrated_ = true;
+    return true;
+  }
 
-  for (size_t i = 0; i < files.size(); ++i) {
-    std::string from = from_dir + files[i];
-    bool exclude = false;
-    for (size_t j = 0;
-         j < sizeof(kSecurityLevelPathCompatibilityExclusionList) /
-             sizeof(const char*);
-         j++) {
-      if (files[i].compare(kSecurityLevelPathCompatibilityExclusionList[j]) == 0) {
-        exclude = true;
-        break;
+  std::vector<std::string> files;
+  if (file->List(from_dir, &files)) {
+    // Copy every file into each security level directory first. File::Copy
+    // syncs the destination, so the marker is only written once all copies
+    // are durable.
+    std::vector<std::string> migrated_files;
+    for (size_t i = 0; i < files.size(); ++i) {
+      std::string from = from_dir + files[i];
+      bool exclude = false;
+      for (size_t j = 0;
+           j < sizeof(kSecurityLevelPathCompatibilityExclusionList) /
+               sizeof(const char*);
+           j++) {
+        if (files[i].compare(kSecurityLevelPathCompatibilityExclusionList[j]) ==
+            0) {
+          exclude = true;
+          break;
+        }
       }
+      if (exclude) continue;
+      if (!file->IsRegularFile(from)) continue;
+
+      for (size_t j = 0; j < security_dirs.size(); ++j) {
+        std::string to_dir = from_dir + security_dirs[j];
+        if (!file->Exists(to_dir))
+          file->CreateDirectory(to_dir);
+        std::string to = to_dir + files[i];
+        if (!file->Copy(from, to)) {
+          LOGW("DeviceFiles::MigrateSecurityLevelPath: Unable to copy %s to "
+              "%s", from.c_str(), to.c_str());
+          return false;
+        }
+      }
+      migrated_files.push_back(from);
     }
-    if (exclude) continue;
-    if (!file_->IsRegularFile(from)) continue;
-
-    for (size_t j = 0; j < security_dirs.size(); ++j) {
-      std::string to_dir = from_dir + security_dirs[j];
-      if (!file_->Exists(to_dir))
-        file_->CreateDirectory(to_dir);
-      std::string to = to_dir + files[i];
-      file_->Copy(from, to);
+
+    if (!StoreMigrationMarker(file, marker_path)) return false;
+
+    for (size_t i = 0; i < migrated_files.size(); ++i) {
+      file->Remove(migrated_files[i]);
     }
-    file_->Remove(from);
+  } else {
+    // Nothing was stored before the security level directories existed
+    if (!file->IsDirectory(from_dir) && !file->CreateDirectory(from_dir))
+      return false;
+    if (!StoreMigrationMarker(file, marker_path)) return false;
   }
+
+  security_level_path_migrated_ = true;
+  return true;
+}
+
+bool DeviceFiles::IsSecurityLevelPathMigrated(File* file,
+                                              const std::string& marker_path) {
+  if (!file->Exists(marker_path)) return false;
+
+  std::string version(sizeof(kSecurityLevelPathMigrationVersion) - 1, 0);
+  if (file->FileSize(marker_path) != static_cast<ssize_t>(version.size()))
+    return false;
+
+  if (!file->Open(marker_path, File::kReadOnly | File::kBinary)) {
+    LOGW("DeviceFiles::IsSecurityLevelPathMigrated: File open failed: %s",
+         marker_path.c_str());
+    return false;
+  }
+
+  ssize_t bytes = file->Read(&version[0], version.size());
+  file->Close();
+
+  return bytes == static_cast<ssize_t>(version.size()) &&
+         version.compare(kSecurityLevelPathMigrationVersion) == 0;
+}
+
+// The marker is written to a temporary file and renamed into place, so an
+// interrupted write never leaves a truncated marker behind
+bool DeviceFiles::StoreMigrationMarker(File* file,
+                                       const std::string& marker_path) {
+  std::string temp_path(marker_path, 0,
+                        marker_path.size() -
+                            strlen(kSecurityLevelPathMigrationFileName));
+  temp_path += kSecurityLevelPathMigrationTempFileName;
+
+  if (!file->Open(temp_path,
+                  File::kCreate | File::kTruncate | File::kBinary)) {
+    LOGW("DeviceFiles::StoreMigrationMarker: File open failed: %s",
+         temp_path.c_str());
+    return false;
+  }
+
+  size_t size = sizeof(kSecurityLevelPathMigrationVersion) - 1;
+  ssize_t bytes = file->Write(kSecurityLevelPathMigrationVersion, size);
+  bool synced = bytes == static_cast<ssize_t>(size) && file->DataSync();
+  file->Close();
+
+  if (!synced) {
+    LOGW("DeviceFiles::StoreMigrationMarker: write failed: %d %d", size,
+         bytes);
+    file->Remove(temp_path);
+    return false;
+  }
+
+  if (!file->Rename(temp_path, marker_path)) {
+    file->Remove(temp_path);
+    return false;
+  }
+  return true;
 }
 
 std::string DeviceFiles::GetCertificateFileName() {
@@ -521,4 +780,13 @@ std::string DeviceFiles::GetLicenseFileNameExtension() {
   return kLicenseFileNameExt;
 }
 
+std::string DeviceFiles::GetSecurityLevelPathMigrationFileName() {
+  return kSecurityLevelPathMigrationFileName;
+}
+
+void DeviceFiles::ResetSecurityLevelPathMigration() {
+  AutoLock auto_lock(migration_lock_);
+  security_level_path_migrated_ = false;
+}
+
 }  // namespace wvcdm
@@ -2,14 +2,20 @@
 
 #include "license.h"
 
+#include <map>
 #include <vector>
 
 #include "crypto_key.h"
 #include "crypto_session.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "lock.h"
 #include "log.h"
+#include "message_cache.h"
 #include "policy_engine.h"
 #include "properties.h"
 #include "privacy_crypto.h"
+#include "service_certificate_cache.h"
 #include "string_conversions.h"
 #include "wv_cdm_constants.h"
 
@@ -79,7 +85,6 @@ namespace wvcdm {
 // Protobuf generated classes.
 using video_widevine_server::sdk::ClientIdentification;
 using video_widevine_server::sdk::ClientIdentification_NameValue;
-using video_widevine_server::sdk::DeviceCertificate;
 using video_widevine_server::sdk::EncryptedClientIdentification;
 using video_widevine_server::sdk::LicenseRequest;
 using video_widevine_server::sdk::LicenseRequest_ContentIdentification;
@@ -88,12 +93,79 @@ using video_widevine_server::sdk::
     LicenseRequest_ContentIdentification_ExistingLicense;
 using video_widevine_server::sdk::License;
 using video_widevine_server::sdk::License_KeyContainer;
+using video_widevine_server::sdk::License_KeyContainer_KeyControl;
 using video_widevine_server::sdk::LicenseError;
 using video_widevine_server::sdk::SignedDeviceCertificate;
 using video_widevine_server::sdk::SignedMessage;
 
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+// The token type, token and device client info of a ClientIdentification
+// do not change for a device and security level. They are serialized once,
+// split around the app parameters of each request so the client info keeps
+// the order of a message built in one piece: app parameters first.
+struct ClientIdentificationTemplate {
+  std::string token;
+  std::string prefix;
+  std::string suffix;
+};
+typedef std::map<CdmSecurityLevel, ClientIdentificationTemplate>
+    ClientIdentificationTemplateMap;
+
+static Lock client_id_template_lock;
+static ClientIdentificationTemplateMap client_id_templates;
+
+// Overwrites the license bytes and key material a recycled message retains
+static void WipeSignedMessage(SignedMessage* message) {
+  if (message->has_msg()) WipeString(message->mutable_msg());
+  if (message->has_signature()) WipeString(message->mutable_signature());
+  if (message->has_session_key()) WipeString(message->mutable_session_key());
+}
+
+static void WipeLicense(License* license) {
+  for (int i = 0; i < license->key_size(); ++i) {
+    License_KeyContainer* key = license->mutable_key(i);
+    if (key->has_id()) WipeString(key->mutable_id());
+    if (key->has_iv()) WipeString(key->mutable_iv());
+    if (key->has_key()) WipeString(key->mutable_key());
+    if (key->has_key_control()) {
+      License_KeyContainer_KeyControl* key_control =
+          key->mutable_key_control();
+      if (key_control->has_key_control_block())
+        WipeString(key_control->mutable_key_control_block());
+      if (key_control->has_iv()) WipeString(key_control->mutable_iv());
+    }
+  }
+}
+
+// Signed messages and licenses parsed from responses are recycled so their
+// key containers and buffers are reused by later responses. Their contents
+// are wiped whenever they are returned to the caches.
+static const size_t kMaxCachedMessages = 4;
+static MessageCache<SignedMessage> signed_message_cache(kMaxCachedMessages,
+                                                        WipeSignedMessage);
+static MessageCache<License> license_cache(kMaxCachedMessages, WipeLicense);
+
+// Appends a length delimited field to a serialized message. Parsers merge
+// the field into the message regardless of where it appears.
+static void AppendLengthDelimitedField(int field_number,
+                                       const std::string& value,
+                                       std::string* output) {
+  const uint32_t tag = WireFormatLite::MakeTag(
+      field_number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  size_t offset = output->size();
+  output->resize(offset + CodedOutputStream::VarintSize32(tag) +
+                 CodedOutputStream::VarintSize32(value.size()));
+  uint8_t* ptr = reinterpret_cast<uint8_t*>(&(*output)[offset]);
+  ptr = CodedOutputStream::WriteVarint32ToArray(tag, ptr);
+  CodedOutputStream::WriteVarint32ToArray(value.size(), ptr);
+  output->append(value);
+}
+
 static std::vector<CryptoKey> ExtractContentKeys(const License& license) {
   std::vector<CryptoKey> key_array;
+  key_array.reserve(license.key_size());
 
   // Extract content key(s)
   for (int i = 0; i < license.key_size(); ++i) {
@@ -163,6 +235,18 @@ bool CdmLicense::PrepareKeyRequest(const CdmInitData& init_data,
                                    const CdmSessionId& session_id,
                                    CdmKeyMessage* signed_request,
                                    std::string* server_url) {
+  CdmInitDataList init_data_list;
+  if (!init_data.empty()) init_data_list.push_back(init_data);
+  return PrepareKeyRequest(init_data_list, license_type, app_parameters,
+                           session_id, signed_request, server_url);
+}
+
+bool CdmLicense::PrepareKeyRequest(const CdmInitDataList& init_data,
+                                   const CdmLicenseType license_type,
+                                   const CdmAppParameterMap& app_parameters,
+                                   const CdmSessionId& session_id,
+                                   CdmKeyMessage* signed_request,
+                                   std::string* server_url) {
   if (!initialized_) {
     LOGE("CdmLicense::PrepareKeyRequest: not initialized");
     return false;
@@ -185,13 +269,13 @@ bool CdmLicense::PrepareKeyRequest(const CdmInitData& init_data,
   }
 
   bool privacy_mode_enabled = Properties::UsePrivacyMode(session_id);
-  std::vector<uint8_t> cert = Properties::GetServiceCertificate(session_id);
-  std::string serialized_service_certificate(cert.begin(), cert.end());
+  // A certificate set by the client takes precedence over one fetched from
+  // the license server
+  const std::vector<uint8_t>& client_service_certificate =
+      Properties::GetServiceCertificate(session_id);
 
-  if (serialized_service_certificate.empty())
-    serialized_service_certificate = service_certificate_;
-
-  if (privacy_mode_enabled && serialized_service_certificate.empty()) {
+  if (privacy_mode_enabled && client_service_certificate.empty() &&
+      service_certificate_.empty()) {
     init_data_ = init_data;
     return PrepareServiceCertificateRequest(signed_request, server_url);
   }
@@ -201,82 +285,30 @@ bool CdmLicense::PrepareKeyRequest(const CdmInitData& init_data,
   session_->GenerateRequestId(request_id);
 
   LicenseRequest license_request;
-  ClientIdentification* client_id = license_request.mutable_client_id();
-
-  if (Properties::use_certificates_as_identification())
-    client_id->set_type(ClientIdentification::DEVICE_CERTIFICATE);
-  else
-    client_id->set_type(ClientIdentification::KEYBOX);
-  client_id->set_token(token_);
-
-  ClientIdentification_NameValue* client_info;
-  CdmAppParameterMap::const_iterator iter;
-  for (iter = app_parameters.begin(); iter != app_parameters.end(); iter++) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(iter->first);
-    client_info->set_value(iter->second);
-  }
-  std::string value;
-  if (Properties::GetCompanyName(&value)) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(kCompanyNameKey);
-    client_info->set_value(value);
-  }
-  if (Properties::GetModelName(&value)) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(kModelNameKey);
-    client_info->set_value(value);
-  }
-  if (Properties::GetArchitectureName(&value)) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(kArchitectureNameKey);
-    client_info->set_value(value);
-  }
-  if (Properties::GetDeviceName(&value)) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(kDeviceNameKey);
-    client_info->set_value(value);
-  }
-  if (Properties::GetProductName(&value)) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(kProductNameKey);
-    client_info->set_value(value);
-  }
-  if (Properties::GetBuildInfo(&value)) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(kBuildInfoKey);
-    client_info->set_value(value);
-  }
-
-  if (session_->GetDeviceUniqueId(&value)) {
-    client_info = client_id->add_client_info();
-    client_info->set_name(kDeviceIdKey);
-    client_info->set_value(value);
-  }
+  std::string serialized_client_id;
+  if (!SerializeClientIdentification(app_parameters, &serialized_client_id))
+    return false;
 
   if (privacy_mode_enabled) {
     EncryptedClientIdentification* encrypted_client_id =
         license_request.mutable_encrypted_client_id();
-    DeviceCertificate service_certificate;
+    std::string service_id;
+    std::string serial_number;
+    RsaPublicKey rsa;
 
-    if (!service_certificate.ParseFromString(serialized_service_certificate)) {
+    bool parsed = client_service_certificate.empty() ?
+        ServiceCertificateCache::Get(service_certificate_, &service_id,
+                                     &serial_number, &rsa) :
+        ServiceCertificateCache::Get(client_service_certificate, &service_id,
+                                     &serial_number, &rsa);
+    if (!parsed) {
       LOGE(
           "CdmLicense::PrepareKeyRequest: unable to parse retrieved "
           "service certificate");
       return false;
     }
-
-    if (service_certificate.type() !=
-        video_widevine_server::sdk::DeviceCertificate_CertificateType_SERVICE) {
-      LOGE(
-          "CdmLicense::PrepareKeyRequest: retrieved certificate not of type"
-          " service, %d",
-          service_certificate.type());
-      return false;
-    }
-    encrypted_client_id->set_service_id(service_certificate.service_id());
-    encrypted_client_id->set_service_certificate_serial_number(
-        service_certificate.serial_number());
+    encrypted_client_id->set_service_id(service_id);
+    encrypted_client_id->set_service_certificate_serial_number(serial_number);
 
     std::string iv(KEY_IV_SIZE, 0);
     std::string key(KEY_SIZE, 0);
@@ -287,21 +319,17 @@ bool CdmLicense::PrepareKeyRequest(const CdmInitData& init_data,
     if (!session_->GetRandom(iv.size(), reinterpret_cast<uint8_t*>(&iv[0]))) {
       return false;
     }
-    std::string id, enc_id, enc_key;
-    client_id->SerializeToString(&id);
+    std::string enc_id, enc_key;
 
     AesCbcKey aes;
     if (!aes.Init(key)) return false;
-    if (!aes.Encrypt(id, &enc_id, &iv)) return false;
+    if (!aes.Encrypt(serialized_client_id, &enc_id, &iv)) return false;
 
-    RsaPublicKey rsa;
-    if (!rsa.Init(service_certificate.public_key())) return false;
     if (!rsa.Encrypt(key, &enc_key)) return false;
 
     encrypted_client_id->set_encrypted_client_id_iv(iv);
     encrypted_client_id->set_encrypted_privacy_key(enc_key);
     encrypted_client_id->set_encrypted_client_id(enc_id);
-    license_request.clear_client_id();
   }
 
   // Content Identification may be a cenc_id, a webm_id or a license_id
@@ -311,11 +339,17 @@ bool CdmLicense::PrepareKeyRequest(const CdmInitData& init_data,
   LicenseRequest_ContentIdentification_CENC* cenc_content_id =
       content_id->mutable_cenc_id();
 
-  if (!init_data.empty()) {
-    cenc_content_id->add_pssh(init_data);
-  } else if (privacy_mode_enabled && !init_data_.empty()) {
-    cenc_content_id->add_pssh(init_data_);
-  } else {
+  const CdmInitDataList* pssh_list = &init_data;
+  if (init_data.empty() && privacy_mode_enabled) pssh_list = &init_data_;
+
+  for (size_t i = 0; i < pssh_list->size(); ++i) {
+    if ((*pssh_list)[i].empty()) {
+      LOGD("CdmLicense::PrepareKeyRequest: empty init data entry %d", i);
+      return false;
+    }
+    cenc_content_id->add_pssh((*pssh_list)[i]);
+  }
+  if (cenc_content_id->pssh_size() == 0) {
     LOGD("CdmLicense::PrepareKeyRequest: init data not available");
     return false;
   }
@@ -351,9 +385,14 @@ bool CdmLicense::PrepareKeyRequest(const CdmInitData& init_data,
   LOGD("PrepareKeyRequest: nonce=%u", nonce);
   license_request.set_protocol_version(video_widevine_server::sdk::VERSION_2_1);
 
-  // License request is complete. Serialize it.
+  // License request is complete. Serialize it, client_id is field 1 so
+  // placing it first keeps the canonical field order.
   std::string serialized_license_req;
-  license_request.SerializeToString(&serialized_license_req);
+  if (!privacy_mode_enabled) {
+    AppendLengthDelimitedField(LicenseRequest::kClientIdFieldNumber,
+                               serialized_client_id, &serialized_license_req);
+  }
+  license_request.AppendToString(&serialized_license_req);
 
   if (Properties::use_certificates_as_identification())
     key_request_ = serialized_license_req;
@@ -459,59 +498,59 @@ CdmResponseType CdmLicense::HandleKeyResponse(
     return KEY_ERROR;
   }
 
-  SignedMessage signed_response;
-  if (!signed_response.ParseFromString(license_response)) {
+  CachedMessage<SignedMessage> signed_response(&signed_message_cache);
+  if (!signed_response->ParseFromString(license_response)) {
     LOGE(
         "CdmLicense::HandleKeyResponse: unable to parse signed license"
         " response");
     return KEY_ERROR;
   }
 
-  switch (signed_response.type()) {
+  switch (signed_response->type()) {
     case SignedMessage::LICENSE:
       break;
     case SignedMessage::SERVICE_CERTIFICATE:
-      return CdmLicense::HandleServiceCertificateResponse(signed_response);
+      return CdmLicense::HandleServiceCertificateResponse(*signed_response);
     case SignedMessage::ERROR:
-      return HandleKeyErrorResponse(signed_response);
+      return HandleKeyErrorResponse(*signed_response);
     default:
       LOGE("CdmLicense::HandleKeyResponse: unrecognized signed message type: %d"
-           , signed_response.type());
+           , signed_response->type());
       return KEY_ERROR;
   }
 
-  if (!signed_response.has_signature()) {
+  if (!signed_response->has_signature()) {
     LOGE("CdmLicense::HandleKeyResponse: license response is not signed");
     return KEY_ERROR;
   }
 
-  License license;
-  if (!license.ParseFromString(signed_response.msg())) {
+  CachedMessage<License> license(&license_cache);
+  if (!license->ParseFromString(signed_response->msg())) {
     LOGE("CdmLicense::HandleKeyResponse: unable to parse license response");
     return KEY_ERROR;
   }
 
   if (Properties::use_certificates_as_identification()) {
-    if (!signed_response.has_session_key()) {
+    if (!signed_response->has_session_key()) {
       LOGE("CdmLicense::HandleKeyResponse: no session keys present");
       return KEY_ERROR;
     }
 
     if (!session_->GenerateDerivedKeys(key_request_,
-                                       signed_response.session_key()))
+                                       signed_response->session_key()))
       return KEY_ERROR;
   }
 
   // Extract mac key
   std::string mac_key_iv;
   std::string mac_key;
-  if (license.policy().can_renew()) {
-    for (int i = 0; i < license.key_size(); ++i) {
-      if (license.key(i).type() == License_KeyContainer::SIGNING) {
-        mac_key_iv.assign(license.key(i).iv());
+  if (license->policy().can_renew()) {
+    for (int i = 0; i < license->key_size(); ++i) {
+      if (license->key(i).type() == License_KeyContainer::SIGNING) {
+        mac_key_iv.assign(license->key(i).iv());
 
         // Strip off PKCS#5 padding
-        mac_key.assign(license.key(i).key().data(), MAC_KEY_SIZE);
+        mac_key.assign(license->key(i).key().data(), MAC_KEY_SIZE);
       }
     }
 
@@ -524,23 +563,23 @@ CdmResponseType CdmLicense::HandleKeyResponse(
     }
   }
 
-  std::vector<CryptoKey> key_array = ExtractContentKeys(license);
+  std::vector<CryptoKey> key_array = ExtractContentKeys(*license);
   if (!key_array.size()) {
     LOGE("CdmLicense::HandleKeyResponse : No content keys.");
     return KEY_ERROR;
   }
 
-  if (license.policy().has_renewal_server_url()) {
-    server_url_ = license.policy().renewal_server_url();
+  if (license->policy().has_renewal_server_url()) {
+    server_url_ = license->policy().renewal_server_url();
   }
 
   // TODO(kqyang, jfore, gmorgan): change SetLicense function signature to
   // be able to return true/false to accept/reject the license. (Pending code
   // merge from Eureka)
-  policy_engine_->SetLicense(license);
+  policy_engine_->SetLicense(*license);
 
-  CdmResponseType resp = session_->LoadKeys(signed_response.msg(),
-                                            signed_response.signature(),
+  CdmResponseType resp = session_->LoadKeys(signed_response->msg(),
+                                            signed_response->signature(),
                                             mac_key_iv,
                                             mac_key,
                                             key_array.size(),
@@ -568,52 +607,53 @@ CdmResponseType CdmLicense::HandleKeyUpdateResponse(
     return KEY_ERROR;
   }
 
-  SignedMessage signed_response;
-  if (!signed_response.ParseFromString(license_response)) {
+  CachedMessage<SignedMessage> signed_response(&signed_message_cache);
+  if (!signed_response->ParseFromString(license_response)) {
     LOGE("CdmLicense::HandleKeyUpdateResponse: Unable to parse signed message");
     return KEY_ERROR;
   }
 
-  if (signed_response.type() == SignedMessage::ERROR) {
-    return HandleKeyErrorResponse(signed_response);
+  if (signed_response->type() == SignedMessage::ERROR) {
+    return HandleKeyErrorResponse(*signed_response);
   }
 
-  if (!signed_response.has_signature()) {
+  if (!signed_response->has_signature()) {
     LOGE("CdmLicense::HandleKeyUpdateResponse: signature missing");
     return KEY_ERROR;
   }
 
-  License license;
-  if (!license.ParseFromString(signed_response.msg())) {
+  CachedMessage<License> license(&license_cache);
+  if (!license->ParseFromString(signed_response->msg())) {
     LOGE(
         "CdmLicense::HandleKeyUpdateResponse: Unable to parse license"
         " from signed message");
     return KEY_ERROR;
   }
 
-  if (!license.has_id()) {
+  if (!license->has_id()) {
     LOGE("CdmLicense::HandleKeyUpdateResponse: license id not present");
     return KEY_ERROR;
   }
 
   if (is_renewal) {
-    if (license.policy().has_renewal_server_url() &&
-        license.policy().renewal_server_url().size() > 0) {
-      server_url_ = license.policy().renewal_server_url();
+    if (license->policy().has_renewal_server_url() &&
+        license->policy().renewal_server_url().size() > 0) {
+      server_url_ = license->policy().renewal_server_url();
     }
   }
 
   // TODO(kqyang, jfore, gmorgan): change UpdateLicense function signature to
   // be able to return true/false to accept/reject the license. (Pending code
   // merge from Eureka)
-  policy_engine_->UpdateLicense(license);
+  policy_engine_->UpdateLicense(*license);
 
   if (!is_renewal) return KEY_ADDED;
 
-  std::vector<CryptoKey> key_array = ExtractContentKeys(license);
+  std::vector<CryptoKey> key_array = ExtractContentKeys(*license);
 
-  if (session_->RefreshKeys(signed_response.msg(), signed_response.signature(),
-                            key_array.size(), &key_array[0])) {
+  if (session_->RefreshKeys(signed_response->msg(),
+                            signed_response->signature(), key_array.size(),
+                            &key_array[0])) {
     return KEY_ADDED;
   } else {
     return KEY_ERROR;
@@ -632,24 +672,24 @@ bool CdmLicense::RestoreOfflineLicense(
     return false;
   }
 
-  SignedMessage signed_request;
-  if (!signed_request.ParseFromString(license_request)) {
+  CachedMessage<SignedMessage> signed_request(&signed_message_cache);
+  if (!signed_request->ParseFromString(license_request)) {
     LOGE("CdmLicense::RestoreOfflineLicense: license_request parse failed");
     return false;
   }
 
-  if (signed_request.type() != SignedMessage::LICENSE_REQUEST) {
+  if (signed_request->type() != SignedMessage::LICENSE_REQUEST) {
     LOGE(
         "CdmLicense::RestoreOfflineLicense: license request type: expected = "
         "%d, actual = %d",
-        SignedMessage::LICENSE_REQUEST, signed_request.type());
+        SignedMessage::LICENSE_REQUEST, signed_request->type());
     return false;
   }
 
   if (Properties::use_certificates_as_identification()) {
-    key_request_ = signed_request.msg();
+    key_request_ = signed_request->msg();
   } else {
-    if (!session_->GenerateDerivedKeys(signed_request.msg())) return false;
+    if (!session_->GenerateDerivedKeys(signed_request->msg())) return false;
   }
 
   CdmResponseType sts = HandleKeyResponse(license_response);
@@ -665,6 +705,104 @@ bool CdmLicense::RestoreOfflineLicense(
   return true;
 }
 
+bool CdmLicense::SerializeClientIdentification(
+    const CdmAppParameterMap& app_parameters,
+    std::string* serialized_client_id) {
+  CdmSecurityLevel security_level = session_->GetSecurityLevel();
+  std::string suffix;
+  bool cached = false;
+  {
+    AutoLock auto_lock(client_id_template_lock);
+    ClientIdentificationTemplateMap::iterator iter =
+        client_id_templates.find(security_level);
+    if (iter != client_id_templates.end() && iter->second.token == token_) {
+      *serialized_client_id = iter->second.prefix;
+      suffix = iter->second.suffix;
+      cached = true;
+    }
+  }
+
+  if (!cached) {
+    if (!BuildClientIdentificationTemplate(serialized_client_id, &suffix))
+      return false;
+    AutoLock auto_lock(client_id_template_lock);
+    ClientIdentificationTemplate& client_id_template =
+        client_id_templates[security_level];
+    client_id_template.token = token_;
+    client_id_template.prefix = *serialized_client_id;
+    client_id_template.suffix = suffix;
+  }
+
+  if (!app_parameters.empty()) {
+    ClientIdentification client_id;
+    ClientIdentification_NameValue* client_info;
+    CdmAppParameterMap::const_iterator iter;
+    for (iter = app_parameters.begin(); iter != app_parameters.end(); iter++) {
+      client_info = client_id.add_client_info();
+      client_info->set_name(iter->first);
+      client_info->set_value(iter->second);
+    }
+    if (!client_id.AppendToString(serialized_client_id)) return false;
+  }
+  serialized_client_id->append(suffix);
+  return true;
+}
+
+bool CdmLicense::BuildClientIdentificationTemplate(std::string* prefix,
+                                                   std::string* suffix) {
+  ClientIdentification client_id;
+
+  if (Properties::use_certificates_as_identification())
+    client_id.set_type(ClientIdentification::DEVICE_CERTIFICATE);
+  else
+    client_id.set_type(ClientIdentification::KEYBOX);
+  client_id.set_token(token_);
+  if (!client_id.SerializeToString(prefix)) return false;
+
+  // Only the client info follows the app parameters
+  client_id.Clear();
+  ClientIdentification_NameValue* client_info;
+  std::string value;
+  if (Properties::GetCompanyName(&value)) {
+    client_info = client_id.add_client_info();
+    client_info->set_name(kCompanyNameKey);
+    client_info->set_value(value);
+  }
+  if (Properties::GetModelName(&value)) {
+    client_info = client_id.add_client_info();
+    client_info->set_name(kModelNameKey);
+    client_info->set_value(value);
+  }
+  if (Properties::GetArchitectureName(&value)) {
+    client_info = client_id.add_client_info();
+    client_info->set_name(kArchitectureNameKey);
+    client_info->set_value(value);
+  }
+  if (Properties::GetDeviceName(&value)) {
+    client_info = client_id.add_client_info();
+    client_info->set_name(kDeviceNameKey);
+    client_info->set_value(value);
+  }
+  if (Properties::GetProductName(&value)) {
+    client_info = client_id.add_client_info();
+    client_info->set_name(kProductNameKey);
+    client_info->set_value(value);
+  }
+  if (Properties::GetBuildInfo(&value)) {
+    client_info = client_id.add_client_info();
+    client_info->set_name(kBuildInfoKey);
+    client_info->set_value(value);
+  }
+
+  if (session_->GetDeviceUniqueId(&value)) {
+    client_info = client_id.add_client_info();
+    client_info->set_name(kDeviceIdKey);
+    client_info->set_value(value);
+  }
+
+  return client_id.SerializeToString(suffix);
+}
+
 bool CdmLicense::PrepareServiceCertificateRequest(CdmKeyMessage* signed_request,
                                                   std::string* server_url) {
   if (!initialized_) {
@@ -702,45 +840,40 @@ CdmResponseType CdmLicense::HandleServiceCertificateResponse(
     return KEY_ERROR;
   }
 
-  RsaPublicKey root_ca_key;
-  std::string ca_public_key(
-      &kServiceCertificateCAPublicKey[0],
-      &kServiceCertificateCAPublicKey[sizeof(kServiceCertificateCAPublicKey)]);
-  if (!root_ca_key.Init(ca_public_key)) {
-    LOGE(
-        "CdmLicense::HandleServiceCertificateResponse: public key "
-        "initialization failed");
-    return KEY_ERROR;
-  }
+  const std::string& certificate =
+      signed_service_certificate.device_certificate();
 
-  if (!root_ca_key.VerifySignature(
-          signed_service_certificate.device_certificate(),
-          signed_service_certificate.signature())) {
-    LOGE(
-        "CdmLicense::HandleServiceCertificateResponse: service "
-        "certificate verification failed");
-    return KEY_ERROR;
+  // The signature only needs checking the first time a certificate is seen
+  if (!ServiceCertificateCache::IsVerified(certificate)) {
+    RsaPublicKey root_ca_key;
+    std::string ca_public_key(
+        &kServiceCertificateCAPublicKey[0],
+        &kServiceCertificateCAPublicKey[sizeof(
+            kServiceCertificateCAPublicKey)]);
+    if (!root_ca_key.Init(ca_public_key)) {
+      LOGE(
+          "CdmLicense::HandleServiceCertificateResponse: public key "
+          "initialization failed");
+      return KEY_ERROR;
+    }
+
+    if (!root_ca_key.VerifySignature(certificate,
+                                     signed_service_certificate.signature())) {
+      LOGE(
+          "CdmLicense::HandleServiceCertificateResponse: service "
+          "certificate verification failed");
+      return KEY_ERROR;
+    }
   }
 
-  DeviceCertificate service_certificate;
-  if (!service_certificate.ParseFromString(
-          signed_service_certificate.device_certificate())) {
+  if (!ServiceCertificateCache::Add(certificate, true)) {
     LOGE(
         "CdmLicense::HandleServiceCertificateResponse: unable to parse "
         "retrieved service certificate");
     return KEY_ERROR;
   }
 
-  if (service_certificate.type() !=
-      video_widevine_server::sdk::DeviceCertificate_CertificateType_SERVICE) {
-    LOGE(
-        "CdmLicense::HandleServiceCertificateResponse: certificate not of type"
-        " service, %d",
-        service_certificate.type());
-    return KEY_ERROR;
-  }
-
-  service_certificate_ = signed_service_certificate.device_certificate();
+  service_certificate_ = certificate;
   return NEED_KEY;
 }
 
@@ -770,4 +903,8 @@ bool CdmLicense::IsKeyLoaded(const KeyId& key_id) {
   return loaded_keys_.find(key_id) != loaded_keys_.end();
 }
 
+size_t CdmLicense::GetCachedMessageCount() {
+  return signed_message_cache.Size() + license_cache.Size();
+}
+
 }  // namespace wvcdm
@@ -3,17 +3,39 @@
 #include "policy_engine.h"
 
 #include <algorithm>
+#include <stdio.h>
 #include <map>
-#include <sstream>
 #include <string>
 #include <vector>
 
+#include "crypto_session.h"
 #include "log.h"
 #include "properties.h"
 #include "string_conversions.h"
 #include "clock.h"
 #include "wv_cdm_constants.h"
 
+namespace {
+
+// Remaining time thresholds, in decreasing order, at which a
+// kKeyStatusExpiring event is raised
+const int64_t kExpiryWarningSeconds[] = {600, 60};
+
+// Seconds until |expiry_time|, 0 if unlimited or expired
+int64_t RemainingTime(int64_t expiry_time, int64_t current_time) {
+  if (expiry_time == 0 || expiry_time <= current_time)
+    return 0;
+  return expiry_time - current_time;
+}
+
+std::string DurationToString(int64_t seconds) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(seconds));
+  return buffer;
+}
+
+}  // namespace
+
 namespace wvcdm {
 
 PolicyEngine::PolicyEngine() {
@@ -37,24 +59,37 @@ void PolicyEngine::Init(Clock* clock) {
   playback_start_time_ = 0;
   next_renewal_time_ = 0;
   policy_max_duration_seconds_ = 0;
+  renewal_jitter_seconds_ = 0;
+  crypto_session_ = NULL;
+  license_expiry_time_ = 0;
+  playback_expiry_time_ = 0;
+  decryption_deadline_ = 0;
+  expiry_warning_seconds_ = 0;
   clock_ = clock;
 }
 
 void PolicyEngine::OnTimerEvent(bool& event_occured, CdmEventType& event) {
   event_occured = false;
   int64_t current_time = clock_->GetCurrentTime();
+  int64_t monotonic_time = clock_->GetMonotonicTime();
 
-  // License expiration trumps all.
-  if ((IsLicenseDurationExpired(current_time) ||
-      IsPlaybackDurationExpired(current_time)) &&
+  // License expiration trumps all. It is measured against the monotonic
+  // decryption deadline, as is IsDecryptionDeadlinePassed, so that changes
+  // to the wall clock neither extend nor cut the license.
+  if (IsDeadlinePassed(monotonic_time) &&
       license_state_ != kLicenseStateExpired) {
     license_state_ = kLicenseStateExpired;
     can_decrypt_ = false;
     event = LICENSE_EXPIRED_EVENT;
     event_occured = true;
+    AddKeyStatusEvent(kKeyStatusExpired, current_time, 0);
     return;
   }
 
+  if (license_state_ != kLicenseStateInitial &&
+      license_state_ != kLicenseStateExpired)
+    CheckExpiryWarning(current_time, monotonic_time);
+
   bool renewal_needed = false;
 
   // Test to determine if renewal should be attempted.
@@ -116,8 +151,11 @@ void PolicyEngine::UpdateLicense(
     return;
   }
 
+  bool is_renewal = license_state_ != kLicenseStateInitial;
+  bool could_decrypt = can_decrypt_;
+
   // some basic license validation
-  if (license_state_ == kLicenseStateInitial) {
+  if (!is_renewal) {
     // license start time needs to be present in the initial response
     if (!license.has_license_start_time())
       return;
@@ -142,8 +180,6 @@ void PolicyEngine::UpdateLicense(
   if (license.has_license_start_time())
     license_start_time_ = license.license_start_time();
   license_received_time_ = current_time;
-  next_renewal_time_ = current_time +
-      policy_.renewal_delay_seconds();
 
   // Calculate policy_max_duration_seconds_. policy_max_duration_seconds_
   // will be set to the minimum of the following policies :
@@ -161,9 +197,14 @@ void PolicyEngine::UpdateLicense(
     policy_max_duration_seconds_ = policy_.license_duration_seconds();
   }
 
+  next_renewal_time_ = current_time + policy_.renewal_delay_seconds() +
+      GetRenewalJitter();
+
   if (Properties::begin_license_usage_when_received())
     playback_start_time_ = current_time;
 
+  UpdateExpiryTimes(current_time);
+
   // Update state
   if (Properties::begin_license_usage_when_received()) {
     if (policy_.renew_with_usage()) {
@@ -183,6 +224,11 @@ void PolicyEngine::UpdateLicense(
       can_decrypt_ = true;
     }
   }
+
+  if (can_decrypt_ && !could_decrypt)
+    AddKeyStatusEvent(kKeyStatusUsable, current_time, 0);
+  if (is_renewal)
+    AddKeyStatusEvent(kKeyStatusRenewed, current_time, 0);
 }
 
 void PolicyEngine::BeginDecryption() {
@@ -193,6 +239,7 @@ void PolicyEngine::BeginDecryption() {
       case kLicenseStateNeedRenewal:
       case kLicenseStateWaitingLicenseUpdate:
         playback_start_time_ = clock_->GetCurrentTime();
+        UpdateExpiryTimes(playback_start_time_);
 
         if (policy_.renew_with_usage()) {
           license_state_ = kLicenseStateNeedRenewal;
@@ -200,6 +247,7 @@ void PolicyEngine::BeginDecryption() {
         else {
           license_state_ = kLicenseStateCanPlay;
           can_decrypt_ = true;
+          AddKeyStatusEvent(kKeyStatusUsable, playback_start_time_, 0);
         }
         break;
       case kLicenseStateCanPlay:
@@ -212,43 +260,168 @@ void PolicyEngine::BeginDecryption() {
 }
 
 CdmResponseType PolicyEngine::Query(CdmQueryMap* key_info) {
-  std::stringstream ss;
-  int64_t current_time = clock_->GetCurrentTime();
-
-  if (license_state_ == kLicenseStateInitial)
-    return UNKNOWN_ERROR;
+  CdmKeyStatus key_status;
+  CdmResponseType status = Query(&key_status);
+  if (status != NO_ERROR)
+    return status;
 
   (*key_info)[QUERY_KEY_LICENSE_TYPE] =
-    license_id_.type() == video_widevine_server::sdk::STREAMING ?
+    key_status.license_type == kLicenseTypeStreaming ?
     QUERY_VALUE_STREAMING : QUERY_VALUE_OFFLINE;
-  (*key_info)[QUERY_KEY_PLAY_ALLOWED] = policy_.can_play() ?
+  (*key_info)[QUERY_KEY_PLAY_ALLOWED] = key_status.play_allowed ?
     QUERY_VALUE_TRUE : QUERY_VALUE_FALSE;
-  (*key_info)[QUERY_KEY_PERSIST_ALLOWED] = policy_.can_persist() ?
+  (*key_info)[QUERY_KEY_PERSIST_ALLOWED] = key_status.persist_allowed ?
     QUERY_VALUE_TRUE : QUERY_VALUE_FALSE;
-  (*key_info)[QUERY_KEY_RENEW_ALLOWED] = policy_.can_renew() ?
+  (*key_info)[QUERY_KEY_RENEW_ALLOWED] = key_status.renew_allowed ?
     QUERY_VALUE_TRUE : QUERY_VALUE_FALSE;
-  int64_t remaining_time = policy_max_duration_seconds_ +
-      license_received_time_ - current_time;
-  if (remaining_time < 0)
-    remaining_time = 0;
-  ss << remaining_time;
-  (*key_info)[QUERY_KEY_LICENSE_DURATION_REMAINING] = ss.str();
-  remaining_time = policy_.playback_duration_seconds() + playback_start_time_ -
-      current_time;
-  if (remaining_time < 0)
-    remaining_time = 0;
-  ss << remaining_time;
-  (*key_info)[QUERY_KEY_PLAYBACK_DURATION_REMAINING] = ss.str();
-  (*key_info)[QUERY_KEY_RENEWAL_SERVER_URL] = policy_.renewal_server_url();
+  (*key_info)[QUERY_KEY_LICENSE_DURATION_REMAINING] =
+    DurationToString(key_status.license_duration_remaining);
+  (*key_info)[QUERY_KEY_PLAYBACK_DURATION_REMAINING] =
+    DurationToString(key_status.playback_duration_remaining);
+  (*key_info)[QUERY_KEY_RENEWAL_SERVER_URL] = key_status.renewal_server_url;
 
   return NO_ERROR;
 }
 
+CdmResponseType PolicyEngine::Query(CdmKeyStatus* key_status) {
+  int64_t current_time = clock_->GetCurrentTime();
+
+  if (license_state_ == kLicenseStateInitial)
+    return UNKNOWN_ERROR;
+
+  GetKeyStatus(current_time, key_status);
+  return NO_ERROR;
+}
+
+void PolicyEngine::OnRenewalFailure() {
+  AddKeyStatusEvent(kKeyStatusRenewalFailed, clock_->GetCurrentTime(), 0);
+}
+
+void PolicyEngine::GetKeyStatusEvents(
+    std::vector<CdmKeyStatusEvent>* events) {
+  events->insert(events->end(), key_status_events_.begin(),
+                 key_status_events_.end());
+  key_status_events_.clear();
+}
+
+void PolicyEngine::GetKeyStatus(int64_t current_time,
+                                CdmKeyStatus* key_status) {
+  key_status->license_type =
+    license_id_.type() == video_widevine_server::sdk::STREAMING ?
+    kLicenseTypeStreaming : kLicenseTypeOffline;
+  key_status->play_allowed = policy_.can_play();
+  key_status->persist_allowed = policy_.can_persist();
+  key_status->renew_allowed = policy_.can_renew();
+  key_status->license_expiry_time = license_expiry_time_;
+  key_status->playback_expiry_time = playback_expiry_time_;
+  key_status->license_duration_remaining =
+      RemainingTime(license_expiry_time_, current_time);
+  key_status->playback_duration_remaining =
+      RemainingTime(playback_expiry_time_, current_time);
+  key_status->renewal_server_url = policy_.renewal_server_url();
+}
+
+void PolicyEngine::AddKeyStatusEvent(CdmKeyStatusEventType type,
+                                     int64_t current_time,
+                                     int64_t threshold_seconds) {
+  // A newer event of a type supersedes the one not yet collected
+  for (std::vector<CdmKeyStatusEvent>::iterator iter =
+           key_status_events_.begin();
+       iter != key_status_events_.end(); ++iter) {
+    if (iter->type == type) {
+      key_status_events_.erase(iter);
+      break;
+    }
+  }
+
+  key_status_events_.push_back(CdmKeyStatusEvent());
+  CdmKeyStatusEvent& event = key_status_events_.back();
+  event.type = type;
+  event.threshold_seconds = threshold_seconds;
+  GetKeyStatus(current_time, &event.status);
+}
+
+void PolicyEngine::CheckExpiryWarning(int64_t current_time,
+                                      int64_t monotonic_time) {
+  int64_t deadline = __atomic_load_n(&decryption_deadline_, __ATOMIC_ACQUIRE);
+  if (deadline == 0 || deadline <= monotonic_time)
+    return;
+
+  int64_t remaining_time = deadline - monotonic_time;
+  int64_t threshold = 0;
+  for (size_t i = 0; i < sizeof(kExpiryWarningSeconds) /
+                             sizeof(kExpiryWarningSeconds[0]); ++i) {
+    if (remaining_time <= kExpiryWarningSeconds[i] &&
+        (expiry_warning_seconds_ == 0 ||
+         kExpiryWarningSeconds[i] < expiry_warning_seconds_))
+      threshold = kExpiryWarningSeconds[i];
+  }
+  if (threshold == 0)
+    return;
+
+  expiry_warning_seconds_ = threshold;
+  AddKeyStatusEvent(kKeyStatusExpiring, current_time, threshold);
+}
+
+void PolicyEngine::UpdateExpiryTimes(int64_t current_time) {
+  license_expiry_time_ = policy_max_duration_seconds_ > 0 ?
+      license_received_time_ + policy_max_duration_seconds_ : 0;
+  playback_expiry_time_ =
+      (policy_.playback_duration_seconds() > 0 && playback_start_time_) ?
+      playback_start_time_ + policy_.playback_duration_seconds() : 0;
+  expiry_warning_seconds_ = 0;
+
+  int64_t expiry_time = license_expiry_time_;
+  if (playback_expiry_time_ &&
+      (expiry_time == 0 || playback_expiry_time_ < expiry_time))
+    expiry_time = playback_expiry_time_;
+
+  int64_t deadline = 0;
+  if (expiry_time) {
+    // Never 0, which would mean unlimited
+    deadline = std::max(clock_->GetMonotonicTime() + expiry_time -
+                            current_time, static_cast<int64_t>(1));
+  }
+  __atomic_store_n(&decryption_deadline_, deadline, __ATOMIC_RELEASE);
+}
+
 void PolicyEngine::UpdateRenewalRequest(int64_t current_time) {
   license_state_ = kLicenseStateWaitingLicenseUpdate;
   next_renewal_time_ = current_time + policy_.renewal_retry_interval_seconds();
 }
 
+int64_t PolicyEngine::GetRenewalJitter() {
+  if (renewal_jitter_seconds_ <= 0 || policy_.renewal_delay_seconds() <= 0)
+    return 0;
+
+  int64_t max_jitter = renewal_jitter_seconds_;
+  // Leave at least one second to renew before the license expires
+  if (policy_max_duration_seconds_ > 0) {
+    max_jitter = std::min(max_jitter, policy_max_duration_seconds_ -
+                                          policy_.renewal_delay_seconds() - 1);
+  }
+  if (max_jitter <= 0) return 0;
+
+  uint32_t random = 0;
+  if (crypto_session_ == NULL ||
+      !crypto_session_->GetRandom(sizeof(random),
+                                  reinterpret_cast<uint8_t*>(&random))) {
+    LOGW("PolicyEngine::GetRenewalJitter: random data unavailable");
+    return 0;
+  }
+  return random % (max_jitter + 1);
+}
+
+bool PolicyEngine::IsDecryptionDeadlinePassed() {
+  int64_t deadline = __atomic_load_n(&decryption_deadline_, __ATOMIC_ACQUIRE);
+  return deadline && deadline <= clock_->GetMonotonicTime();
+}
+
+bool PolicyEngine::IsDeadlinePassed(int64_t monotonic_time) {
+  int64_t deadline = __atomic_load_n(&decryption_deadline_, __ATOMIC_ACQUIRE);
+  return deadline && deadline <= monotonic_time;
+}
+
 // For the policy time fields checked in the following methods, a value of 0
 // indicates that there is no limit to the duration. These methods
 // will always return false if the value is 0.
@@ -268,8 +441,7 @@ bool PolicyEngine::IsPlaybackDurationExpired(int64_t current_time) {
 bool PolicyEngine::IsRenewalDelayExpired(int64_t current_time) {
   return policy_.can_renew() &&
       (policy_.renewal_delay_seconds() > 0) &&
-      license_received_time_ + policy_.renewal_delay_seconds() <=
-      current_time;
+      next_renewal_time_ <= current_time;
 }
 
 // TODO(jfore, edwinwong, rfrias): This field is in flux and currently
@@ -129,6 +129,20 @@ bool RsaPublicKey::Init(const std::string& serialized_key) {
   return true;
 }
 
+bool RsaPublicKey::Init(RSA* key) {
+  if (key == NULL) {
+    LOGE("RsaPublicKey::Init: no key provided");
+    return false;
+  }
+
+  if (key_ != NULL) {
+    RSA_free(key_);
+  }
+  RSA_up_ref(key);
+  key_ = key;
+  return true;
+}
+
 bool RsaPublicKey::Encrypt(const std::string& clear_message,
                            std::string* encrypted_message) {
   if (clear_message.empty()) {
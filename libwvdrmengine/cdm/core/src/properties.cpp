@@ -6,6 +6,7 @@
 
 namespace {
 const char *kSecurityLevelDirs[] = { "L1/", "L3/" };
+const std::vector<uint8_t> kNoServiceCertificate;
 }  // namespace
 
 namespace wvcdm {
@@ -18,6 +19,9 @@ bool Properties::use_certificates_as_identification_;
 bool Properties::extract_pssh_data_;
 bool Properties::decrypt_with_empty_session_support_;
 bool Properties::security_level_path_backward_compatibility_support_;
+uint32_t Properties::renewal_jitter_seconds_;
+uint32_t Properties::crypto_session_pool_size_;
+uint32_t Properties::oem_crypto_idle_termination_seconds_;
 scoped_ptr<CdmClientPropertySetMap> Properties::session_property_set_;
 
 void Properties::Init() {
@@ -31,6 +35,10 @@ void Properties::Init() {
   extract_pssh_data_ = kExtractPsshData;
   decrypt_with_empty_session_support_ = kDecryptWithEmptySessionSupport;
   security_level_path_backward_compatibility_support_ = kSecurityLevelPathBackwardCompatibilitySupport;
+  renewal_jitter_seconds_ = kPropertyRenewalJitterSeconds;
+  crypto_session_pool_size_ = kPropertyCryptoSessionPoolSize;
+  oem_crypto_idle_termination_seconds_ =
+      kPropertyOemCryptoIdleTerminationSeconds;
   session_property_set_.reset(new CdmClientPropertySetMap());
 }
 
@@ -77,14 +85,14 @@ const std::string Properties::GetSecurityLevel(const CdmSessionId& session_id) {
   return property_set->security_level();
 }
 
-const std::vector<uint8_t> Properties::GetServiceCertificate(
+const std::vector<uint8_t>& Properties::GetServiceCertificate(
     const CdmSessionId& session_id) {
   const CdmClientPropertySet* property_set =
       GetCdmClientPropertySet(session_id);
   if (NULL == property_set) {
     LOGE("Properties::GetServiceCertificate: cannot find property set for %s",
          session_id.c_str());
-    return std::vector<uint8_t>();
+    return kNoServiceCertificate;
   }
   return property_set->service_certificate();
 }
@@ -0,0 +1,162 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+
+#include "service_certificate_cache.h"
+
+#include <string.h>
+
+#include "license_protocol.pb.h"
+#include "log.h"
+#include "openssl/err.h"
+#include "privacy_crypto.h"
+
+namespace {
+// Service certificates are issued per license service, a device talks to
+// very few of them
+const size_t kMaxEntries = 8;
+}  // namespace
+
+namespace wvcdm {
+
+using video_widevine_server::sdk::DeviceCertificate;
+
+Lock ServiceCertificateCache::lock_;
+ServiceCertificateCache::EntryList ServiceCertificateCache::entries_;
+
+ServiceCertificateCache::Entry::~Entry() {
+  if (key != NULL) RSA_free(key);
+}
+
+bool ServiceCertificateCache::Add(const std::string& certificate,
+                                  bool verified) {
+  AutoLock auto_lock(lock_);
+  Entry* entry = Insert(certificate.data(), certificate.size());
+  if (entry == NULL) return false;
+
+  if (verified) entry->verified = true;
+  return true;
+}
+
+bool ServiceCertificateCache::IsVerified(const std::string& certificate) {
+  AutoLock auto_lock(lock_);
+  Entry* entry = Find(certificate.data(), certificate.size());
+  return entry != NULL && entry->verified;
+}
+
+bool ServiceCertificateCache::Get(const std::string& certificate,
+                                  std::string* service_id,
+                                  std::string* serial_number,
+                                  RsaPublicKey* public_key) {
+  return Get(certificate.data(), certificate.size(), service_id,
+             serial_number, public_key);
+}
+
+bool ServiceCertificateCache::Get(const std::vector<uint8_t>& certificate,
+                                  std::string* service_id,
+                                  std::string* serial_number,
+                                  RsaPublicKey* public_key) {
+  if (certificate.empty()) {
+    LOGE("ServiceCertificateCache::Get: no certificate provided");
+    return false;
+  }
+  return Get(reinterpret_cast<const char*>(&certificate[0]),
+             certificate.size(), service_id, serial_number, public_key);
+}
+
+bool ServiceCertificateCache::Get(const char* certificate, size_t size,
+                                  std::string* service_id,
+                                  std::string* serial_number,
+                                  RsaPublicKey* public_key) {
+  if (!service_id || !serial_number || !public_key) {
+    LOGE("ServiceCertificateCache::Get: no destination provided");
+    return false;
+  }
+
+  AutoLock auto_lock(lock_);
+  Entry* entry = Insert(certificate, size);
+  if (entry == NULL) return false;
+
+  *service_id = entry->service_id;
+  *serial_number = entry->serial_number;
+  return public_key->Init(entry->key);
+}
+
+void ServiceCertificateCache::Clear() {
+  AutoLock auto_lock(lock_);
+  for (EntryList::iterator iter = entries_.begin(); iter != entries_.end();
+       ++iter) {
+    delete *iter;
+  }
+  entries_.clear();
+}
+
+size_t ServiceCertificateCache::Size() {
+  AutoLock auto_lock(lock_);
+  return entries_.size();
+}
+
+bool ServiceCertificateCache::Parse(Entry* entry) {
+  DeviceCertificate service_certificate;
+  if (!service_certificate.ParseFromString(entry->certificate)) {
+    LOGE("ServiceCertificateCache::Parse: unable to parse service "
+         "certificate");
+    return false;
+  }
+
+  if (service_certificate.type() !=
+      video_widevine_server::sdk::DeviceCertificate_CertificateType_SERVICE) {
+    LOGE("ServiceCertificateCache::Parse: certificate not of type service, "
+         "%d", service_certificate.type());
+    return false;
+  }
+
+  const std::string& public_key = service_certificate.public_key();
+  const unsigned char* der =
+      reinterpret_cast<const unsigned char*>(public_key.data());
+  entry->key = d2i_RSAPublicKey(NULL, &der, public_key.size());
+  if (entry->key == NULL) {
+    LOGE("ServiceCertificateCache::Parse: RSA key deserialization failure: "
+         "%s", ERR_error_string(ERR_get_error(), NULL));
+    return false;
+  }
+
+  entry->service_id = service_certificate.service_id();
+  entry->serial_number = service_certificate.serial_number();
+  return true;
+}
+
+ServiceCertificateCache::Entry* ServiceCertificateCache::Find(
+    const char* certificate, size_t size) {
+  for (EntryList::iterator iter = entries_.begin(); iter != entries_.end();
+       ++iter) {
+    const std::string& cached = (*iter)->certificate;
+    if (cached.size() == size &&
+        memcmp(cached.data(), certificate, size) == 0) {
+      entries_.splice(entries_.begin(), entries_, iter);
+      return entries_.front();
+    }
+  }
+  return NULL;
+}
+
+ServiceCertificateCache::Entry* ServiceCertificateCache::Insert(
+    const char* certificate, size_t size) {
+  Entry* entry = Find(certificate, size);
+  if (entry != NULL) return entry;
+
+  entry = new Entry();
+  entry->certificate.assign(certificate, size);
+  if (!Parse(entry)) {
+    delete entry;
+    return NULL;
+  }
+
+  if (entries_.size() >= kMaxEntries) {
+    // Keys handed out share the RSA object, so eviction is safe
+    delete entries_.back();
+    entries_.pop_back();
+  }
+  entries_.push_front(entry);
+  return entry;
+}
+
+}  // namespace wvcdm
@@ -0,0 +1,123 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+
+#include "crypto_session_pool.h"
+
+#include <unistd.h>
+
+#include <vector>
+
+#include "crypto_session.h"
+#include "gtest/gtest.h"
+#include "scoped_ptr.h"
+
+namespace {
+const size_t kMaxSessions = 2;
+const int kPollIntervalUs = 1000;
+const int kMaxPolls = 5000;
+const int kMaxOpenSessions = 256;
+const uint32_t kIdleSeconds = 1;
+}  // namespace
+
+namespace wvcdm {
+
+class CryptoSessionPoolTest : public ::testing::Test {
+ protected:
+  CryptoSessionPoolTest() : pool_(kMaxSessions) {}
+
+  // Waits for the background refill to bring the pool to |size| sessions
+  bool WaitForSize(size_t size) {
+    for (int i = 0; i < kMaxPolls; ++i) {
+      if (pool_.Size() == size) return true;
+      usleep(kPollIntervalUs);
+    }
+    return false;
+  }
+
+  CryptoSessionPool pool_;
+};
+
+TEST_F(CryptoSessionPoolTest, FillsOnFirstUse) {
+  EXPECT_EQ(0u, pool_.Size());
+  scoped_ptr<CryptoSession> session(pool_.Acquire(kLevelDefault));
+  EXPECT_TRUE(session.get() == NULL);
+  EXPECT_TRUE(WaitForSize(kMaxSessions));
+}
+
+TEST_F(CryptoSessionPoolTest, HandsOutOpenedSessions) {
+  delete pool_.Acquire(kLevelDefault);
+  ASSERT_TRUE(WaitForSize(kMaxSessions));
+
+  scoped_ptr<CryptoSession> session1(pool_.Acquire(kLevelDefault));
+  scoped_ptr<CryptoSession> session2(pool_.Acquire(kLevelDefault));
+  ASSERT_TRUE(session1.get() != NULL);
+  ASSERT_TRUE(session2.get() != NULL);
+  EXPECT_TRUE(session1->IsOpen());
+  EXPECT_TRUE(session2->IsOpen());
+  EXPECT_NE(session1->oec_session_id(), session2->oec_session_id());
+
+  // Sessions handed out are replaced, never returned to the pool
+  EXPECT_TRUE(WaitForSize(kMaxSessions));
+  session1.reset();
+  EXPECT_EQ(kMaxSessions, pool_.Size());
+}
+
+TEST_F(CryptoSessionPoolTest, DoesNotPoolLevel3Sessions) {
+  delete pool_.Acquire(kLevelDefault);
+  ASSERT_TRUE(WaitForSize(kMaxSessions));
+
+  scoped_ptr<CryptoSession> session(pool_.Acquire(kLevel3));
+  EXPECT_TRUE(session.get() == NULL);
+  EXPECT_EQ(kMaxSessions, pool_.Size());
+}
+
+TEST_F(CryptoSessionPoolTest, ClearClosesSessions) {
+  delete pool_.Acquire(kLevelDefault);
+  ASSERT_TRUE(WaitForSize(kMaxSessions));
+
+  pool_.Clear();
+  EXPECT_EQ(0u, pool_.Size());
+  usleep(10 * kPollIntervalUs);
+  EXPECT_EQ(0u, pool_.Size());
+}
+
+TEST_F(CryptoSessionPoolTest, ReleasesSessionsWhenIdle) {
+  delete pool_.Acquire(kLevelDefault);
+  ASSERT_TRUE(WaitForSize(kMaxSessions));
+
+  pool_.ReleaseWhenIdle(kIdleSeconds);
+  EXPECT_EQ(kMaxSessions, pool_.Size());
+  EXPECT_TRUE(WaitForSize(0));
+}
+
+TEST_F(CryptoSessionPoolTest, AcquireCancelsIdleRelease) {
+  delete pool_.Acquire(kLevelDefault);
+  ASSERT_TRUE(WaitForSize(kMaxSessions));
+
+  pool_.ReleaseWhenIdle(kIdleSeconds);
+  delete pool_.Acquire(kLevelDefault);
+  sleep(kIdleSeconds + 1);
+  EXPECT_EQ(kMaxSessions, pool_.Size());
+}
+
+TEST_F(CryptoSessionPoolTest, OpenClearsPoolWhenOutOfSessions) {
+  delete pool_.Acquire(kLevelDefault);
+  ASSERT_TRUE(WaitForSize(kMaxSessions));
+
+  // Takes the OEMCrypto sessions the pool leaves free
+  std::vector<CryptoSession*> sessions;
+  CdmResponseType sts = NO_ERROR;
+  for (int i = 0; i < kMaxOpenSessions && NO_ERROR == sts; ++i) {
+    sessions.push_back(new CryptoSession());
+    sts = sessions.back()->Open(kLevelDefault);
+  }
+  EXPECT_EQ(INSUFFICIENT_CRYPTO_RESOURCES, sts);
+
+  CryptoSession session;
+  EXPECT_EQ(NO_ERROR, pool_.Open(&session, kLevelDefault));
+  EXPECT_TRUE(session.IsOpen());
+  EXPECT_EQ(0u, pool_.Size());
+
+  for (size_t i = 0; i < sessions.size(); ++i) delete sessions[i];
+}
+
+}  // namespace wvcdm
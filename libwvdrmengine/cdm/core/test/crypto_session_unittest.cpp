@@ -0,0 +1,79 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+
+#include "crypto_session.h"
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "properties.h"
+#include "scoped_ptr.h"
+
+namespace {
+const int kPollIntervalUs = 100000;
+const int kMaxPolls = 50;
+}  // namespace
+
+namespace wvcdm {
+
+class CryptoSessionTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Properties::Init();
+  }
+
+  virtual void TearDown() {
+    CryptoSession::Shutdown();
+  }
+
+  void SetIdleTerminationSeconds(uint32_t seconds) {
+    Properties::set_oem_crypto_idle_termination_seconds(seconds);
+  }
+
+  bool WaitForTermination() {
+    for (int i = 0; i < kMaxPolls; ++i) {
+      if (!CryptoSession::IsOEMCryptoInitialized()) return true;
+      usleep(kPollIntervalUs);
+    }
+    return false;
+  }
+};
+
+TEST_F(CryptoSessionTest, TerminatesWhenUnusedWithoutGracePeriod) {
+  SetIdleTerminationSeconds(0);
+  scoped_ptr<CryptoSession> session(new CryptoSession());
+  EXPECT_TRUE(CryptoSession::IsOEMCryptoInitialized());
+  session.reset();
+  EXPECT_FALSE(CryptoSession::IsOEMCryptoInitialized());
+}
+
+TEST_F(CryptoSessionTest, TerminatesAfterGracePeriod) {
+  SetIdleTerminationSeconds(1);
+  scoped_ptr<CryptoSession> session(new CryptoSession());
+  EXPECT_EQ(NO_ERROR, session->Open());
+  session.reset();
+  EXPECT_TRUE(CryptoSession::IsOEMCryptoInitialized());
+  EXPECT_TRUE(WaitForTermination());
+}
+
+TEST_F(CryptoSessionTest, StaysInitializedWhileInUse) {
+  SetIdleTerminationSeconds(1);
+  scoped_ptr<CryptoSession> session(new CryptoSession());
+  session.reset(new CryptoSession());
+  EXPECT_FALSE(WaitForTermination());
+  EXPECT_FALSE(CryptoSession::Shutdown());
+
+  session.reset();
+  EXPECT_TRUE(WaitForTermination());
+}
+
+TEST_F(CryptoSessionTest, ShutdownTerminatesRightAway) {
+  SetIdleTerminationSeconds(60);
+  scoped_ptr<CryptoSession> session(new CryptoSession());
+  session.reset();
+  EXPECT_TRUE(CryptoSession::IsOEMCryptoInitialized());
+
+  EXPECT_TRUE(CryptoSession::Shutdown());
+  EXPECT_FALSE(CryptoSession::IsOEMCryptoInitialized());
+}
+
+}  // namespace wvcdm
@@ -0,0 +1,174 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Measures DeviceFiles license store and retrieve throughput. Device files
+// are redirected to a directory created for the run under $TMPDIR, or
+// /data/local/tmp when it is not set. Point TMPDIR at a tmpfs mount for
+// numbers that reflect the CDM's serialization, hashing and File overhead
+// rather than the flash device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vector>
+
+#include "device_files.h"
+#include "file_store.h"
+#include "gtest/gtest.h"
+#include "properties.h"
+#include "string_conversions.h"
+#include "test_vectors.h"
+
+namespace {
+const size_t kNumLicenses = 200;
+const char kKeySetIdPrefix[] = "ksidbench";
+const char kDefaultTempDir[] = "/data/local/tmp";
+const char kBenchmarkDirTemplate[] = "/wvcdm_benchmark_XXXXXX";
+
+double ElapsedSeconds(const struct timespec& start,
+                      const struct timespec& end) {
+  return (end.tv_sec - start.tv_sec) +
+         (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+}
+}  // namespace
+
+namespace wvcdm {
+
+// Redirects paths under the device files base path to the benchmark
+// directory
+class RedirectedFile : public File {
+ public:
+  RedirectedFile(const std::string& from, const std::string& to)
+      : from_(from), to_(to) {}
+
+  virtual bool Open(const std::string& path, int flags) {
+    return File::Open(Map(path), flags);
+  }
+  virtual bool Exists(const std::string& path) {
+    return File::Exists(Map(path));
+  }
+  virtual bool Remove(const std::string& path) {
+    return File::Remove(Map(path));
+  }
+  virtual bool Copy(const std::string& old_path,
+                    const std::string& new_path) {
+    return File::Copy(Map(old_path), Map(new_path));
+  }
+  virtual bool Rename(const std::string& old_path,
+                      const std::string& new_path) {
+    return File::Rename(Map(old_path), Map(new_path));
+  }
+  virtual bool List(const std::string& path,
+                    std::vector<std::string>* files) {
+    return File::List(Map(path), files);
+  }
+  virtual bool CreateDirectory(const std::string path) {
+    return File::CreateDirectory(Map(path));
+  }
+  virtual bool IsDirectory(const std::string& path) {
+    return File::IsDirectory(Map(path));
+  }
+  virtual bool IsRegularFile(const std::string& path) {
+    return File::IsRegularFile(Map(path));
+  }
+  virtual ssize_t FileSize(const std::string& path) {
+    return File::FileSize(Map(path));
+  }
+
+ private:
+  std::string Map(const std::string& path) {
+    if (path.compare(0, from_.size(), from_) != 0) return path;
+    return to_ + path.substr(from_.size());
+  }
+
+  std::string from_;
+  std::string to_;
+};
+
+class DeviceFilesBenchmark : public ::testing::TestWithParam<size_t> {
+ protected:
+  virtual void SetUp() {
+    ASSERT_TRUE(Properties::GetDeviceFilesBasePath(kSecurityLevelL1,
+                                                   &device_base_path_));
+    const char* temp_dir = getenv("TMPDIR");
+    std::string dir_template(temp_dir != NULL ? temp_dir : kDefaultTempDir);
+    dir_template += kBenchmarkDirTemplate;
+    std::vector<char> dir_path(dir_template.begin(), dir_template.end());
+    dir_path.push_back('\0');
+    ASSERT_TRUE(mkdtemp(&dir_path[0]) != NULL)
+        << "unable to create a directory from " << dir_template;
+    benchmark_dir_.assign(&dir_path[0]);
+    benchmark_dir_ += "/";
+  }
+
+  virtual void TearDown() {
+    if (benchmark_dir_.empty()) return;
+    File file;
+    EXPECT_TRUE(file.Remove(benchmark_dir_));
+  }
+
+  std::string GenerateRandomData(uint32_t len) {
+    std::string data(len, 0);
+    for (size_t i = 0; i < len; i++) {
+      data[i] = rand() % 256;
+    }
+    return data;
+  }
+
+  void Report(const char* operation, size_t license_size, double seconds) {
+    printf("%-8s %6zu B licenses: %8.0f licenses/s %8.2f MB/s\n", operation,
+           license_size, kNumLicenses / seconds,
+           kNumLicenses * license_size / seconds / (1024 * 1024));
+  }
+
+  std::string device_base_path_;
+  std::string benchmark_dir_;
+};
+
+TEST_P(DeviceFilesBenchmark, StoreAndRetrieveLicenses) {
+  size_t license_size = GetParam();
+  RedirectedFile file(device_base_path_, benchmark_dir_);
+  DeviceFiles device_files;
+  ASSERT_TRUE(device_files.Init(&file, kSecurityLevelL1));
+
+  std::string pssh_data = GenerateRandomData(64);
+  std::string key_request = GenerateRandomData(1024);
+  std::string key_response = GenerateRandomData(license_size);
+  std::string release_server_url = "http://example.com/release";
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < kNumLicenses; ++i) {
+    ASSERT_TRUE(device_files.StoreLicense(
+        kKeySetIdPrefix + IntToString(i), DeviceFiles::kLicenseStateActive,
+        pssh_data, key_request, key_response, "", "", release_server_url));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  Report("Store", license_size, ElapsedSeconds(start, end));
+
+  DeviceFiles::LicenseState state;
+  CdmInitData retrieved_pssh_data;
+  CdmKeyMessage retrieved_key_request;
+  CdmKeyResponse retrieved_key_response;
+  CdmKeyMessage retrieved_renewal_request;
+  CdmKeyResponse retrieved_renewal_response;
+  std::string retrieved_release_server_url;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < kNumLicenses; ++i) {
+    ASSERT_TRUE(device_files.RetrieveLicense(
+        kKeySetIdPrefix + IntToString(i), &state, &retrieved_pssh_data,
+        &retrieved_key_request, &retrieved_key_response,
+        &retrieved_renewal_request, &retrieved_renewal_response,
+        &retrieved_release_server_url));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  Report("Retrieve", license_size, ElapsedSeconds(start, end));
+
+  EXPECT_EQ(key_response, retrieved_key_response);
+}
+
+INSTANTIATE_TEST_CASE_P(LicenseSize, DeviceFilesBenchmark,
+                        ::testing::Values(1024, 16 * 1024, 256 * 1024));
+
+}  // namespace wvcdm
@@ -985,10 +985,12 @@ class MockFile : public File {
 
   MOCK_METHOD2(Read, ssize_t(char*, size_t));
   MOCK_METHOD2(Write, ssize_t(const char*, size_t));
+  MOCK_METHOD0(DataSync, bool());
 
   MOCK_METHOD1(Exists, bool(const std::string&));
   MOCK_METHOD1(Remove, bool(const std::string&));
   MOCK_METHOD2(Copy, bool(const std::string&, const std::string&));
+  MOCK_METHOD2(Rename, bool(const std::string&, const std::string&));
   MOCK_METHOD2(List, bool(const std::string&, std::vector<std::string>*));
   MOCK_METHOD1(CreateDirectory, bool(const std::string));
   MOCK_METHOD1(IsDirectory, bool(const std::string&));
@@ -1028,6 +1030,8 @@ class DeviceFilesSecurityLevelTest
     : public DeviceFilesTest,
       public ::testing::WithParamInterface<CdmSecurityLevel> {};
 
+ACTION_P(SaveWrittenData, data) { data->assign(arg0, arg1); }
+
 MATCHER(IsCreateFileFlagSet, "") { return File::kCreate & arg; }
 MATCHER(IsBinaryFileFlagSet, "") { return File::kBinary & arg; }
 MATCHER_P(IsStrEq, str, "") {
@@ -1078,6 +1082,7 @@ TEST_P(DeviceFilesStoreTest, StoreCertificate) {
   EXPECT_CALL(file, Write(Contains(certificate, wrapped_private_key),
                           Gt(certificate.size() + wrapped_private_key.size())))
       .WillOnce(ReturnArg<1>());
+  EXPECT_CALL(file, DataSync()).WillOnce(Return(true));
   EXPECT_CALL(file, Close()).Times(1);
   EXPECT_CALL(file, Read(_, _)).Times(0);
 
@@ -1139,6 +1144,7 @@ TEST_P(DeviceFilesSecurityLevelTest, SecurityLevel) {
   EXPECT_CALL(file, Write(Contains(certificate, wrapped_private_key),
                           Gt(certificate.size() + wrapped_private_key.size())))
       .WillOnce(ReturnArg<1>());
+  EXPECT_CALL(file, DataSync()).WillOnce(Return(true));
   EXPECT_CALL(file, Close()).Times(1);
   EXPECT_CALL(file, Read(_, _)).Times(0);
 
@@ -1179,6 +1185,7 @@ TEST_P(DeviceFilesStoreTest, StoreLicense) {
                            license_test_data[license_num].key_release_url),
                   Gt(GetLicenseDataSize(license_test_data[license_num]))))
       .WillOnce(ReturnArg<1>());
+  EXPECT_CALL(file, DataSync()).WillOnce(Return(true));
   EXPECT_CALL(file, Close()).Times(1);
   EXPECT_CALL(file, Read(_, _)).Times(0);
 
@@ -1222,6 +1229,8 @@ TEST_F(DeviceFilesTest, StoreLicenses) {
                             Gt(GetLicenseDataSize(license_test_data[i]))))
         .WillOnce(ReturnArg<1>());
   }
+  EXPECT_CALL(file, DataSync()).Times(kNumberOfLicenses)
+      .WillRepeatedly(Return(true));
   EXPECT_CALL(file, Close()).Times(kNumberOfLicenses);
   EXPECT_CALL(file, Read(_, _)).Times(0);
 
@@ -1285,6 +1294,42 @@ TEST_F(DeviceFilesTest, RetrieveLicenses) {
   }
 }
 
+TEST_F(DeviceFilesTest, RetrieveLicenseHashMismatch) {
+  MockFile file;
+  std::string license_path = device_base_path_ +
+                             license_test_data[0].key_set_id +
+                             DeviceFiles::GetLicenseFileNameExtension();
+
+  // Corrupt a byte of the embedded license file
+  std::string data = license_test_data[0].file_data;
+  data[data.size() / 2] ^= 0x01;
+  size_t size = data.size();
+
+  EXPECT_CALL(file, Exists(StrEq(license_path))).WillOnce(Return(true));
+  EXPECT_CALL(file, FileSize(StrEq(license_path))).WillOnce(Return(size));
+  EXPECT_CALL(file, Open(StrEq(license_path), IsBinaryFileFlagSet()))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, Read(NotNull(), Eq(size))).WillOnce(
+      DoAll(SetArrayArgument<0>(data.begin(), data.end()), Return(size)));
+  EXPECT_CALL(file, Close()).Times(1);
+  EXPECT_CALL(file, Write(_, _)).Times(0);
+
+  DeviceFiles device_files;
+  EXPECT_TRUE(device_files.Init(&file, kSecurityLevelL1));
+  DeviceFiles::LicenseState license_state;
+  CdmInitData pssh_data;
+  CdmKeyMessage key_request;
+  CdmKeyResponse key_response;
+  CdmKeyMessage key_renewal_request;
+  CdmKeyResponse key_renewal_response;
+  std::string release_server_url;
+
+  EXPECT_FALSE(device_files.RetrieveLicense(
+      license_test_data[0].key_set_id, &license_state, &pssh_data, &key_request,
+      &key_response, &key_renewal_request, &key_renewal_response,
+      &release_server_url));
+}
+
 TEST_F(DeviceFilesTest, SecurityLevelPathBackwardCompatibility) {
   MockFile file;
   std::vector<std::string> security_dirs;
@@ -1340,24 +1385,145 @@ TEST_F(DeviceFilesTest, SecurityLevelPathBackwardCompatibility) {
   EXPECT_CALL(file, List(StrEq(base_path), NotNull()))
       .WillOnce(DoAll(SetArgPointee<1>(old_files), Return(true)));
 
+  std::string marker_path =
+      base_path + DeviceFiles::GetSecurityLevelPathMigrationFileName();
+  std::string temp_marker_path = marker_path + ".tmp";
+  EXPECT_CALL(file, Exists(StrEq(marker_path))).WillOnce(Return(false));
+  EXPECT_CALL(file, Open(StrEq(temp_marker_path),
+                         AllOf(IsCreateFileFlagSet(), IsBinaryFileFlagSet())))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, Write(NotNull(), Gt(0u))).WillOnce(ReturnArg<1>());
+  EXPECT_CALL(file, DataSync()).WillOnce(Return(true));
+  EXPECT_CALL(file, Rename(StrEq(temp_marker_path), StrEq(marker_path)))
+      .WillOnce(Return(true));
+
   std::string data = a2bs_hex(kTestCertificateFileData);
 
   new_path = device_base_path_ + DeviceFiles::GetCertificateFileName();
-  EXPECT_CALL(file, Exists(StrEq(new_path))).WillOnce(Return(true));
-  EXPECT_CALL(file, FileSize(_)).WillOnce(Return(data.size()));
-  EXPECT_CALL(file, Open(_, _)).WillOnce(Return(true));
+  EXPECT_CALL(file, Exists(StrEq(new_path))).Times(2)
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(file, FileSize(_)).Times(2).WillRepeatedly(Return(data.size()));
+  EXPECT_CALL(file, Open(StrEq(new_path), IsBinaryFileFlagSet())).Times(2)
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(file, Read(NotNull(), Eq(data.size()))).Times(2)
+      .WillRepeatedly(DoAll(SetArrayArgument<0>(data.begin(), data.end()),
+                            Return(data.size())));
+  EXPECT_CALL(file, Close()).Times(3);
+
+  DeviceFiles device_files;
+  EXPECT_TRUE(device_files.Init(&file, kSecurityLevelL1));
+
+  Properties::Init();
+  DeviceFiles::ResetSecurityLevelPathMigration();
+  std::string certificate, wrapped_private_key;
+  ASSERT_TRUE(
+      device_files.RetrieveCertificate(&certificate, &wrapped_private_key));
+
+  // The migration is not repeated once it has completed
+  ASSERT_TRUE(
+      device_files.RetrieveCertificate(&certificate, &wrapped_private_key));
+}
+
+TEST_F(DeviceFilesTest, SecurityLevelPathMigrationMarkerWriteFails) {
+  MockFile file;
+  std::vector<std::string> security_dirs;
+  EXPECT_TRUE(Properties::GetSecurityLevelDirectories(&security_dirs));
+
+  size_t pos = std::string::npos;
+  for (size_t i = 0; i < security_dirs.size(); ++i) {
+    pos = device_base_path_.rfind(security_dirs[i]);
+    if (std::string::npos != pos) break;
+  }
+
+  EXPECT_NE(std::string::npos, pos);
+
+  std::string base_path(device_base_path_, 0, pos);
+  std::string marker_path =
+      base_path + DeviceFiles::GetSecurityLevelPathMigrationFileName();
+  std::string temp_marker_path = marker_path + ".tmp";
+  EXPECT_CALL(file, Exists(StrEq(marker_path))).WillOnce(Return(false));
+  EXPECT_CALL(file, List(StrEq(base_path), NotNull()))
+      .WillOnce(Return(false));
+  EXPECT_CALL(file, IsDirectory(StrEq(base_path))).WillOnce(Return(true));
+
+  // A marker that is not fully written is discarded, never renamed into
+  // place
+  EXPECT_CALL(file, Open(StrEq(temp_marker_path),
+                         AllOf(IsCreateFileFlagSet(), IsBinaryFileFlagSet())))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, Write(NotNull(), Gt(0u))).WillOnce(Return(0));
+  EXPECT_CALL(file, Close());
+  EXPECT_CALL(file, Remove(StrEq(temp_marker_path))).WillOnce(Return(true));
+  EXPECT_CALL(file, Rename(_, _)).Times(0);
+
+  std::string device_certificate_path =
+      device_base_path_ + DeviceFiles::GetCertificateFileName();
+  EXPECT_CALL(file, Exists(StrEq(device_certificate_path)))
+      .WillOnce(Return(false));
+
+  DeviceFiles device_files;
+  EXPECT_TRUE(device_files.Init(&file, kSecurityLevelL1));
+
+  Properties::Init();
+  DeviceFiles::ResetSecurityLevelPathMigration();
+  std::string certificate, wrapped_private_key;
+  EXPECT_FALSE(
+      device_files.RetrieveCertificate(&certificate, &wrapped_private_key));
+  DeviceFiles::ResetSecurityLevelPathMigration();
+}
+
+TEST_F(DeviceFilesTest, SecurityLevelPathAlreadyMigrated) {
+  MockFile file;
+  std::vector<std::string> security_dirs;
+  EXPECT_TRUE(Properties::GetSecurityLevelDirectories(&security_dirs));
+
+  size_t pos = std::string::npos;
+  for (size_t i = 0; i < security_dirs.size(); ++i) {
+    pos = device_base_path_.rfind(security_dirs[i]);
+    if (std::string::npos != pos) break;
+  }
+
+  EXPECT_NE(std::string::npos, pos);
+
+  std::string base_path(device_base_path_, 0, pos);
+  std::string marker_path =
+      base_path + DeviceFiles::GetSecurityLevelPathMigrationFileName();
+  std::string version("1");
+  EXPECT_CALL(file, Exists(StrEq(marker_path))).WillOnce(Return(true));
+  EXPECT_CALL(file, FileSize(StrEq(marker_path)))
+      .WillOnce(Return(version.size()));
+  EXPECT_CALL(file, Open(StrEq(marker_path), IsBinaryFileFlagSet()))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, Read(NotNull(), Eq(version.size()))).WillOnce(DoAll(
+      SetArrayArgument<0>(version.begin(), version.end()),
+      Return(version.size())));
+  EXPECT_CALL(file, List(_, _)).Times(0);
+  EXPECT_CALL(file, Copy(_, _)).Times(0);
+  EXPECT_CALL(file, Remove(_)).Times(0);
+  EXPECT_CALL(file, Write(_, _)).Times(0);
+
+  std::string data = a2bs_hex(kTestCertificateFileData);
+  std::string device_certificate_path =
+      device_base_path_ + DeviceFiles::GetCertificateFileName();
+  EXPECT_CALL(file, Exists(StrEq(device_certificate_path)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, FileSize(StrEq(device_certificate_path)))
+      .WillOnce(Return(data.size()));
+  EXPECT_CALL(file, Open(StrEq(device_certificate_path), IsBinaryFileFlagSet()))
+      .WillOnce(Return(true));
   EXPECT_CALL(file, Read(NotNull(), Eq(data.size()))).WillOnce(DoAll(
       SetArrayArgument<0>(data.begin(), data.end()), Return(data.size())));
-  EXPECT_CALL(file, Close()).Times(1);
-  EXPECT_CALL(file, Write(_, _)).Times(0);
+  EXPECT_CALL(file, Close()).Times(2);
 
   DeviceFiles device_files;
   EXPECT_TRUE(device_files.Init(&file, kSecurityLevelL1));
 
   Properties::Init();
+  DeviceFiles::ResetSecurityLevelPathMigration();
   std::string certificate, wrapped_private_key;
   ASSERT_TRUE(
       device_files.RetrieveCertificate(&certificate, &wrapped_private_key));
+  EXPECT_EQ(kTestCertificate, b2a_hex(certificate));
 }
 
 TEST_F(DeviceFilesTest, UpdateLicenseState) {
@@ -1378,6 +1544,7 @@ TEST_F(DeviceFilesTest, UpdateLicenseState) {
   EXPECT_CALL(file, Write(IsStrEq(license_update_test_data[1].file_data),
                           Eq(license_update_test_data[1].file_data.size())))
       .WillOnce(ReturnArg<1>());
+  EXPECT_CALL(file, DataSync()).Times(2).WillRepeatedly(Return(true));
   EXPECT_CALL(file, Close()).Times(2);
   EXPECT_CALL(file, Read(_, _)).Times(0);
 
@@ -1404,6 +1571,72 @@ TEST_F(DeviceFilesTest, UpdateLicenseState) {
       license_update_test_data[0].key_release_url));
 }
 
+TEST_F(DeviceFilesTest, StoreAndRetrieveLicenseWithMultiplePssh) {
+  MockFile file;
+  std::string license_path = device_base_path_ +
+                             license_test_data[0].key_set_id +
+                             DeviceFiles::GetLicenseFileNameExtension();
+  CdmInitDataList pssh_data;
+  pssh_data.push_back(license_test_data[0].pssh_data);
+  pssh_data.push_back(license_test_data[1].pssh_data);
+  std::string file_data;
+
+  EXPECT_CALL(file, IsDirectory(StrEq(device_base_path_)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, Open(StrEq(license_path),
+                         AllOf(IsCreateFileFlagSet(), IsBinaryFileFlagSet())))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, Write(Contains(pssh_data[0], pssh_data[1]), _))
+      .WillOnce(DoAll(SaveWrittenData(&file_data), ReturnArg<1>()));
+  EXPECT_CALL(file, DataSync()).WillOnce(Return(true));
+  EXPECT_CALL(file, Close()).Times(3);
+
+  DeviceFiles device_files;
+  EXPECT_TRUE(device_files.Init(&file, kSecurityLevelL1));
+  EXPECT_TRUE(device_files.StoreLicense(
+      license_test_data[0].key_set_id, license_test_data[0].license_state,
+      pssh_data, license_test_data[0].key_request,
+      license_test_data[0].key_response,
+      license_test_data[0].key_renewal_request,
+      license_test_data[0].key_renewal_response,
+      license_test_data[0].key_release_url));
+
+  EXPECT_CALL(file, Exists(StrEq(license_path)))
+      .Times(2).WillRepeatedly(Return(true));
+  EXPECT_CALL(file, FileSize(StrEq(license_path)))
+      .Times(2).WillRepeatedly(Return(file_data.size()));
+  EXPECT_CALL(file, Open(StrEq(license_path), IsBinaryFileFlagSet()))
+      .Times(2).WillRepeatedly(Return(true));
+  EXPECT_CALL(file, Read(NotNull(), Eq(file_data.size())))
+      .Times(2).WillRepeatedly(
+          DoAll(SetArrayArgument<0>(file_data.begin(), file_data.end()),
+                Return(file_data.size())));
+
+  DeviceFiles::LicenseState license_state;
+  CdmInitDataList retrieved_pssh_data;
+  CdmKeyMessage key_request;
+  CdmKeyResponse key_response;
+  CdmKeyMessage key_renewal_request;
+  CdmKeyResponse key_renewal_response;
+  std::string release_server_url;
+  EXPECT_TRUE(device_files.RetrieveLicense(
+      license_test_data[0].key_set_id, &license_state, &retrieved_pssh_data,
+      &key_request, &key_response, &key_renewal_request,
+      &key_renewal_response, &release_server_url));
+  EXPECT_EQ(license_test_data[0].license_state, license_state);
+  EXPECT_EQ(pssh_data, retrieved_pssh_data);
+  EXPECT_EQ(license_test_data[0].key_request, key_request);
+  EXPECT_EQ(license_test_data[0].key_response, key_response);
+
+  // Callers that know a single PSSH get the first one
+  CdmInitData first_pssh_data;
+  EXPECT_TRUE(device_files.RetrieveLicense(
+      license_test_data[0].key_set_id, &license_state, &first_pssh_data,
+      &key_request, &key_response, &key_renewal_request,
+      &key_renewal_response, &release_server_url));
+  EXPECT_EQ(pssh_data[0], first_pssh_data);
+}
+
 TEST_F(DeviceFilesTest, DeleteLicense) {
   MockFile file;
   std::string license_path = device_base_path_ +
@@ -1450,4 +1683,30 @@ TEST_F(DeviceFilesTest, DeleteLicense) {
   EXPECT_FALSE(device_files.LicenseExists(license_test_data[0].key_set_id));
 }
 
+TEST_F(DeviceFilesTest, ListLicenses) {
+  MockFile file;
+  std::vector<std::string> files;
+  files.push_back(license_test_data[0].key_set_id +
+                  DeviceFiles::GetLicenseFileNameExtension());
+  files.push_back(DeviceFiles::GetCertificateFileName());
+  files.push_back(license_test_data[1].key_set_id +
+                  DeviceFiles::GetLicenseFileNameExtension());
+  files.push_back(DeviceFiles::GetLicenseFileNameExtension());
+
+  EXPECT_CALL(file, IsDirectory(StrEq(device_base_path_)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(file, List(StrEq(device_base_path_), NotNull()))
+      .WillOnce(DoAll(SetArgPointee<1>(files), Return(true)));
+  EXPECT_CALL(file, Open(_, _)).Times(0);
+
+  DeviceFiles device_files;
+  EXPECT_TRUE(device_files.Init(&file, kSecurityLevelL1));
+
+  std::vector<std::string> key_set_ids;
+  EXPECT_TRUE(device_files.ListLicenses(&key_set_ids));
+  ASSERT_EQ(2u, key_set_ids.size());
+  EXPECT_EQ(license_test_data[0].key_set_id, key_set_ids[0]);
+  EXPECT_EQ(license_test_data[1].key_set_id, key_set_ids[1]);
+}
+
 }  // namespace wvcdm
@@ -0,0 +1,328 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+
+#include "event_dispatcher.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lock.h"
+#include "wv_cdm_event_listener.h"
+
+namespace {
+const std::string kSessionId1 = "session_1";
+const std::string kSessionId2 = "session_2";
+const int kPollIntervalUs = 1000;
+const int kMaxPolls = 2000;
+const size_t kMaxQueuedEventsPerListener = 16;
+}  // namespace
+
+namespace wvcdm {
+
+// Records delivered events. Delivery can be held up to let events queue.
+class TestListener : public WvCdmEventListener {
+ public:
+  struct Delivery {
+    CdmSessionId session_id;
+    bool is_key_status_event;
+    CdmEventType event;
+    CdmKeyStatusEvent key_status_event;
+    int sequence;  // order of delivery across all listeners
+  };
+
+  TestListener() : blocked_(false), in_callback_(false) {}
+
+  virtual void onEvent(const CdmSessionId& session_id,
+                       CdmEventType cdm_event) {
+    Delivery delivery;
+    delivery.session_id = session_id;
+    delivery.is_key_status_event = false;
+    delivery.event = cdm_event;
+    Record(delivery);
+  }
+
+  virtual void onKeyStatusEvent(const CdmSessionId& session_id,
+                                const CdmKeyStatusEvent& event) {
+    Delivery delivery;
+    delivery.session_id = session_id;
+    delivery.is_key_status_event = true;
+    delivery.event = LICENSE_EXPIRED_EVENT;
+    delivery.key_status_event = event;
+    Record(delivery);
+  }
+
+  void Block() {
+    AutoLock auto_lock(lock_);
+    blocked_ = true;
+  }
+
+  void Unblock() {
+    AutoLock auto_lock(lock_);
+    blocked_ = false;
+  }
+
+  // Waits for a callback to be held up by Block
+  bool WaitForBlockedCallback() {
+    for (int i = 0; i < kMaxPolls; ++i) {
+      {
+        AutoLock auto_lock(lock_);
+        if (in_callback_) return true;
+      }
+      usleep(kPollIntervalUs);
+    }
+    return false;
+  }
+
+  bool WaitForDeliveries(size_t count) {
+    for (int i = 0; i < kMaxPolls; ++i) {
+      if (deliveries().size() >= count) return true;
+      usleep(kPollIntervalUs);
+    }
+    return false;
+  }
+
+  std::vector<Delivery> deliveries() {
+    AutoLock auto_lock(lock_);
+    return deliveries_;
+  }
+
+  std::vector<pthread_t> threads() {
+    AutoLock auto_lock(lock_);
+    return threads_;
+  }
+
+ private:
+  void Record(const Delivery& delivery) {
+    lock_.Acquire();
+    in_callback_ = true;
+    while (blocked_) {
+      lock_.Release();
+      usleep(kPollIntervalUs);
+      lock_.Acquire();
+    }
+    in_callback_ = false;
+    deliveries_.push_back(delivery);
+    {
+      AutoLock sequence_lock(sequence_lock_);
+      deliveries_.back().sequence = next_sequence_++;
+    }
+    threads_.push_back(pthread_self());
+    lock_.Release();
+  }
+
+  static Lock sequence_lock_;
+  static int next_sequence_;
+
+  Lock lock_;
+  bool blocked_;
+  bool in_callback_;
+  std::vector<Delivery> deliveries_;
+  std::vector<pthread_t> threads_;
+};
+
+Lock TestListener::sequence_lock_;
+int TestListener::next_sequence_ = 0;
+
+CdmKeyStatusEvent ExpiringEvent(int64_t threshold_seconds) {
+  CdmKeyStatusEvent event;
+  event.type = kKeyStatusExpiring;
+  event.threshold_seconds = threshold_seconds;
+  return event;
+}
+
+TEST(EventDispatcherTest, DeliversInOrderOnDispatcherThread) {
+  EventDispatcher dispatcher;
+  TestListener listener;
+
+  dispatcher.Post(&listener, kSessionId1, LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Post(&listener, kSessionId1, ExpiringEvent(600));
+  dispatcher.Post(&listener, kSessionId2, LICENSE_EXPIRED_EVENT);
+  ASSERT_TRUE(listener.WaitForDeliveries(3));
+
+  std::vector<TestListener::Delivery> deliveries = listener.deliveries();
+  ASSERT_EQ(3u, deliveries.size());
+  EXPECT_EQ(kSessionId1, deliveries[0].session_id);
+  EXPECT_FALSE(deliveries[0].is_key_status_event);
+  EXPECT_EQ(LICENSE_RENEWAL_NEEDED_EVENT, deliveries[0].event);
+  EXPECT_TRUE(deliveries[1].is_key_status_event);
+  EXPECT_EQ(kKeyStatusExpiring, deliveries[1].key_status_event.type);
+  EXPECT_EQ(kSessionId2, deliveries[2].session_id);
+  EXPECT_EQ(LICENSE_EXPIRED_EVENT, deliveries[2].event);
+
+  std::vector<pthread_t> threads = listener.threads();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    EXPECT_FALSE(pthread_equal(pthread_self(), threads[i]));
+  }
+}
+
+TEST(EventDispatcherTest, CoalescesQueuedEvents) {
+  EventDispatcher dispatcher;
+  TestListener listener;
+
+  listener.Block();
+  dispatcher.Post(&listener, kSessionId2, LICENSE_EXPIRED_EVENT);
+  ASSERT_TRUE(listener.WaitForBlockedCallback());
+
+  dispatcher.Post(&listener, kSessionId1, LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Post(&listener, kSessionId1, ExpiringEvent(600));
+  dispatcher.Post(&listener, kSessionId1, LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Post(&listener, kSessionId1, ExpiringEvent(60));
+  listener.Unblock();
+  ASSERT_TRUE(listener.WaitForDeliveries(3));
+  usleep(10 * kPollIntervalUs);
+
+  std::vector<TestListener::Delivery> deliveries = listener.deliveries();
+  ASSERT_EQ(3u, deliveries.size());
+  EXPECT_EQ(kSessionId2, deliveries[0].session_id);
+  EXPECT_EQ(LICENSE_RENEWAL_NEEDED_EVENT, deliveries[1].event);
+  EXPECT_TRUE(deliveries[2].is_key_status_event);
+  EXPECT_EQ(60, deliveries[2].key_status_event.threshold_seconds);
+}
+
+TEST(EventDispatcherTest, DeliversLatestStatusLast) {
+  EventDispatcher dispatcher;
+  TestListener listener;
+
+  listener.Block();
+  dispatcher.Post(&listener, kSessionId2, LICENSE_EXPIRED_EVENT);
+  ASSERT_TRUE(listener.WaitForBlockedCallback());
+
+  CdmKeyStatusEvent usable;
+  usable.type = kKeyStatusUsable;
+  CdmKeyStatusEvent expired;
+  expired.type = kKeyStatusExpired;
+  dispatcher.Post(&listener, kSessionId1, usable);
+  dispatcher.Post(&listener, kSessionId1, expired);
+  dispatcher.Post(&listener, kSessionId1, usable);
+  listener.Unblock();
+  ASSERT_TRUE(listener.WaitForDeliveries(3));
+  usleep(10 * kPollIntervalUs);
+
+  std::vector<TestListener::Delivery> deliveries = listener.deliveries();
+  ASSERT_EQ(3u, deliveries.size());
+  EXPECT_EQ(kKeyStatusExpired, deliveries[1].key_status_event.type);
+  EXPECT_EQ(kKeyStatusUsable, deliveries[2].key_status_event.type);
+}
+
+TEST(EventDispatcherTest, CancelDiscardsQueuedEvents) {
+  EventDispatcher dispatcher;
+  TestListener listener;
+
+  listener.Block();
+  dispatcher.Post(&listener, kSessionId2, LICENSE_EXPIRED_EVENT);
+  ASSERT_TRUE(listener.WaitForBlockedCallback());
+
+  dispatcher.Post(&listener, kSessionId1, LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Post(&listener, kSessionId2, LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Cancel(&listener, kSessionId1);
+  listener.Unblock();
+  ASSERT_TRUE(listener.WaitForDeliveries(2));
+  usleep(10 * kPollIntervalUs);
+
+  std::vector<TestListener::Delivery> deliveries = listener.deliveries();
+  ASSERT_EQ(2u, deliveries.size());
+  EXPECT_EQ(kSessionId2, deliveries[0].session_id);
+  EXPECT_EQ(kSessionId2, deliveries[1].session_id);
+  EXPECT_EQ(LICENSE_RENEWAL_NEEDED_EVENT, deliveries[1].event);
+}
+
+TEST(EventDispatcherTest, ServesListenersInTurn) {
+  EventDispatcher dispatcher;
+  TestListener slow_listener;
+  TestListener listener;
+
+  slow_listener.Block();
+  dispatcher.Post(&slow_listener, kSessionId1, LICENSE_EXPIRED_EVENT);
+  ASSERT_TRUE(slow_listener.WaitForBlockedCallback());
+
+  dispatcher.Post(&slow_listener, kSessionId1, LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Post(&slow_listener, kSessionId1, ExpiringEvent(600));
+  dispatcher.Post(&listener, kSessionId2, LICENSE_RENEWAL_NEEDED_EVENT);
+  slow_listener.Unblock();
+  ASSERT_TRUE(slow_listener.WaitForDeliveries(3));
+  ASSERT_TRUE(listener.WaitForDeliveries(1));
+
+  // The other listener is not queued behind the whole backlog
+  std::vector<TestListener::Delivery> slow_deliveries =
+      slow_listener.deliveries();
+  std::vector<TestListener::Delivery> deliveries = listener.deliveries();
+  EXPECT_EQ(LICENSE_EXPIRED_EVENT, slow_deliveries[0].event);
+  EXPECT_EQ(LICENSE_RENEWAL_NEEDED_EVENT, slow_deliveries[1].event);
+  EXPECT_TRUE(slow_deliveries[2].is_key_status_event);
+  EXPECT_LT(deliveries[0].sequence, slow_deliveries[2].sequence);
+}
+
+TEST(EventDispatcherTest, BoundsQueueWhenListenerStalls) {
+  EventDispatcher dispatcher;
+  TestListener listener;
+
+  listener.Block();
+  dispatcher.Post(&listener, "blocked", LICENSE_EXPIRED_EVENT);
+  ASSERT_TRUE(listener.WaitForBlockedCallback());
+
+  // Fill the queue with one status event followed by renewal events
+  dispatcher.Post(&listener, "status", ExpiringEvent(600));
+  for (size_t i = 1; i < kMaxQueuedEventsPerListener; ++i) {
+    dispatcher.Post(&listener, std::string(i, 'r'),
+                    LICENSE_RENEWAL_NEEDED_EVENT);
+  }
+
+  // Duplicates coalesce and the status event makes room for the first new
+  // session. Events of other sessions are still queued, while a status
+  // snapshot is dropped.
+  dispatcher.Post(&listener, "r", LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Post(&listener, kSessionId1, LICENSE_RENEWAL_NEEDED_EVENT);
+  dispatcher.Post(&listener, kSessionId2, LICENSE_EXPIRED_EVENT);
+  dispatcher.Post(&listener, kSessionId1, ExpiringEvent(60));
+  listener.Unblock();
+  ASSERT_TRUE(listener.WaitForDeliveries(kMaxQueuedEventsPerListener + 2));
+  usleep(10 * kPollIntervalUs);
+
+  std::vector<TestListener::Delivery> deliveries = listener.deliveries();
+  ASSERT_EQ(kMaxQueuedEventsPerListener + 2, deliveries.size());
+  for (size_t i = 1; i < kMaxQueuedEventsPerListener; ++i) {
+    EXPECT_EQ(std::string(i, 'r'), deliveries[i].session_id);
+  }
+  EXPECT_EQ(kSessionId1, deliveries[kMaxQueuedEventsPerListener].session_id);
+  EXPECT_EQ(kSessionId2, deliveries.back().session_id);
+  EXPECT_EQ(LICENSE_EXPIRED_EVENT, deliveries.back().event);
+  EXPECT_FALSE(deliveries.back().is_key_status_event);
+}
+
+TEST(EventDispatcherTest, KeepsRenewalStatusWhenQueueIsFull) {
+  EventDispatcher dispatcher;
+  TestListener listener;
+
+  listener.Block();
+  dispatcher.Post(&listener, "blocked", LICENSE_EXPIRED_EVENT);
+  ASSERT_TRUE(listener.WaitForBlockedCallback());
+
+  CdmKeyStatusEvent renewed;
+  renewed.type = kKeyStatusRenewed;
+  CdmKeyStatusEvent renewal_failed;
+  renewal_failed.type = kKeyStatusRenewalFailed;
+  dispatcher.Post(&listener, "renewed", renewed);
+  dispatcher.Post(&listener, "renewal_failed", renewal_failed);
+  dispatcher.Post(&listener, "expiring", ExpiringEvent(600));
+  for (size_t i = 3; i < kMaxQueuedEventsPerListener; ++i) {
+    dispatcher.Post(&listener, std::string(i, 'r'),
+                    LICENSE_RENEWAL_NEEDED_EVENT);
+  }
+
+  // Only the expiry warning makes room
+  dispatcher.Post(&listener, kSessionId1, LICENSE_RENEWAL_NEEDED_EVENT);
+  listener.Unblock();
+  ASSERT_TRUE(listener.WaitForDeliveries(kMaxQueuedEventsPerListener + 1));
+  usleep(10 * kPollIntervalUs);
+
+  std::vector<TestListener::Delivery> deliveries = listener.deliveries();
+  ASSERT_EQ(kMaxQueuedEventsPerListener + 1, deliveries.size());
+  EXPECT_EQ(kKeyStatusRenewed, deliveries[1].key_status_event.type);
+  EXPECT_EQ(kKeyStatusRenewalFailed, deliveries[2].key_status_event.type);
+  EXPECT_EQ(std::string(3, 'r'), deliveries[3].session_id);
+  EXPECT_EQ(kSessionId1, deliveries.back().session_id);
+}
+
+}  // namespace wvcdm
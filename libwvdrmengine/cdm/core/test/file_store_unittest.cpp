@@ -3,6 +3,7 @@
 #include "device_files.h"
 #include "file_store.h"
 #include "gtest/gtest.h"
+#include "lock.h"
 #include "properties.h"
 #include "test_vectors.h"
 
@@ -226,6 +227,136 @@ TEST_F(FileTest, CopyFile) {
   EXPECT_EQ(file.FileSize(path), file.FileSize(path_copy));
 }
 
+TEST_F(FileTest, RenameFile) {
+  std::string path = test_vectors::kTestDir + kTestFileName;
+  std::string path_renamed = test_vectors::kTestDir + kTestFileName2;
+  File file;
+  file.Remove(path);
+  file.Remove(path_renamed);
+
+  std::string write_data = GenerateRandomData(600);
+  EXPECT_TRUE(file.Open(path, File::kCreate | File::kBinary));
+  EXPECT_TRUE(file.Write(write_data.data(), write_data.size()));
+  EXPECT_TRUE(file.Sync());
+  file.Close();
+
+  EXPECT_TRUE(file.Rename(path, path_renamed));
+  EXPECT_FALSE(file.Exists(path));
+  EXPECT_EQ(static_cast<ssize_t>(write_data.size()),
+            file.FileSize(path_renamed));
+}
+
+TEST_F(FileTest, PositionalReadWrite) {
+  std::string path = test_vectors::kTestDir + kTestFileName;
+  File file;
+  file.Remove(path);
+
+  std::string head = GenerateRandomData(300);
+  std::string tail = GenerateRandomData(300);
+  EXPECT_TRUE(file.Open(path, File::kCreate | File::kBinary));
+  EXPECT_TRUE(file.Allocate(head.size() + tail.size()));
+  EXPECT_EQ(static_cast<ssize_t>(tail.size()),
+            file.WriteAt(tail.data(), tail.size(), head.size()));
+  EXPECT_EQ(static_cast<ssize_t>(head.size()),
+            file.WriteAt(head.data(), head.size(), 0));
+  EXPECT_TRUE(file.DataSync());
+
+  std::string read_data(tail.size(), 0);
+  EXPECT_EQ(static_cast<ssize_t>(tail.size()),
+            file.ReadAt(&read_data[0], read_data.size(), head.size()));
+  EXPECT_EQ(tail, read_data);
+  file.Close();
+
+  EXPECT_EQ(static_cast<ssize_t>(head.size() + tail.size()),
+            file.FileSize(path));
+}
+
+TEST_F(FileTest, VectoredReadWrite) {
+  std::string path = test_vectors::kTestDir + kTestFileName;
+  File file;
+  file.Remove(path);
+
+  std::string header = GenerateRandomData(32);
+  std::string payload = GenerateRandomData(600);
+  File::IoVector write_vectors[] = {
+    { &header[0], header.size() },
+    { &payload[0], payload.size() }
+  };
+  EXPECT_TRUE(file.Open(path, File::kCreate | File::kBinary));
+  EXPECT_EQ(static_cast<ssize_t>(header.size() + payload.size()),
+            file.WriteV(write_vectors, 2));
+  file.Close();
+
+  std::string read_header(header.size(), 0);
+  std::string read_payload(payload.size(), 0);
+  File::IoVector read_vectors[] = {
+    { &read_header[0], read_header.size() },
+    { &read_payload[0], read_payload.size() }
+  };
+  EXPECT_TRUE(file.Open(path, File::kReadOnly | File::kBinary));
+  EXPECT_EQ(static_cast<ssize_t>(header.size() + payload.size()),
+            file.ReadV(read_vectors, 2));
+  file.Close();
+  EXPECT_EQ(header, read_header);
+  EXPECT_EQ(payload, read_payload);
+}
+
+class CountingFileIoHandler : public FileIoHandler {
+ public:
+  CountingFileIoHandler() : calls_(0), bytes_(0) {}
+
+  virtual void OnFileIoComplete(void* context, ssize_t result) {
+    AutoLock auto_lock(lock_);
+    ++calls_;
+    if (result > 0) bytes_ += result;
+  }
+
+  int calls() {
+    AutoLock auto_lock(lock_);
+    return calls_;
+  }
+
+  size_t bytes() {
+    AutoLock auto_lock(lock_);
+    return bytes_;
+  }
+
+ private:
+  Lock lock_;
+  int calls_;
+  size_t bytes_;
+};
+
+TEST_F(FileTest, AsyncReadWrite) {
+  const size_t kBlockSize = 512;
+  const int kNumBlocks = 8;
+  std::string path = test_vectors::kTestDir + kTestFileName;
+  File file;
+  file.Remove(path);
+
+  std::string write_data = GenerateRandomData(kBlockSize * kNumBlocks);
+  CountingFileIoHandler write_handler;
+  EXPECT_TRUE(file.Open(path, File::kCreate | File::kBinary));
+  for (int i = 0; i < kNumBlocks; ++i) {
+    EXPECT_TRUE(file.SubmitWriteAt(write_data.data() + i * kBlockSize,
+                                   kBlockSize, i * kBlockSize,
+                                   &write_handler, NULL));
+  }
+  file.WaitForPendingIo();
+  EXPECT_EQ(kNumBlocks, write_handler.calls());
+  EXPECT_EQ(write_data.size(), write_handler.bytes());
+
+  std::string read_data(write_data.size(), 0);
+  CountingFileIoHandler read_handler;
+  for (int i = 0; i < kNumBlocks; ++i) {
+    EXPECT_TRUE(file.SubmitReadAt(&read_data[i * kBlockSize], kBlockSize,
+                                  i * kBlockSize, &read_handler, NULL));
+  }
+  file.Close();
+  EXPECT_EQ(kNumBlocks, read_handler.calls());
+  EXPECT_EQ(write_data, read_data);
+}
+
 TEST_F(FileTest, ListEmptyDirectory) {
   std::vector<std::string> files;
   File file;
@@ -1,10 +1,18 @@
 // Copyright 2012 Google Inc. All Rights Reserved.
 
+#include "cdm_client_property_set.h"
 #include "crypto_session.h"
 #include "license.h"
 #include "gtest/gtest.h"
+#include "license_protocol.pb.h"
+#include "openssl/bn.h"
+#include "openssl/evp.h"
+#include "openssl/rsa.h"
 #include "policy_engine.h"
+#include "properties.h"
+#include "service_certificate_cache.h"
 #include "string_conversions.h"
+#include "wv_cdm_constants.h"
 
 namespace {
 
@@ -41,28 +49,223 @@ static const char* kInvalidResponse =
     "2E4A47A24C06AC1B1A2061F21836A04E558BEE0244EF41C165F60CF23C580275"
     "3175D48BAF1C6CA5759F200220A2BCCA86051A203FD4671075D9DEC6486A9317"
     "70669993306831EDD57D77F34EFEB467470BA364";
+static const char* kServiceId = "license.widevine.com";
 }
 
 namespace wvcdm {
 
+using video_widevine_server::sdk::ClientIdentification;
+using video_widevine_server::sdk::ClientIdentification_NameValue;
+using video_widevine_server::sdk::DeviceCertificate;
+using video_widevine_server::sdk::License;
+using video_widevine_server::sdk::License_KeyContainer;
+using video_widevine_server::sdk::LicenseRequest;
+using video_widevine_server::sdk::LicenseRequest_ContentIdentification_CENC;
+using video_widevine_server::sdk::SignedMessage;
+
+class TestPropertySet : public CdmClientPropertySet {
+ public:
+  TestPropertySet(bool use_privacy_mode, const std::string& certificate)
+      : use_privacy_mode_(use_privacy_mode),
+        service_certificate_(certificate.begin(), certificate.end()),
+        session_sharing_id_(0) {}
+
+  virtual std::string security_level() const { return ""; }
+  virtual bool use_privacy_mode() const { return use_privacy_mode_; }
+  virtual const std::vector<uint8_t>& service_certificate() const {
+    return service_certificate_;
+  }
+  virtual bool is_session_sharing_enabled() const { return false; }
+  virtual uint32_t session_sharing_id() const { return session_sharing_id_; }
+  virtual void set_session_sharing_id(uint32_t id) {
+    session_sharing_id_ = id;
+  }
+
+ private:
+  bool use_privacy_mode_;
+  std::vector<uint8_t> service_certificate_;
+  uint32_t session_sharing_id_;
+};
+
 class LicenseTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
+    Properties::Init();
+    ServiceCertificateCache::Clear();
     session_ = new CryptoSession();
     EXPECT_TRUE(session_ != NULL);
 
-    std::string token;
-    EXPECT_TRUE(session_->GetToken(&token));
+    EXPECT_TRUE(session_->GetToken(&token_));
 
-    EXPECT_TRUE(session_->Open());
-    EXPECT_TRUE(license_.Init(token, session_, &policy_engine_));
+    EXPECT_EQ(NO_ERROR, session_->Open());
+    EXPECT_TRUE(license_.Init(token_, session_, &policy_engine_));
   }
 
   virtual void TearDown() {
     session_->Close();
     delete session_;
+    ServiceCertificateCache::Clear();
   }
 
+  static RSA* ServiceKey() {
+    static RSA* key = NULL;
+    if (key == NULL) {
+      BIGNUM* exponent = BN_new();
+      BN_set_word(exponent, RSA_F4);
+      key = RSA_new();
+      RSA_generate_key_ex(key, 2048, exponent, NULL);
+      BN_free(exponent);
+    }
+    return key;
+  }
+
+  static std::string CreateServiceCertificate() {
+    unsigned char* der = NULL;
+    int der_size = i2d_RSAPublicKey(ServiceKey(), &der);
+    DeviceCertificate certificate;
+    certificate.set_type(DeviceCertificate::SERVICE);
+    certificate.set_serial_number("serial0");
+    certificate.set_public_key(der, der_size);
+    certificate.set_service_id(kServiceId);
+    OPENSSL_free(der);
+    std::string serialized;
+    certificate.SerializeToString(&serialized);
+    return serialized;
+  }
+
+  // Reverses the client id encryption of a privacy mode request
+  static bool DecryptClientId(const LicenseRequest& license_request,
+                              std::string* client_id) {
+    const std::string& enc_key =
+        license_request.encrypted_client_id().encrypted_privacy_key();
+    std::string key(RSA_size(ServiceKey()), 0);
+    int key_size = RSA_private_decrypt(
+        enc_key.size(), reinterpret_cast<const unsigned char*>(enc_key.data()),
+        reinterpret_cast<unsigned char*>(&key[0]), ServiceKey(),
+        RSA_PKCS1_OAEP_PADDING);
+    if (key_size != KEY_SIZE) return false;
+
+    const std::string& iv =
+        license_request.encrypted_client_id().encrypted_client_id_iv();
+    const std::string& enc_id =
+        license_request.encrypted_client_id().encrypted_client_id();
+    client_id->resize(enc_id.size());
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int update_size = 0;
+    int final_size = 0;
+    bool ok =
+        EVP_DecryptInit_ex(
+            ctx, EVP_aes_128_cbc(), NULL,
+            reinterpret_cast<const unsigned char*>(key.data()),
+            reinterpret_cast<const unsigned char*>(iv.data())) &&
+        EVP_DecryptUpdate(
+            ctx, reinterpret_cast<unsigned char*>(&(*client_id)[0]),
+            &update_size,
+            reinterpret_cast<const unsigned char*>(enc_id.data()),
+            enc_id.size()) &&
+        EVP_DecryptFinal_ex(
+            ctx, reinterpret_cast<unsigned char*>(&(*client_id)[update_size]),
+            &final_size);
+    EVP_CIPHER_CTX_free(ctx);
+    client_id->resize(ok ? update_size + final_size : 0);
+    return ok;
+  }
+
+  static void AddClientInfo(const std::string& name, const std::string& value,
+                            ClientIdentification* client_id) {
+    ClientIdentification_NameValue* client_info =
+        client_id->add_client_info();
+    client_info->set_name(name);
+    client_info->set_value(value);
+  }
+
+  // Builds the client id as a single protobuf message, app parameters
+  // ahead of the device information
+  std::string ExpectedClientId(const CdmAppParameterMap& app_parameters) {
+    ClientIdentification client_id;
+    if (Properties::use_certificates_as_identification())
+      client_id.set_type(ClientIdentification::DEVICE_CERTIFICATE);
+    else
+      client_id.set_type(ClientIdentification::KEYBOX);
+    client_id.set_token(token_);
+
+    CdmAppParameterMap::const_iterator iter;
+    for (iter = app_parameters.begin(); iter != app_parameters.end(); iter++)
+      AddClientInfo(iter->first, iter->second, &client_id);
+    std::string value;
+    if (Properties::GetCompanyName(&value))
+      AddClientInfo("company_name", value, &client_id);
+    if (Properties::GetModelName(&value))
+      AddClientInfo("model_name", value, &client_id);
+    if (Properties::GetArchitectureName(&value))
+      AddClientInfo("architecture_name", value, &client_id);
+    if (Properties::GetDeviceName(&value))
+      AddClientInfo("device_name", value, &client_id);
+    if (Properties::GetProductName(&value))
+      AddClientInfo("product_name", value, &client_id);
+    if (Properties::GetBuildInfo(&value))
+      AddClientInfo("build_info", value, &client_id);
+    if (session_->GetDeviceUniqueId(&value))
+      AddClientInfo("device_id", value, &client_id);
+
+    std::string serialized;
+    client_id.SerializeToString(&serialized);
+    return serialized;
+  }
+
+  // Prepares a license request and checks it is laid out exactly as
+  // protobuf serializes it
+  void PrepareLicenseRequest(bool use_privacy_mode,
+                             const CdmAppParameterMap& app_parameters,
+                             LicenseRequest* license_request) {
+    TestPropertySet property_set(use_privacy_mode, CreateServiceCertificate());
+    CdmSessionId session_id("ksid0");
+    EXPECT_TRUE(Properties::AddSessionPropertySet(session_id, &property_set));
+
+    std::string signed_request;
+    std::string server_url;
+    EXPECT_TRUE(license_.PrepareKeyRequest(a2bs_hex(kInitData),
+                                           kLicenseTypeStreaming,
+                                           app_parameters,
+                                           session_id,
+                                           &signed_request,
+                                           &server_url));
+    EXPECT_TRUE(Properties::RemoveSessionPropertySet(session_id));
+
+    SignedMessage signed_message;
+    EXPECT_TRUE(signed_message.ParseFromString(signed_request));
+    EXPECT_EQ(SignedMessage::LICENSE_REQUEST, signed_message.type());
+    EXPECT_TRUE(license_request->ParseFromString(signed_message.msg()));
+    EXPECT_EQ(license_request->SerializeAsString(), signed_message.msg());
+  }
+
+  // Builds a signed streaming license response carrying |num_keys| content
+  // keys, accepted as is by the fake OEMCrypto
+  static std::string CreateLicenseResponse(int num_keys) {
+    License license;
+    license.mutable_id()->set_request_id("request_id");
+    license.mutable_id()->set_session_id("session_id");
+    license.mutable_policy()->set_can_play(true);
+    for (int i = 0; i < num_keys; ++i) {
+      License_KeyContainer* key = license.add_key();
+      key->set_id(std::string(16, 'a' + i));
+      key->set_iv(std::string(16, 'A' + i));
+      key->set_key(std::string(32, 'k' + i));
+      key->set_type(License_KeyContainer::CONTENT);
+      key->mutable_key_control()->set_key_control_block(
+          std::string(16, 'c' + i));
+      key->mutable_key_control()->set_iv(std::string(16, 'C' + i));
+    }
+
+    SignedMessage signed_message;
+    signed_message.set_type(SignedMessage::LICENSE);
+    signed_message.set_msg(license.SerializeAsString());
+    signed_message.set_signature(std::string(32, 's'));
+    signed_message.set_session_key(std::string(256, 'e'));
+    return signed_message.SerializeAsString();
+  }
+
+  std::string token_;
   CryptoSession* session_;
   CdmLicense license_;
   PolicyEngine policy_engine_;
@@ -120,6 +323,167 @@ TEST_F(LicenseTest, DISABLED_HandleKeyResponseInvalid) {
   EXPECT_FALSE(license_.HandleKeyResponse(a2bs_hex(kInvalidResponse)));
 }
 
+TEST_F(LicenseTest, PrivacyModeWithoutCertificateRequestsOne) {
+  // A certificate verified for another session, possibly for another
+  // provider, must not be used to encrypt this session's client id
+  EXPECT_TRUE(ServiceCertificateCache::Add(CreateServiceCertificate(), true));
+
+  TestPropertySet property_set(true, "");
+  CdmSessionId session_id("ksid0");
+  EXPECT_TRUE(Properties::AddSessionPropertySet(session_id, &property_set));
+
+  std::string signed_request;
+  CdmAppParameterMap app_parameters;
+  std::string server_url;
+  EXPECT_TRUE(license_.PrepareKeyRequest(a2bs_hex(kInitData),
+                                         kLicenseTypeStreaming,
+                                         app_parameters,
+                                         session_id,
+                                         &signed_request,
+                                         &server_url));
+  SignedMessage signed_message;
+  EXPECT_TRUE(signed_message.ParseFromString(signed_request));
+  EXPECT_EQ(SignedMessage::SERVICE_CERTIFICATE_REQUEST, signed_message.type());
+
+  EXPECT_TRUE(Properties::RemoveSessionPropertySet(session_id));
+}
+
+TEST_F(LicenseTest, ClientIdMatchesProtobufSerialization) {
+  CdmAppParameterMap app_parameters;
+  for (int i = 0; i < 2; ++i) {
+    // The second request reuses the cached device client info
+    LicenseRequest license_request;
+    PrepareLicenseRequest(false, app_parameters, &license_request);
+    EXPECT_TRUE(license_request.has_client_id());
+    EXPECT_FALSE(license_request.has_encrypted_client_id());
+    EXPECT_EQ(ExpectedClientId(app_parameters),
+              license_request.client_id().SerializeAsString());
+  }
+
+  app_parameters["key1"] = "value1";
+  app_parameters["key2"] = "value2";
+  LicenseRequest license_request;
+  PrepareLicenseRequest(false, app_parameters, &license_request);
+  EXPECT_EQ(ExpectedClientId(app_parameters),
+            license_request.client_id().SerializeAsString());
+}
+
+TEST_F(LicenseTest, PrivacyModeClientIdMatchesProtobufSerialization) {
+  CdmAppParameterMap app_parameters;
+  LicenseRequest license_request;
+  PrepareLicenseRequest(true, app_parameters, &license_request);
+  EXPECT_FALSE(license_request.has_client_id());
+  EXPECT_EQ(kServiceId, license_request.encrypted_client_id().service_id());
+  std::string client_id;
+  EXPECT_TRUE(DecryptClientId(license_request, &client_id));
+  EXPECT_EQ(ExpectedClientId(app_parameters), client_id);
+
+  app_parameters["key1"] = "value1";
+  app_parameters["key2"] = "value2";
+  license_request.Clear();
+  PrepareLicenseRequest(true, app_parameters, &license_request);
+  EXPECT_TRUE(DecryptClientId(license_request, &client_id));
+  EXPECT_EQ(ExpectedClientId(app_parameters), client_id);
+}
+
+TEST_F(LicenseTest, PrepareKeyRequestWithMultiplePssh) {
+  TestPropertySet property_set(false, "");
+  CdmSessionId session_id("ksid0");
+  EXPECT_TRUE(Properties::AddSessionPropertySet(session_id, &property_set));
+
+  CdmInitDataList init_data;
+  init_data.push_back(a2bs_hex(kInitData));
+  init_data.push_back(a2bs_hex("08011210AB6531FF6E6EA15E387B019E59C2DE0A"));
+  std::string signed_request;
+  CdmAppParameterMap app_parameters;
+  std::string server_url;
+  EXPECT_TRUE(license_.PrepareKeyRequest(init_data, kLicenseTypeOffline,
+                                         app_parameters, session_id,
+                                         &signed_request, &server_url));
+
+  SignedMessage signed_message;
+  EXPECT_TRUE(signed_message.ParseFromString(signed_request));
+  LicenseRequest license_request;
+  EXPECT_TRUE(license_request.ParseFromString(signed_message.msg()));
+  const LicenseRequest_ContentIdentification_CENC& cenc_id =
+      license_request.content_id().cenc_id();
+  EXPECT_EQ(video_widevine_server::sdk::OFFLINE, cenc_id.license_type());
+  ASSERT_EQ(2, cenc_id.pssh_size());
+  EXPECT_EQ(init_data[0], cenc_id.pssh(0));
+  EXPECT_EQ(init_data[1], cenc_id.pssh(1));
+
+  EXPECT_TRUE(Properties::RemoveSessionPropertySet(session_id));
+}
+
+TEST_F(LicenseTest, PrepareKeyRequestRejectsEmptyPssh) {
+  TestPropertySet property_set(false, "");
+  CdmSessionId session_id("ksid0");
+  EXPECT_TRUE(Properties::AddSessionPropertySet(session_id, &property_set));
+
+  CdmInitDataList init_data;
+  init_data.push_back(a2bs_hex(kInitData));
+  init_data.push_back("");
+  std::string signed_request;
+  CdmAppParameterMap app_parameters;
+  std::string server_url;
+  EXPECT_FALSE(license_.PrepareKeyRequest(init_data, kLicenseTypeStreaming,
+                                          app_parameters, session_id,
+                                          &signed_request, &server_url));
+
+  init_data.clear();
+  EXPECT_FALSE(license_.PrepareKeyRequest(init_data, kLicenseTypeStreaming,
+                                          app_parameters, session_id,
+                                          &signed_request, &server_url));
+
+  EXPECT_TRUE(Properties::RemoveSessionPropertySet(session_id));
+}
+
+TEST_F(LicenseTest, HandleKeyResponseRecyclesMessages) {
+  const int kNumKeys = 4;
+  CdmAppParameterMap app_parameters;
+  LicenseRequest license_request;
+  PrepareLicenseRequest(false, app_parameters, &license_request);
+  std::string response = CreateLicenseResponse(kNumKeys);
+
+  EXPECT_EQ(KEY_ADDED, license_.HandleKeyResponse(response));
+  for (int i = 0; i < kNumKeys; ++i)
+    EXPECT_TRUE(license_.IsKeyLoaded(std::string(16, 'a' + i)));
+  // The signed message and license are returned to the caches
+  size_t cached_messages = CdmLicense::GetCachedMessageCount();
+  EXPECT_LE(2u, cached_messages);
+
+  // and taken from them again by the next response
+  EXPECT_EQ(KEY_ADDED, license_.HandleKeyResponse(response));
+  EXPECT_EQ(cached_messages, CdmLicense::GetCachedMessageCount());
+}
+
+TEST_F(LicenseTest, ReleasedLicenseKeepsCachedMessages) {
+  TestPropertySet property_set(false, "");
+  CdmSessionId session_id("ksid0");
+  EXPECT_TRUE(Properties::AddSessionPropertySet(session_id, &property_set));
+
+  CdmLicense* license = new CdmLicense();
+  EXPECT_TRUE(license->Init(token_, session_, &policy_engine_));
+  std::string signed_request;
+  CdmAppParameterMap app_parameters;
+  std::string server_url;
+  EXPECT_TRUE(license->PrepareKeyRequest(a2bs_hex(kInitData),
+                                         kLicenseTypeStreaming,
+                                         app_parameters,
+                                         session_id,
+                                         &signed_request,
+                                         &server_url));
+  EXPECT_EQ(KEY_ADDED, license->HandleKeyResponse(CreateLicenseResponse(1)));
+  size_t cached_messages = CdmLicense::GetCachedMessageCount();
+  EXPECT_LE(2u, cached_messages);
+
+  // The wiped messages stay cached for the next session
+  delete license;
+  EXPECT_EQ(cached_messages, CdmLicense::GetCachedMessageCount());
+
+  EXPECT_TRUE(Properties::RemoveSessionPropertySet(session_id));
+}
+
 // TODO(kqyang): add unit test cases for PrepareKeyRenewalRequest
 // and HandleRenewalKeyResponse
 
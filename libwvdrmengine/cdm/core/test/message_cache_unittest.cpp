@@ -0,0 +1,154 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+
+#include "message_cache.h"
+
+#include <stdlib.h>
+
+#include <new>
+
+#include "gtest/gtest.h"
+#include "license_protocol.pb.h"
+
+namespace {
+const int kNumKeys = 8;
+const size_t kMaxCachedMessages = 2;
+
+// Counts heap allocations made while |counting| is set
+bool counting = false;
+size_t allocation_count = 0;
+
+void WipeKeys(video_widevine_server::sdk::License* license) {
+  for (int i = 0; i < license->key_size(); ++i)
+    wvcdm::WipeString(license->mutable_key(i)->mutable_key());
+}
+}  // namespace
+
+void* operator new(size_t size) {
+  if (counting) ++allocation_count;
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == NULL) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) throw() { free(ptr); }
+
+namespace wvcdm {
+
+using video_widevine_server::sdk::License;
+using video_widevine_server::sdk::License_KeyContainer;
+using video_widevine_server::sdk::SignedMessage;
+
+class MessageCacheTest : public ::testing::Test {
+ protected:
+  MessageCacheTest()
+      : signed_message_cache_(kMaxCachedMessages, NULL),
+        license_cache_(kMaxCachedMessages, WipeKeys) {}
+
+  // Builds a signed license response shaped like those handled by AddKey
+  std::string BuildLicenseResponse() {
+    License license;
+    license.mutable_id()->set_request_id("request_id");
+    license.mutable_id()->set_session_id("session_id");
+    license.mutable_policy()->set_can_play(true);
+    license.mutable_policy()->set_can_renew(true);
+    license.mutable_policy()->set_renewal_server_url(
+        "http://example.com/renewal");
+    for (int i = 0; i < kNumKeys; ++i) {
+      License_KeyContainer* key = license.add_key();
+      key->set_id(std::string(16, 'a' + i));
+      key->set_iv(std::string(16, 'i'));
+      key->set_key(std::string(32, 'k'));
+      key->set_type(License_KeyContainer::CONTENT);
+      key->mutable_key_control()->set_key_control_block(std::string(16, 'c'));
+      key->mutable_key_control()->set_iv(std::string(16, 'v'));
+    }
+
+    SignedMessage signed_message;
+    signed_message.set_type(SignedMessage::LICENSE);
+    signed_message.set_msg(license.SerializeAsString());
+    signed_message.set_signature(std::string(32, 's'));
+    signed_message.set_session_key(std::string(256, 'e'));
+    return signed_message.SerializeAsString();
+  }
+
+  // Parses |response| the way CdmLicense::HandleKeyResponse does
+  bool ParseLicenseResponse(const std::string& response) {
+    CachedMessage<SignedMessage> signed_response(&signed_message_cache_);
+    if (!signed_response->ParseFromString(response)) return false;
+    CachedMessage<License> license(&license_cache_);
+    if (!license->ParseFromString(signed_response->msg())) return false;
+    return license->key_size() == kNumKeys;
+  }
+
+  MessageCache<SignedMessage> signed_message_cache_;
+  MessageCache<License> license_cache_;
+};
+
+TEST_F(MessageCacheTest, RecyclesReleasedMessages) {
+  License* license = license_cache_.Acquire();
+  license->add_key()->set_id("key_id");
+  license_cache_.Release(license);
+  EXPECT_EQ(1u, license_cache_.Size());
+
+  License* recycled = license_cache_.Acquire();
+  EXPECT_EQ(license, recycled);
+  EXPECT_EQ(0, recycled->key_size());
+  EXPECT_EQ(0u, license_cache_.Size());
+  license_cache_.Release(recycled);
+}
+
+TEST_F(MessageCacheTest, BoundsCachedMessages) {
+  License* licenses[kMaxCachedMessages + 1];
+  for (size_t i = 0; i <= kMaxCachedMessages; ++i)
+    licenses[i] = license_cache_.Acquire();
+  for (size_t i = 0; i <= kMaxCachedMessages; ++i)
+    license_cache_.Release(licenses[i]);
+  EXPECT_EQ(kMaxCachedMessages, license_cache_.Size());
+}
+
+TEST_F(MessageCacheTest, WipesReleasedMessages) {
+  const std::string kKey(32, 'k');
+  License* license = license_cache_.Acquire();
+  license->add_key()->set_key(kKey);
+  const char* key_buffer = license->key(0).key().data();
+  license_cache_.Release(license);
+
+  // The recycled key container keeps its buffer, overwritten
+  License* recycled = license_cache_.Acquire();
+  ASSERT_EQ(license, recycled);
+  EXPECT_EQ(0, recycled->key_size());
+  EXPECT_EQ(key_buffer, recycled->add_key()->mutable_key()->data());
+  EXPECT_EQ(std::string(kKey.size(), '\0'),
+            std::string(key_buffer, kKey.size()));
+  license_cache_.Release(recycled);
+}
+
+TEST_F(MessageCacheTest, LicenseResponseParseDoesNotAllocateOnceWarm) {
+  std::string response = BuildLicenseResponse();
+  ASSERT_TRUE(ParseLicenseResponse(response));
+
+  allocation_count = 0;
+  counting = true;
+  bool parsed = ParseLicenseResponse(response);
+  counting = false;
+
+  EXPECT_TRUE(parsed);
+  EXPECT_EQ(0u, allocation_count);
+}
+
+TEST_F(MessageCacheTest, UncachedLicenseResponseParseAllocatesPerKey) {
+  std::string response = BuildLicenseResponse();
+
+  allocation_count = 0;
+  counting = true;
+  SignedMessage signed_response;
+  bool parsed = signed_response.ParseFromString(response);
+  License license;
+  parsed = parsed && license.ParseFromString(signed_response.msg());
+  counting = false;
+
+  EXPECT_TRUE(parsed);
+  EXPECT_LT(static_cast<size_t>(kNumKeys), allocation_count);
+}
+
+}  // namespace wvcdm
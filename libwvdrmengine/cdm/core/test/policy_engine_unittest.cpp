@@ -1,8 +1,10 @@
 // Copyright 2012 Google Inc. All Rights Reserved.
 
+#include <string.h>
 #include <sstream>
 
 #include "clock.h"
+#include "crypto_session.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "license.h"
@@ -18,16 +20,47 @@ using video_widevine_server::sdk::LicenseIdentification;
 using video_widevine_server::sdk::STREAMING;
 using video_widevine_server::sdk::OFFLINE;
 
+namespace {
+const int64_t kMonotonicTime = 3600;
+}  // namespace
+
 // gmock methods
 using ::testing::Return;
 using ::testing::AtLeast;
+using ::testing::DoAll;
+using ::testing::NotNull;
+
 
+ACTION_P(SetRandomData, value) { memcpy(arg1, &value, sizeof(value)); }
+
+class MockCryptoSession : public CryptoSession {
+ public:
+  MOCK_METHOD2(GetRandom, bool(size_t, uint8_t*));
+};
 
+// The wall clock is mocked through GetWallTime. Unless a test sets its own
+// expectations, the monotonic clock advances with it from kMonotonicTime.
 class MockClock : public Clock {
  public:
-  MOCK_METHOD0(GetCurrentTime, int64_t());
+  MockClock() : wall_time_(0) {}
+
+  virtual int64_t GetCurrentTime() {
+    wall_time_ = GetWallTime();
+    return wall_time_;
+  }
+  MOCK_METHOD0(GetWallTime, int64_t());
+  MOCK_METHOD0(GetMonotonicTime, int64_t());
+
+  int64_t wall_time() { return wall_time_; }
+
+ private:
+  int64_t wall_time_;
 };
 
+ACTION_P2(FollowWallTime, clock, wall_time_origin) {
+  return kMonotonicTime + clock->wall_time() - wall_time_origin;
+}
+
 class PolicyEngineTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
@@ -35,6 +68,8 @@ class PolicyEngineTest : public ::testing::Test {
     policy_engine_ = new PolicyEngine(mock_clock_);
 
     license_start_time_ = 1413517500;             // ~ 01/01/2013
+    EXPECT_CALL(*mock_clock_, GetMonotonicTime())
+        .WillRepeatedly(FollowWallTime(mock_clock_, license_start_time_));
     license_renewal_delay_ = 604200;              // 7 days - 10 minutes
     license_renewal_retry_interval_ = 30;
     license_duration_ = 604800;                   // 7 days
@@ -88,7 +123,7 @@ TEST_F(PolicyEngineTest, NoLicense) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackSuccess) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 10));
@@ -105,7 +140,7 @@ TEST_F(PolicyEngineTest, PlaybackSuccess) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackFailed_CanPlayFalse) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 5));
 
   License_Policy* policy = license_.mutable_policy();
@@ -125,7 +160,7 @@ TEST_F(PolicyEngineTest, PlaybackFailed_CanPlayFalse) {
 // TODO(edwinwong, rfrias): persist license verification test needed
 
 TEST_F(PolicyEngineTest, PlaybackFails_RentalDurationExpired) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 3600))
@@ -155,7 +190,7 @@ TEST_F(PolicyEngineTest, PlaybackFails_RentalDurationExpired) {
 //     is enabled
 
 TEST_F(PolicyEngineTest, PlaybackFails_PlaybackDurationExpired) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 10000))
       .WillOnce(Return(license_start_time_ + 13598))
@@ -182,7 +217,7 @@ TEST_F(PolicyEngineTest, PlaybackFails_PlaybackDurationExpired) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackFails_LicenseDurationExpired) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 3600))
@@ -209,7 +244,7 @@ TEST_F(PolicyEngineTest, PlaybackFails_LicenseDurationExpired) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_RentalDuration0) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 3600))
@@ -237,7 +272,7 @@ TEST_F(PolicyEngineTest, PlaybackOk_RentalDuration0) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_PlaybackDuration0) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 10000))
       .WillOnce(Return(license_start_time_ + 10005))
       .WillOnce(Return(license_start_time_ + 13598))
@@ -265,7 +300,7 @@ TEST_F(PolicyEngineTest, PlaybackOk_PlaybackDuration0) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_LicenseDuration0) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 3600))
@@ -293,7 +328,7 @@ TEST_F(PolicyEngineTest, PlaybackOk_LicenseDuration0) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_Durations0) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 604800))
@@ -325,7 +360,7 @@ TEST_F(PolicyEngineTest, PlaybackOk_Durations0) {
 // TODO(edwinwong, rfrias): renewal url test needed
 
 TEST_F(PolicyEngineTest, PlaybackFailed_CanRenewFalse) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + license_duration_ -
           playback_duration_ + 1))
@@ -357,7 +392,7 @@ TEST_F(PolicyEngineTest, PlaybackFailed_CanRenewFalse) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_RenewSuccess) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + license_duration_ -
           playback_duration_ + 1))
@@ -395,8 +430,65 @@ TEST_F(PolicyEngineTest, PlaybackOk_RenewSuccess) {
   EXPECT_TRUE(policy_engine_->can_decrypt());
 }
 
+TEST_F(PolicyEngineTest, PlaybackOk_RenewalJitter) {
+  const int64_t jitter = 100;
+  // Reduced modulo jitter + 1 to a 42 second delay
+  const uint32_t random_data = 3 * (jitter + 1) + 42;
+  MockCryptoSession crypto_session;
+  EXPECT_CALL(crypto_session, GetRandom(sizeof(uint32_t), NotNull()))
+      .WillOnce(DoAll(SetRandomData(random_data), Return(true)));
+  EXPECT_CALL(*mock_clock_, GetWallTime())
+      .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + license_duration_ -
+          playback_duration_ + 1))
+      .WillOnce(Return(license_start_time_ + 1 + license_renewal_delay_ + 41))
+      .WillOnce(Return(license_start_time_ + 1 + license_renewal_delay_ + 42));
+
+  policy_engine_->SetRenewalJitter(jitter, &crypto_session);
+  policy_engine_->SetLicense(license_);
+
+  policy_engine_->BeginDecryption();
+  EXPECT_TRUE(policy_engine_->can_decrypt());
+
+  bool event_occurred;
+  CdmEventType event;
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_FALSE(event_occurred);
+
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_TRUE(event_occurred);
+  EXPECT_EQ(LICENSE_RENEWAL_NEEDED_EVENT, event);
+}
+
+TEST_F(PolicyEngineTest, PlaybackOk_RenewalJitterRandomDataUnavailable) {
+  MockCryptoSession crypto_session;
+  EXPECT_CALL(crypto_session, GetRandom(sizeof(uint32_t), NotNull()))
+      .WillOnce(Return(false));
+  EXPECT_CALL(*mock_clock_, GetWallTime())
+      .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + license_duration_ -
+          playback_duration_ + 1))
+      .WillOnce(Return(license_start_time_ + license_renewal_delay_))
+      .WillOnce(Return(license_start_time_ + 1 + license_renewal_delay_));
+
+  policy_engine_->SetRenewalJitter(100, &crypto_session);
+  policy_engine_->SetLicense(license_);
+
+  policy_engine_->BeginDecryption();
+  EXPECT_TRUE(policy_engine_->can_decrypt());
+
+  bool event_occurred;
+  CdmEventType event;
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_FALSE(event_occurred);
+
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_TRUE(event_occurred);
+  EXPECT_EQ(LICENSE_RENEWAL_NEEDED_EVENT, event);
+}
+
 TEST_F(PolicyEngineTest, PlaybackFailed_RenewFailedVersionNotUpdated) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + license_duration_ -
           playback_duration_ + 1))
@@ -439,7 +531,7 @@ TEST_F(PolicyEngineTest, PlaybackFailed_RenewFailedVersionNotUpdated) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackFailed_RepeatedRenewFailures) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + license_duration_ -
           playback_duration_ + 1))
@@ -497,7 +589,7 @@ TEST_F(PolicyEngineTest, PlaybackFailed_RepeatedRenewFailures) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_RenewSuccessAfterExpiry) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + license_duration_ -
           playback_duration_ + 1))
@@ -573,7 +665,7 @@ TEST_F(PolicyEngineTest, PlaybackOk_RenewSuccessAfterExpiry) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_RenewSuccessAfterFailures) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + license_duration_ -
           playback_duration_ + 1))
@@ -632,7 +724,7 @@ TEST_F(PolicyEngineTest, PlaybackOk_RenewSuccessAfterFailures) {
 }
 
 TEST_F(PolicyEngineTest, PlaybackOk_RenewedWithUsage) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 10))
@@ -669,8 +761,128 @@ TEST_F(PolicyEngineTest, PlaybackOk_RenewedWithUsage) {
   EXPECT_TRUE(policy_engine_->can_decrypt());
 }
 
+TEST_F(PolicyEngineTest, DecryptionDeadline) {
+  EXPECT_CALL(*mock_clock_, GetWallTime())
+      .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + 5));
+  EXPECT_CALL(*mock_clock_, GetMonotonicTime())
+      .WillOnce(Return(kMonotonicTime))
+      .WillOnce(Return(kMonotonicTime + license_duration_ - 1))
+      .WillOnce(Return(kMonotonicTime + 4))
+      .WillOnce(Return(kMonotonicTime + 4 + playback_duration_ - 1))
+      .WillOnce(Return(kMonotonicTime + 4 + playback_duration_));
+
+  EXPECT_FALSE(policy_engine_->IsDecryptionDeadlinePassed());
+
+  // Limited by the license duration until playback begins
+  policy_engine_->SetLicense(license_);
+  EXPECT_FALSE(policy_engine_->IsDecryptionDeadlinePassed());
+
+  policy_engine_->BeginDecryption();
+  EXPECT_FALSE(policy_engine_->IsDecryptionDeadlinePassed());
+  EXPECT_TRUE(policy_engine_->IsDecryptionDeadlinePassed());
+}
+
+TEST_F(PolicyEngineTest, ExpiryIgnoresWallClockChanges) {
+  EXPECT_CALL(*mock_clock_, GetWallTime())
+      .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + 5))
+      .WillOnce(Return(license_start_time_ + 100000))
+      .WillOnce(Return(license_start_time_ + 10));
+  EXPECT_CALL(*mock_clock_, GetMonotonicTime())
+      .WillOnce(Return(kMonotonicTime))
+      .WillOnce(Return(kMonotonicTime + 4))
+      .WillOnce(Return(kMonotonicTime + 100))
+      .WillOnce(Return(kMonotonicTime + 4 + 3600));
+
+  License_Policy* policy = license_.mutable_policy();
+  policy->set_playback_duration_seconds(3600);
+
+  policy_engine_->SetLicense(license_);
+  policy_engine_->BeginDecryption();
+  EXPECT_TRUE(policy_engine_->can_decrypt());
+
+  // The wall clock jumps past the playback duration
+  bool event_occurred;
+  CdmEventType event;
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_FALSE(event_occurred);
+  EXPECT_TRUE(policy_engine_->can_decrypt());
+
+  // and back, while the playback duration runs out
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_TRUE(event_occurred);
+  EXPECT_EQ(LICENSE_EXPIRED_EVENT, event);
+  EXPECT_FALSE(policy_engine_->can_decrypt());
+}
+
+TEST_F(PolicyEngineTest, DecryptionDeadlineUnlimited) {
+  License_Policy* policy = license_.mutable_policy();
+  policy->clear_rental_duration_seconds();
+  policy->clear_license_duration_seconds();
+  policy->clear_playback_duration_seconds();
+
+  EXPECT_CALL(*mock_clock_, GetWallTime())
+      .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + 5));
+
+  policy_engine_->SetLicense(license_);
+  policy_engine_->BeginDecryption();
+  EXPECT_FALSE(policy_engine_->IsDecryptionDeadlinePassed());
+}
+
+TEST_F(PolicyEngineTest, KeyStatusEvents) {
+  int64_t playback_expiry = license_start_time_ + 5 + playback_duration_;
+  EXPECT_CALL(*mock_clock_, GetWallTime())
+      .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + 5))
+      .WillOnce(Return(playback_expiry - 700))
+      .WillOnce(Return(playback_expiry - 500))
+      .WillOnce(Return(playback_expiry - 400))
+      .WillOnce(Return(playback_expiry - 30))
+      .WillOnce(Return(playback_expiry));
+
+  policy_engine_->SetLicense(license_);
+  EXPECT_FALSE(policy_engine_->has_key_status_events());
+
+  policy_engine_->BeginDecryption();
+  std::vector<CdmKeyStatusEvent> events;
+  policy_engine_->GetKeyStatusEvents(&events);
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ(kKeyStatusUsable, events[0].type);
+  EXPECT_EQ(playback_expiry, events[0].status.playback_expiry_time);
+  EXPECT_EQ(playback_duration_, events[0].status.playback_duration_remaining);
+
+  bool event_occurred;
+  CdmEventType event;
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_FALSE(policy_engine_->has_key_status_events());
+
+  // Each warning threshold is reported once
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  events.clear();
+  policy_engine_->GetKeyStatusEvents(&events);
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ(kKeyStatusExpiring, events[0].type);
+  EXPECT_EQ(600, events[0].threshold_seconds);
+  EXPECT_EQ(500, events[0].status.playback_duration_remaining);
+
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  policy_engine_->OnTimerEvent(event_occurred, event);
+  EXPECT_TRUE(event_occurred);
+  EXPECT_EQ(LICENSE_EXPIRED_EVENT, event);
+  events.clear();
+  policy_engine_->GetKeyStatusEvents(&events);
+  ASSERT_EQ(2u, events.size());
+  EXPECT_EQ(kKeyStatusExpiring, events[0].type);
+  EXPECT_EQ(60, events[0].threshold_seconds);
+  EXPECT_EQ(kKeyStatusExpired, events[1].type);
+  EXPECT_EQ(0, events[1].status.playback_duration_remaining);
+}
+
 TEST_F(PolicyEngineTest, QueryFailed_LicenseNotReceived) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_));
 
   CdmQueryMap query_info;
@@ -678,13 +890,15 @@ TEST_F(PolicyEngineTest, QueryFailed_LicenseNotReceived) {
 }
 
 TEST_F(PolicyEngineTest, QuerySuccess) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 100));
 
   License_Policy* policy = license_.mutable_policy();
 
   policy_engine_->SetLicense(license_);
+  policy_engine_->BeginDecryption();
 
   CdmQueryMap query_info;
   EXPECT_EQ(NO_ERROR, policy_engine_->Query(&query_info));
@@ -693,21 +907,53 @@ TEST_F(PolicyEngineTest, QuerySuccess) {
   EXPECT_EQ(QUERY_VALUE_TRUE, query_info[QUERY_KEY_PERSIST_ALLOWED]);
   EXPECT_EQ(QUERY_VALUE_TRUE, query_info[QUERY_KEY_RENEW_ALLOWED]);
 
-  int64_t remaining_time;
-  std::istringstream ss;
-  ss.str(query_info[QUERY_KEY_LICENSE_DURATION_REMAINING]);
-  ss >> remaining_time;
-  EXPECT_LT(0, remaining_time);
-  ss.str(query_info[QUERY_KEY_PLAYBACK_DURATION_REMAINING]);
-  ss >> remaining_time;
-  EXPECT_LT(0, remaining_time);
+  std::ostringstream license_remaining;
+  license_remaining << license_duration_ - 99;
+  EXPECT_EQ(license_remaining.str(),
+            query_info[QUERY_KEY_LICENSE_DURATION_REMAINING]);
+  std::ostringstream playback_remaining;
+  playback_remaining << playback_duration_ - 95;
+  EXPECT_EQ(playback_remaining.str(),
+            query_info[QUERY_KEY_PLAYBACK_DURATION_REMAINING]);
 
   EXPECT_EQ(query_info[QUERY_KEY_RENEWAL_SERVER_URL],
       policy->renewal_server_url());
 }
 
+TEST_F(PolicyEngineTest, QueryKeyStatusSuccess) {
+  EXPECT_CALL(*mock_clock_, GetWallTime())
+      .WillOnce(Return(license_start_time_ + 1))
+      .WillOnce(Return(license_start_time_ + 5))
+      .WillOnce(Return(license_start_time_ + 100))
+      .WillOnce(Return(license_start_time_ + playback_duration_ + 10));
+
+  policy_engine_->SetLicense(license_);
+  policy_engine_->BeginDecryption();
+
+  CdmKeyStatus key_status;
+  EXPECT_EQ(NO_ERROR, policy_engine_->Query(&key_status));
+  EXPECT_EQ(kLicenseTypeStreaming, key_status.license_type);
+  EXPECT_TRUE(key_status.play_allowed);
+  EXPECT_TRUE(key_status.persist_allowed);
+  EXPECT_TRUE(key_status.renew_allowed);
+  EXPECT_EQ(license_start_time_ + 1 + license_duration_,
+            key_status.license_expiry_time);
+  EXPECT_EQ(license_start_time_ + 5 + playback_duration_,
+            key_status.playback_expiry_time);
+  EXPECT_EQ(license_duration_ - 99, key_status.license_duration_remaining);
+  EXPECT_EQ(playback_duration_ - 95, key_status.playback_duration_remaining);
+  EXPECT_EQ(license_.policy().renewal_server_url(),
+            key_status.renewal_server_url);
+
+  // Remaining durations stop at zero once expired
+  EXPECT_EQ(NO_ERROR, policy_engine_->Query(&key_status));
+  EXPECT_EQ(license_duration_ - playback_duration_ - 9,
+            key_status.license_duration_remaining);
+  EXPECT_EQ(0, key_status.playback_duration_remaining);
+}
+
 TEST_F(PolicyEngineTest, QuerySuccess_Offline) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 100));
 
@@ -750,7 +996,7 @@ TEST_F(PolicyEngineTest, QuerySuccess_Offline) {
 }
 
 TEST_F(PolicyEngineTest, QuerySuccess_DurationExpired) {
-  EXPECT_CALL(*mock_clock_, GetCurrentTime())
+  EXPECT_CALL(*mock_clock_, GetWallTime())
       .WillOnce(Return(license_start_time_ + 1))
       .WillOnce(Return(license_start_time_ + 5))
       .WillOnce(Return(license_start_time_ + 10))
@@ -0,0 +1,137 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+
+#include "service_certificate_cache.h"
+
+#include "gtest/gtest.h"
+#include "license_protocol.pb.h"
+#include "privacy_crypto.h"
+#include "string_conversions.h"
+
+namespace {
+// DER encoded PKCS#1 RSAPublicKey, 2048 bit modulus
+const std::string kServicePublicKey = wvcdm::a2bs_hex(
+    "3082010a02820101008b02013aa004ff02c80fcac9bec9e627874d9c33649fcb"
+    "771f4510b29bdb70641f2c085996bcc48e978fae48b5368e035b31f3038c11f7"
+    "f774933fd8d9d5f9b9fa1fa751b35df6cf15f39c08d4d4ef2464e81f0690add8"
+    "4c407f024a0209e1e9289c5f8edc8cb81ad04e93a97b6fb6a20430769abb4ca6"
+    "f0815f8c6bb9746f62ad15939c50ff3d64e5323629bcb89f3f6e955959d42bcc"
+    "b89e30d77153486ec682249cd057f1db3bbcf39ddbb0bb907b052b41d17824fb"
+    "28fe4a03e69aad629a2ee5a395f7c89b69054d6680073e33cf91134db8f0a401"
+    "51b2e232b2bba302a4810988618fba0618b3a65b6a51bc16187dc9e123095907"
+    "796013b095832ef7cf0203010001");
+const std::string kServiceId = "license.widevine.com";
+const size_t kRsaKeySize = 256;
+}  // namespace
+
+namespace wvcdm {
+
+using video_widevine_server::sdk::DeviceCertificate;
+
+class ServiceCertificateCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() { ServiceCertificateCache::Clear(); }
+  virtual void TearDown() { ServiceCertificateCache::Clear(); }
+
+  std::string CreateCertificate(const std::string& serial_number,
+                                DeviceCertificate::CertificateType type) {
+    DeviceCertificate certificate;
+    certificate.set_type(type);
+    certificate.set_serial_number(serial_number);
+    certificate.set_public_key(kServicePublicKey);
+    certificate.set_service_id(kServiceId);
+    std::string serialized;
+    certificate.SerializeToString(&serialized);
+    return serialized;
+  }
+
+  std::string CreateServiceCertificate(const std::string& serial_number) {
+    return CreateCertificate(serial_number, DeviceCertificate::SERVICE);
+  }
+};
+
+TEST_F(ServiceCertificateCacheTest, GetParsesOnce) {
+  std::string certificate = CreateServiceCertificate("serial0");
+
+  for (int i = 0; i < 2; ++i) {
+    std::string service_id;
+    std::string serial_number;
+    RsaPublicKey key;
+    EXPECT_TRUE(ServiceCertificateCache::Get(certificate, &service_id,
+                                             &serial_number, &key));
+    EXPECT_EQ(kServiceId, service_id);
+    EXPECT_EQ("serial0", serial_number);
+
+    std::string encrypted;
+    EXPECT_TRUE(key.Encrypt("0123456789abcdef", &encrypted));
+    EXPECT_EQ(kRsaKeySize, encrypted.size());
+  }
+  EXPECT_EQ(1u, ServiceCertificateCache::Size());
+}
+
+TEST_F(ServiceCertificateCacheTest, RejectsNonServiceCertificate) {
+  std::string certificate =
+      CreateCertificate("serial0", DeviceCertificate::USER_DEVICE);
+
+  std::string service_id;
+  std::string serial_number;
+  RsaPublicKey key;
+  EXPECT_FALSE(ServiceCertificateCache::Get(certificate, &service_id,
+                                            &serial_number, &key));
+  EXPECT_FALSE(ServiceCertificateCache::Add(certificate, true));
+  EXPECT_EQ(0u, ServiceCertificateCache::Size());
+}
+
+TEST_F(ServiceCertificateCacheTest, VerifiedCertificate) {
+  std::string certificate = CreateServiceCertificate("serial0");
+
+  EXPECT_FALSE(ServiceCertificateCache::IsVerified(certificate));
+  EXPECT_TRUE(ServiceCertificateCache::Add(certificate, false));
+  EXPECT_FALSE(ServiceCertificateCache::IsVerified(certificate));
+
+  EXPECT_TRUE(ServiceCertificateCache::Add(certificate, true));
+  EXPECT_TRUE(ServiceCertificateCache::IsVerified(certificate));
+  EXPECT_FALSE(ServiceCertificateCache::IsVerified(
+      CreateServiceCertificate("serial1")));
+}
+
+TEST_F(ServiceCertificateCacheTest, EvictionKeepsKeysUsable) {
+  std::string verified = CreateServiceCertificate("verified");
+  EXPECT_TRUE(ServiceCertificateCache::Add(verified, true));
+
+  std::string service_id;
+  std::string serial_number;
+  RsaPublicKey key;
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_TRUE(ServiceCertificateCache::Get(
+        CreateServiceCertificate(IntToString(i)), &service_id,
+        &serial_number, &key));
+  }
+  EXPECT_GT(16u, ServiceCertificateCache::Size());
+  EXPECT_FALSE(ServiceCertificateCache::IsVerified(verified));
+
+  // Keys remain usable after their cache entry is evicted
+  std::string encrypted;
+  EXPECT_TRUE(key.Encrypt("0123456789abcdef", &encrypted));
+}
+
+TEST_F(ServiceCertificateCacheTest, EvictsLeastRecentlyUsed) {
+  std::string verified = CreateServiceCertificate("verified");
+  EXPECT_TRUE(ServiceCertificateCache::Add(verified, true));
+  std::vector<uint8_t> verified_bytes(verified.begin(), verified.end());
+
+  std::string service_id;
+  std::string serial_number;
+  RsaPublicKey key;
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_TRUE(ServiceCertificateCache::Get(
+        CreateServiceCertificate(IntToString(i)), &service_id,
+        &serial_number, &key));
+    // Oldest entry, but in use
+    EXPECT_TRUE(ServiceCertificateCache::Get(verified_bytes, &service_id,
+                                             &serial_number, &key));
+    EXPECT_EQ("verified", serial_number);
+  }
+  EXPECT_TRUE(ServiceCertificateCache::IsVerified(verified));
+}
+
+}  // namespace wvcdm
@@ -1,5 +1,7 @@
 // Copyright 2013 Google Inc. All Rights Reserved.
 
+#include <time.h>
+
 #include "gtest/gtest.h"
 #include "timer.h"
 
@@ -21,6 +23,20 @@ class TestTimerHandler : public TimerHandler {
   uint32_t timer_events_;
 };
 
+// Stops its timer on the first event
+class StoppingTimerHandler : public TestTimerHandler {
+ public:
+  explicit StoppingTimerHandler(Timer* timer) : timer_(timer) {}
+
+  virtual void OnTimerEvent() {
+    TestTimerHandler::OnTimerEvent();
+    timer_->Stop();
+  }
+
+ private:
+  Timer* timer_;
+};
+
 TEST(TimerTest, ParametersCheck) {
   Timer timer;
   EXPECT_FALSE(timer.Start(NULL, 10));
@@ -51,4 +67,26 @@ TEST(TimerTest, TimerCheck) {
   EXPECT_LE(handler.timer_events(), duration+1);
 }
 
+TEST(TimerTest, StopFromHandler) {
+  Timer timer;
+  StoppingTimerHandler handler(&timer);
+
+  EXPECT_TRUE(timer.Start(&handler, 1));
+  sleep(3);
+  EXPECT_EQ(1u, handler.timer_events());
+  EXPECT_FALSE(timer.IsRunning());
+}
+
+TEST(TimerTest, StopDoesNotWaitForPeriod) {
+  TestTimerHandler handler;
+  Timer timer;
+
+  EXPECT_TRUE(timer.Start(&handler, 60));
+  time_t start = time(NULL);
+  timer.Stop();
+  EXPECT_GE(1, time(NULL) - start);
+  EXPECT_FALSE(timer.IsRunning());
+  EXPECT_EQ(0u, handler.timer_events());
+}
+
 }
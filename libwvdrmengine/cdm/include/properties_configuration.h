@@ -39,6 +39,19 @@ const bool kDecryptWithEmptySessionSupport = false;
 // Properties::GetDeviceFilesBasePath
 const bool kSecurityLevelPathBackwardCompatibilitySupport = true;
 
+// Upper bound of the random delay added to license renewal deadlines, so
+// devices that received licenses together do not renew together
+const uint32_t kPropertyRenewalJitterSeconds = 60;
+
+// Number of OEMCrypto sessions kept open ahead of time so that opening a
+// CDM session does not wait for OEMCrypto, 0 to open sessions on demand
+const uint32_t kPropertyCryptoSessionPoolSize = 2;
+
+// Seconds OEMCrypto stays initialized after the last crypto session is
+// closed, so that sessions opened in quick succession do not initialize it
+// again each time. 0 to terminate it as soon as it is unused.
+const uint32_t kPropertyOemCryptoIdleTerminationSeconds = 10;
+
 } // namespace wvcdm
 
 #endif  // CDM_BASE_WV_PROPERTIES_CONFIGURATION_H_
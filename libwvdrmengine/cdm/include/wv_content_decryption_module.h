@@ -34,6 +34,15 @@ class WvContentDecryptionModule {
                                              CdmKeyMessage* key_request,
                                              std::string* server_url);
 
+  // Construct a single license request for several pieces of content. The
+  // keys for all of them are loaded into |session_id| by AddKey.
+  virtual CdmResponseType GenerateKeyRequest(const CdmSessionId& session_id,
+                                             const CdmInitDataList& init_data,
+                                             const CdmLicenseType license_type,
+                                             CdmAppParameterMap& app_parameters,
+                                             CdmKeyMessage* key_request,
+                                             std::string* server_url);
+
   // Accept license response and extract key info.
   virtual CdmResponseType AddKey(const CdmSessionId& session_id,
                                  const CdmKeyResponse& key_data,
@@ -43,6 +52,18 @@ class WvContentDecryptionModule {
   virtual CdmResponseType RestoreKey(const CdmSessionId& session_id,
                                      const CdmKeySetId& key_set_id);
 
+  // Bulk offline license methods, see CdmEngine
+  virtual CdmResponseType RestoreKeys(CdmClientPropertySet* property_set,
+                                      const CdmKeySetIdList& key_set_ids,
+                                      CdmKeySetSessionMap* sessions,
+                                      CdmKeySetResponseMap* results);
+  virtual CdmResponseType QueryOfflineLicenseStates(
+      CdmClientPropertySet* property_set, const CdmKeySetIdList& key_set_ids,
+      CdmOfflineLicenseStateMap* states);
+  virtual CdmResponseType DeleteOfflineLicenses(
+      CdmClientPropertySet* property_set, const CdmKeySetIdList& key_set_ids,
+      CdmKeySetResponseMap* results);
+
   // Cancel session
   virtual CdmResponseType CancelKeyRequest(const CdmSessionId& session_id);
 
@@ -56,6 +77,8 @@ class WvContentDecryptionModule {
   // Query license information
   virtual CdmResponseType QueryKeyStatus(const CdmSessionId& session_id,
                                          CdmQueryMap* key_info);
+  virtual CdmResponseType QueryKeyStatus(const CdmSessionId& session_id,
+                                         CdmKeyStatus* key_status);
 
   // Query session control information
   virtual CdmResponseType QueryKeyControlInfo(const CdmSessionId& session_id,
@@ -88,6 +111,7 @@ class WvContentDecryptionModule {
                                    WvCdmEventListener* listener);
 
  private:
+  void SetUpSessionSharing(CdmClientPropertySet* property_set);
   uint32_t GenerateSessionSharingId();
 
   // instance variables
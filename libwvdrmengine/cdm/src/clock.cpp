@@ -5,6 +5,7 @@
 #include "clock.h"
 
 #include <sys/time.h>
+#include <time.h>
 
 namespace wvcdm {
 
@@ -15,5 +16,18 @@ int64_t Clock::GetCurrentTime() {
   return tv.tv_sec;
 }
 
+int64_t Clock::GetMonotonicTime() {
+  struct timespec ts;
+  ts.tv_sec = ts.tv_nsec = 0;
+#if defined(CLOCK_MONOTONIC_COARSE)
+  // Second resolution is all that is needed, the coarse clock avoids
+  // reading the hardware timer
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+    return ts.tv_sec;
+#endif
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
 
 };  // namespace wvcdm
@@ -0,0 +1,226 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// CryptoSessionPool class - Android specific implementation that refills
+// the pool on an android::Thread
+
+#include "crypto_session_pool.h"
+
+#include <vector>
+
+#include "clock.h"
+#include "crypto_session.h"
+#include "log.h"
+#include "utils/Condition.h"
+#include "utils/Mutex.h"
+#include "utils/RefBase.h"
+#include "utils/StrongPointer.h"
+#include "utils/Thread.h"
+
+namespace wvcdm {
+
+class CryptoSessionPool::Impl {
+ public:
+  explicit Impl(size_t max_sessions)
+      : max_sessions_(max_sessions),
+        refill_requested_(false),
+        release_pending_(false),
+        release_time_(0) {
+    sessions_.reserve(max_sessions);
+  }
+
+  ~Impl() {
+    android::sp<Worker> worker;
+    std::vector<CryptoSession*> sessions;
+    {
+      android::Mutex::Autolock auto_lock(lock_);
+      worker = worker_;
+      worker_.clear();
+      sessions.swap(sessions_);
+      if (worker != NULL) worker->requestExit();
+      condition_.broadcast();
+    }
+    if (worker != NULL) worker->requestExitAndWait();
+    for (size_t i = 0; i < sessions.size(); ++i) delete sessions[i];
+  }
+
+  CryptoSession* Acquire(SecurityLevel requested_security_level) {
+    android::Mutex::Autolock auto_lock(lock_);
+    release_pending_ = false;
+    if (requested_security_level != kLevelDefault || max_sessions_ == 0)
+      return NULL;
+
+    CryptoSession* session = NULL;
+    if (!sessions_.empty()) {
+      session = sessions_.back();
+      sessions_.pop_back();
+    }
+    if (StartWorker()) {
+      refill_requested_ = true;
+      condition_.broadcast();
+    }
+    return session;
+  }
+
+  void Clear() {
+    std::vector<CryptoSession*> sessions;
+    {
+      android::Mutex::Autolock auto_lock(lock_);
+      sessions.swap(sessions_);
+      refill_requested_ = false;
+      release_pending_ = false;
+    }
+    for (size_t i = 0; i < sessions.size(); ++i) delete sessions[i];
+  }
+
+  void ReleaseWhenIdle(uint32_t idle_seconds) {
+    if (idle_seconds == 0) {
+      Clear();
+      return;
+    }
+
+    android::Mutex::Autolock auto_lock(lock_);
+    // Without a refill thread the pool has never held a session
+    if (worker_ == NULL) return;
+    Clock clock;
+    release_pending_ = true;
+    release_time_ = clock.GetMonotonicTime() + idle_seconds;
+    condition_.broadcast();
+  }
+
+  size_t Size() {
+    android::Mutex::Autolock auto_lock(lock_);
+    return sessions_.size();
+  }
+
+ private:
+  class Worker : public android::Thread {
+   public:
+    explicit Worker(Impl* impl) : Thread(false), impl_(impl) {}
+    virtual ~Worker() {}
+
+   private:
+    virtual bool threadLoop() { return impl_->OpenNextSession(); }
+
+    Impl* impl_;
+
+    CORE_DISALLOW_COPY_AND_ASSIGN(Worker);
+  };
+
+  // Starts the refill thread if not running, caller must hold lock_
+  bool StartWorker() {
+    if (worker_ != NULL) return true;
+
+    android::sp<Worker> worker = new Worker(this);
+    if (worker->run("WVCdmSessionPool") != android::NO_ERROR) {
+      LOGW("CryptoSessionPool: unable to start refill thread");
+      return false;
+    }
+    worker_ = worker;
+    return true;
+  }
+
+  // Waits for a refill request and opens one session for the pool. Refilling
+  // stops when the pool is full or a session cannot be opened, typically
+  // because OEMCrypto has run out of sessions. Also closes the sessions held
+  // once a pending release is due. Returns false when the pool is shutting
+  // down.
+  bool OpenNextSession() {
+    std::vector<CryptoSession*> idle_sessions;
+    {
+      android::Mutex::Autolock auto_lock(lock_);
+      while (!refill_requested_ && worker_ != NULL) {
+        if (!release_pending_) {
+          condition_.wait(lock_);
+          continue;
+        }
+        Clock clock;
+        int64_t remaining_seconds = release_time_ - clock.GetMonotonicTime();
+        if (remaining_seconds <= 0) break;
+        condition_.waitRelative(lock_, remaining_seconds * 1000000000LL);
+      }
+      if (worker_ == NULL) return false;
+      if (!refill_requested_) {
+        LOGV("CryptoSessionPool: releasing idle sessions");
+        idle_sessions.swap(sessions_);
+        release_pending_ = false;
+      } else if (sessions_.size() >= max_sessions_) {
+        refill_requested_ = false;
+        return true;
+      }
+    }
+
+    if (!idle_sessions.empty()) {
+      for (size_t i = 0; i < idle_sessions.size(); ++i)
+        delete idle_sessions[i];
+      return true;
+    }
+
+    CryptoSession* session = new CryptoSession();
+    CdmResponseType sts = session->Open(kLevelDefault);
+
+    {
+      android::Mutex::Autolock auto_lock(lock_);
+      if (sts != NO_ERROR) {
+        LOGV("CryptoSessionPool: unable to open session: %d", sts);
+        refill_requested_ = false;
+      } else if (refill_requested_ && worker_ != NULL) {
+        sessions_.push_back(session);
+        return true;
+      }
+    }
+
+    // Not needed once the pool was cleared or is shutting down
+    delete session;
+    return true;
+  }
+
+  android::Mutex lock_;
+  android::Condition condition_;
+  size_t max_sessions_;
+  std::vector<CryptoSession*> sessions_;
+  bool refill_requested_;
+  // Release of the sessions held once no CDM session is open
+  bool release_pending_;
+  int64_t release_time_;
+  android::sp<Worker> worker_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(Impl);
+};
+
+CryptoSessionPool::CryptoSessionPool(size_t max_sessions)
+    : impl_(new CryptoSessionPool::Impl(max_sessions)) {
+}
+
+CryptoSessionPool::~CryptoSessionPool() {
+  delete impl_;
+  impl_ = NULL;
+}
+
+CryptoSession* CryptoSessionPool::Acquire(
+    SecurityLevel requested_security_level) {
+  return impl_->Acquire(requested_security_level);
+}
+
+CdmResponseType CryptoSessionPool::Open(
+    CryptoSession* session, SecurityLevel requested_security_level) {
+  CdmResponseType sts = session->Open(requested_security_level);
+  if (INSUFFICIENT_CRYPTO_RESOURCES == sts) {
+    Clear();
+    sts = session->Open(requested_security_level);
+  }
+  return sts;
+}
+
+void CryptoSessionPool::Clear() {
+  impl_->Clear();
+}
+
+void CryptoSessionPool::ReleaseWhenIdle(uint32_t idle_seconds) {
+  impl_->ReleaseWhenIdle(idle_seconds);
+}
+
+size_t CryptoSessionPool::Size() {
+  return impl_->Size();
+}
+
+}  // namespace wvcdm
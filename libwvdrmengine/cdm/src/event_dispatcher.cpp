@@ -0,0 +1,269 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// EventDispatcher class - Android specific implementation using a single
+// android::Thread
+
+#include "event_dispatcher.h"
+
+#include <pthread.h>
+
+#include <deque>
+#include <list>
+#include <map>
+
+#include "log.h"
+#include "utils/Condition.h"
+#include "utils/Mutex.h"
+#include "utils/RefBase.h"
+#include "utils/StrongPointer.h"
+#include "utils/Thread.h"
+#include "wv_cdm_event_listener.h"
+
+namespace wvcdm {
+
+namespace {
+// Key status snapshots queued for one listener beyond this are dropped so
+// that a stalled listener cannot grow the queue without limit. Other
+// events are kept, coalescing bounds them by the number of sessions.
+const size_t kMaxQueuedEventsPerListener = 16;
+}  // namespace
+
+class EventDispatcher::Impl {
+ public:
+  Impl() : delivering_listener_(NULL) {}
+
+  ~Impl() {
+    android::sp<Worker> worker;
+    {
+      android::Mutex::Autolock auto_lock(lock_);
+      worker = worker_;
+      worker_.clear();
+      queues_.clear();
+      ready_listeners_.clear();
+      if (worker != NULL) worker->requestExit();
+      condition_.broadcast();
+    }
+    if (worker != NULL) worker->requestExitAndWait();
+  }
+
+  void Post(WvCdmEventListener* listener, const CdmSessionId& session_id,
+            bool is_key_status_event, CdmEventType event,
+            const CdmKeyStatusEvent* key_status_event) {
+    {
+      android::Mutex::Autolock auto_lock(lock_);
+      EventQueue& events = queues_[listener];
+      bool listener_ready = !events.empty();
+      for (EventQueue::iterator iter = events.begin(); iter != events.end();
+           ++iter) {
+        if (iter->session_id != session_id ||
+            iter->is_key_status_event != is_key_status_event) {
+          continue;
+        }
+        if (!is_key_status_event && iter->event == event) return;
+        if (is_key_status_event &&
+            iter->key_status_event.type == key_status_event->type) {
+          // The new snapshot is queued after any status queued since
+          events.erase(iter);
+          break;
+        }
+      }
+
+      if (events.size() >= kMaxQueuedEventsPerListener &&
+          !DropStatusEvent(&events) && is_key_status_event &&
+          !IsRetainedStatus(key_status_event->type)) {
+        LOGW("EventDispatcher: queue full, dropping key status event for "
+             "session %s", session_id.c_str());
+        return;
+      }
+
+      if (StartWorker()) {
+        if (!listener_ready) ready_listeners_.push_back(listener);
+        events.push_back(Event());
+        Event& queued = events.back();
+        queued.session_id = session_id;
+        queued.is_key_status_event = is_key_status_event;
+        queued.event = event;
+        if (is_key_status_event) queued.key_status_event = *key_status_event;
+        condition_.broadcast();
+        return;
+      }
+      if (events.empty()) queues_.erase(listener);
+    }
+
+    // Without a dispatcher thread events are delivered by the caller
+    if (is_key_status_event) {
+      listener->onKeyStatusEvent(session_id, *key_status_event);
+    } else {
+      listener->onEvent(session_id, event);
+    }
+  }
+
+  void Cancel(WvCdmEventListener* listener, const CdmSessionId& session_id) {
+    android::Mutex::Autolock auto_lock(lock_);
+    EventQueueMap::iterator queue = queues_.find(listener);
+    if (queue != queues_.end()) {
+      EventQueue& events = queue->second;
+      for (EventQueue::iterator iter = events.begin(); iter != events.end();) {
+        if (iter->session_id == session_id) {
+          iter = events.erase(iter);
+        } else {
+          ++iter;
+        }
+      }
+      if (events.empty()) {
+        queues_.erase(queue);
+        ready_listeners_.remove(listener);
+      }
+    }
+
+    // A listener may cancel its own events from within a callback
+    while (delivering_listener_ == listener &&
+           delivering_session_id_ == session_id &&
+           !pthread_equal(delivering_thread_, pthread_self())) {
+      condition_.wait(lock_);
+    }
+  }
+
+ private:
+  struct Event {
+    CdmSessionId session_id;
+    bool is_key_status_event;
+    CdmEventType event;
+    CdmKeyStatusEvent key_status_event;
+  };
+
+  typedef std::deque<Event> EventQueue;
+  typedef std::map<WvCdmEventListener*, EventQueue> EventQueueMap;
+
+  class Worker : public android::Thread {
+   public:
+    explicit Worker(Impl* impl) : Thread(false), impl_(impl) {}
+    virtual ~Worker() {}
+
+   private:
+    virtual bool threadLoop() { return impl_->DeliverNextEvent(); }
+
+    Impl* impl_;
+
+    CORE_DISALLOW_COPY_AND_ASSIGN(Worker);
+  };
+
+  // Starts the dispatcher thread if not running, caller must hold lock_
+  bool StartWorker() {
+    if (worker_ != NULL) return true;
+
+    android::sp<Worker> worker = new Worker(this);
+    if (worker->run("WVCdmEvents") != android::NO_ERROR) {
+      LOGW("EventDispatcher: unable to start dispatcher thread");
+      return false;
+    }
+    worker_ = worker;
+    return true;
+  }
+
+  // Makes room in a full queue by discarding its oldest key status event
+  // other than a renewal or expiry. Later status events carry a newer
+  // snapshot, so only the notification itself is lost. Renewal and expiry
+  // events are never discarded. Caller must hold lock_.
+  bool DropStatusEvent(EventQueue* events) {
+    for (EventQueue::iterator iter = events->begin(); iter != events->end();
+         ++iter) {
+      if (iter->is_key_status_event &&
+          !IsRetainedStatus(iter->key_status_event.type)) {
+        events->erase(iter);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static bool IsRetainedStatus(CdmKeyStatusEventType type) {
+    return type == kKeyStatusExpired || type == kKeyStatusRenewed ||
+           type == kKeyStatusRenewalFailed;
+  }
+
+  // Waits for and delivers one event. Listeners with queued events are
+  // served in turn, so a listener with a backlog does not queue the others
+  // behind all of its events, while events for any one listener keep their
+  // order. All listeners share this thread, so a callback that blocks
+  // holds up delivery to every listener until it returns.
+  // Returns false when the dispatcher is shutting down.
+  bool DeliverNextEvent() {
+    WvCdmEventListener* listener;
+    Event event;
+    {
+      android::Mutex::Autolock auto_lock(lock_);
+      while (ready_listeners_.empty() && worker_ != NULL)
+        condition_.wait(lock_);
+      if (worker_ == NULL) return false;
+
+      listener = ready_listeners_.front();
+      ready_listeners_.pop_front();
+      EventQueueMap::iterator queue = queues_.find(listener);
+      event = queue->second.front();
+      queue->second.pop_front();
+      if (queue->second.empty()) {
+        queues_.erase(queue);
+      } else {
+        ready_listeners_.push_back(listener);
+      }
+      delivering_listener_ = listener;
+      delivering_session_id_ = event.session_id;
+      delivering_thread_ = pthread_self();
+    }
+
+    if (event.is_key_status_event) {
+      listener->onKeyStatusEvent(event.session_id, event.key_status_event);
+    } else {
+      listener->onEvent(event.session_id, event.event);
+    }
+
+    android::Mutex::Autolock auto_lock(lock_);
+    delivering_listener_ = NULL;
+    delivering_session_id_.clear();
+    condition_.broadcast();
+    return true;
+  }
+
+  android::Mutex lock_;
+  android::Condition condition_;
+  EventQueueMap queues_;
+  std::list<WvCdmEventListener*> ready_listeners_;
+  android::sp<Worker> worker_;
+
+  // The delivery in progress, if any
+  WvCdmEventListener* delivering_listener_;
+  CdmSessionId delivering_session_id_;
+  pthread_t delivering_thread_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(Impl);
+};
+
+EventDispatcher::EventDispatcher() : impl_(new EventDispatcher::Impl()) {
+}
+
+EventDispatcher::~EventDispatcher() {
+  delete impl_;
+  impl_ = NULL;
+}
+
+void EventDispatcher::Post(WvCdmEventListener* listener,
+                           const CdmSessionId& session_id,
+                           CdmEventType event) {
+  if (listener == NULL) return;
+  impl_->Post(listener, session_id, false, event, NULL);
+}
+
+void EventDispatcher::Post(WvCdmEventListener* listener,
+                           const CdmSessionId& session_id,
+                           const CdmKeyStatusEvent& event) {
+  if (listener == NULL) return;
+  impl_->Post(listener, session_id, true, LICENSE_EXPIRED_EVENT, &event);
+}
+
+void EventDispatcher::Cancel(WvCdmEventListener* listener,
+                             const CdmSessionId& session_id) {
+  impl_->Cancel(listener, session_id);
+}
+
+}  // namespace wvcdm
@@ -10,28 +10,213 @@
 #include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <deque>
+
 #include "log.h"
+#include "utils/Condition.h"
+#include "utils/Mutex.h"
+#include "utils/RefBase.h"
+#include "utils/StrongPointer.h"
+#include "utils/Thread.h"
 
 namespace {
 const char kCurrentDirectory[] = ".";
 const char kParentDirectory[] = "..";
 const char kPathDelimiter[] = "/";
 const char kWildcard[] = "*";
+const size_t kIoWorkerThreads = 2;
+const size_t kMaxIoVectors = 16;
 }  // namespace
 
 namespace wvcdm {
 
+namespace {
+
+// Tracks the asynchronous requests outstanding against a File
+class PendingIo {
+ public:
+  PendingIo() : count_(0) {}
+
+  void Add() {
+    android::Mutex::Autolock auto_lock(lock_);
+    ++count_;
+  }
+
+  void Done() {
+    android::Mutex::Autolock auto_lock(lock_);
+    if (--count_ == 0) condition_.broadcast();
+  }
+
+  void Wait() {
+    android::Mutex::Autolock auto_lock(lock_);
+    while (count_ > 0) condition_.wait(lock_);
+  }
+
+ private:
+  android::Mutex lock_;
+  android::Condition condition_;
+  int count_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(PendingIo);
+};
+
+struct IoRequest {
+  bool is_write;
+  int fd;
+  char* buffer;
+  size_t bytes;
+  off_t offset;
+  FileIoHandler* handler;
+  void* context;
+  PendingIo* pending;
+};
+
+ssize_t ReadFully(int fd, char* buffer, size_t bytes, off_t offset) {
+  size_t total = 0;
+  while (total < bytes) {
+    ssize_t len = (offset < 0)
+        ? TEMP_FAILURE_RETRY(read(fd, buffer + total, bytes - total))
+        : TEMP_FAILURE_RETRY(pread(fd, buffer + total, bytes - total,
+                                   offset + total));
+    if (len < 0) return total > 0 ? total : -1;
+    if (len == 0) break;
+    total += len;
+  }
+  return total;
+}
+
+ssize_t WriteFully(int fd, const char* buffer, size_t bytes, off_t offset) {
+  size_t total = 0;
+  while (total < bytes) {
+    ssize_t len = (offset < 0)
+        ? TEMP_FAILURE_RETRY(write(fd, buffer + total, bytes - total))
+        : TEMP_FAILURE_RETRY(pwrite(fd, buffer + total, bytes - total,
+                                    offset + total));
+    if (len <= 0) return total > 0 ? total : -1;
+    total += len;
+  }
+  return total;
+}
+
+// Runs IoRequests on a fixed set of worker threads. The pool is created on
+// first use and lives for the remainder of the process.
+class IoThreadPool {
+ public:
+  static IoThreadPool* GetInstance() {
+    android::Mutex::Autolock auto_lock(instance_lock_);
+    if (instance_ == NULL) {
+      instance_ = new IoThreadPool();
+    }
+    return instance_;
+  }
+
+  bool Submit(const IoRequest& request) {
+    android::Mutex::Autolock auto_lock(lock_);
+    if (workers_.empty()) return false;
+    requests_.push_back(request);
+    condition_.signal();
+    return true;
+  }
+
+ private:
+  class Worker : public android::Thread {
+   public:
+    explicit Worker(IoThreadPool* pool) : Thread(false), pool_(pool) {}
+    virtual ~Worker() {}
+
+   private:
+    virtual bool threadLoop() {
+      IoRequest request;
+      pool_->Dequeue(&request);
+      ssize_t result = request.is_write
+          ? WriteFully(request.fd, request.buffer, request.bytes,
+                       request.offset)
+          : ReadFully(request.fd, request.buffer, request.bytes,
+                      request.offset);
+      if (result < 0) {
+        LOGW("File::Submit%sAt: failed: %d", request.is_write ? "Write" :
+             "Read", errno);
+      }
+      if (request.handler) {
+        request.handler->OnFileIoComplete(request.context, result);
+      }
+      request.pending->Done();
+      return true;
+    }
+
+    IoThreadPool* pool_;
+
+    CORE_DISALLOW_COPY_AND_ASSIGN(Worker);
+  };
+
+  IoThreadPool() {
+    for (size_t i = 0; i < kIoWorkerThreads; ++i) {
+      android::sp<Worker> worker = new Worker(this);
+      if (worker->run("WVCdmFileIo") != android::NO_ERROR) {
+        LOGW("IoThreadPool: unable to start worker thread");
+        continue;
+      }
+      workers_.push_back(worker);
+    }
+  }
+
+  void Dequeue(IoRequest* request) {
+    android::Mutex::Autolock auto_lock(lock_);
+    while (requests_.empty()) condition_.wait(lock_);
+    *request = requests_.front();
+    requests_.pop_front();
+  }
+
+  static android::Mutex instance_lock_;
+  static IoThreadPool* instance_;
+
+  android::Mutex lock_;
+  android::Condition condition_;
+  std::deque<IoRequest> requests_;
+  std::vector<android::sp<Worker> > workers_;
+
+  CORE_DISALLOW_COPY_AND_ASSIGN(IoThreadPool);
+};
+
+android::Mutex IoThreadPool::instance_lock_;
+IoThreadPool* IoThreadPool::instance_ = NULL;
+
+}  // namespace
+
 class File::Impl {
  public:
-  Impl() : file_(NULL) {}
-  Impl(const std::string& file_path) : file_(NULL), file_path_(file_path) {}
+  Impl() : fd_(-1) {}
+  Impl(const std::string& file_path) : fd_(-1), file_path_(file_path) {}
   virtual ~Impl() {}
 
-  FILE* file_;
+  bool Submit(bool is_write, char* buffer, size_t bytes, off_t offset,
+              FileIoHandler* handler, void* context) {
+    IoRequest request;
+    request.is_write = is_write;
+    request.fd = fd_;
+    request.buffer = buffer;
+    request.bytes = bytes;
+    request.offset = offset;
+    request.handler = handler;
+    request.context = context;
+    request.pending = &pending_io_;
+
+    pending_io_.Add();
+    if (!IoThreadPool::GetInstance()->Submit(request)) {
+      pending_io_.Done();
+      return false;
+    }
+    return true;
+  }
+
+  int fd_;
   std::string file_path_;
+  PendingIo pending_io_;
 };
 
 File::File() : impl_(new File::Impl()) {}
@@ -42,42 +227,32 @@ File::~File() {
 }
 
 bool File::Open(const std::string& name, int flags) {
-  std::string open_flags;
-
-  if (((flags & File::kTruncate) && Exists(name)) ||
-      ((flags & File::kCreate) && !Exists(name))) {
-    FILE* fp = fopen(name.c_str(), "w+");
-    if (fp) {
-      fclose(fp);
-    }
-  }
-
-  if (flags & File::kBinary) {
-    open_flags = (flags & File::kReadOnly) ? "rb" : "rb+";
-  } else {
-    open_flags = (flags & File::kReadOnly) ? "r" : "r+";
-  }
-
-  impl_->file_ = fopen(name.c_str(), open_flags.c_str());
-  if (!impl_->file_) {
-    LOGW("File::Open: fopen failed: %d", errno);
+  int open_flags = (flags & File::kReadOnly) ? O_RDONLY : O_RDWR;
+  if (flags & File::kCreate) open_flags |= O_CREAT;
+  if (flags & File::kTruncate) open_flags |= O_TRUNC;
+  if (flags & File::kDirect) open_flags |= O_DIRECT;
+
+  impl_->fd_ = TEMP_FAILURE_RETRY(open(name.c_str(), open_flags, 0666));
+  if (impl_->fd_ < 0) {
+    LOGW("File::Open: open failed: %d", errno);
   }
   impl_->file_path_ = name;
-  return impl_->file_ != NULL;
+  return impl_->fd_ >= 0;
 }
 
 void File::Close() {
-  if (impl_->file_) {
-    fclose(impl_->file_);
-    impl_->file_ = NULL;
+  if (impl_->fd_ >= 0) {
+    WaitForPendingIo();
+    close(impl_->fd_);
+    impl_->fd_ = -1;
   }
 }
 
 ssize_t File::Read(char* buffer, size_t bytes) {
-  if (impl_->file_) {
-    size_t len = fread(buffer, sizeof(char), bytes, impl_->file_);
-    if (len == 0) {
-      LOGW("File::Read: fread failed: %d", errno);
+  if (impl_->fd_ >= 0) {
+    ssize_t len = ReadFully(impl_->fd_, buffer, bytes, -1);
+    if (len <= 0) {
+      LOGW("File::Read: read failed: %d", errno);
     }
     return len;
   }
@@ -86,10 +261,10 @@ ssize_t File::Read(char* buffer, size_t bytes) {
 }
 
 ssize_t File::Write(const char* buffer, size_t bytes) {
-  if (impl_->file_) {
-    size_t len = fwrite(buffer, sizeof(char), bytes, impl_->file_);
-    if (len == 0) {
-      LOGW("File::Write: fwrite failed: %d", errno);
+  if (impl_->fd_ >= 0) {
+    ssize_t len = WriteFully(impl_->fd_, buffer, bytes, -1);
+    if (len <= 0) {
+      LOGW("File::Write: write failed: %d", errno);
     }
     return len;
   }
@@ -97,6 +272,155 @@ ssize_t File::Write(const char* buffer, size_t bytes) {
   return -1;
 }
 
+ssize_t File::ReadAt(char* buffer, size_t bytes, off_t offset) {
+  if (impl_->fd_ >= 0 && offset >= 0) {
+    ssize_t len = ReadFully(impl_->fd_, buffer, bytes, offset);
+    if (len <= 0) {
+      LOGW("File::ReadAt: pread failed: %d", errno);
+    }
+    return len;
+  }
+  LOGW("File::ReadAt: file not open or invalid offset");
+  return -1;
+}
+
+ssize_t File::WriteAt(const char* buffer, size_t bytes, off_t offset) {
+  if (impl_->fd_ >= 0 && offset >= 0) {
+    ssize_t len = WriteFully(impl_->fd_, buffer, bytes, offset);
+    if (len <= 0) {
+      LOGW("File::WriteAt: pwrite failed: %d", errno);
+    }
+    return len;
+  }
+  LOGW("File::WriteAt: file not open or invalid offset");
+  return -1;
+}
+
+ssize_t File::ReadV(const IoVector* vectors, size_t count) {
+  if (impl_->fd_ < 0) {
+    LOGW("File::ReadV: file not open");
+    return -1;
+  }
+  if (count > kMaxIoVectors) {
+    LOGW("File::ReadV: too many buffers: %d", count);
+    return -1;
+  }
+
+  struct iovec iov[kMaxIoVectors];
+  for (size_t i = 0; i < count; ++i) {
+    iov[i].iov_base = vectors[i].data;
+    iov[i].iov_len = vectors[i].size;
+  }
+  ssize_t len = TEMP_FAILURE_RETRY(readv(impl_->fd_, iov, count));
+  if (len < 0) {
+    LOGW("File::ReadV: readv failed: %d", errno);
+  }
+  return len;
+}
+
+ssize_t File::WriteV(const IoVector* vectors, size_t count) {
+  if (impl_->fd_ < 0) {
+    LOGW("File::WriteV: file not open");
+    return -1;
+  }
+  if (count > kMaxIoVectors) {
+    LOGW("File::WriteV: too many buffers: %d", count);
+    return -1;
+  }
+
+  struct iovec iov[kMaxIoVectors];
+  size_t bytes = 0;
+  for (size_t i = 0; i < count; ++i) {
+    iov[i].iov_base = vectors[i].data;
+    iov[i].iov_len = vectors[i].size;
+    bytes += vectors[i].size;
+  }
+
+  // Complete short writes one buffer at a time
+  size_t total = 0;
+  size_t index = 0;
+  while (total < bytes) {
+    ssize_t len = TEMP_FAILURE_RETRY(writev(impl_->fd_, &iov[index],
+                                            count - index));
+    if (len <= 0) {
+      LOGW("File::WriteV: writev failed: %d", errno);
+      return total > 0 ? total : -1;
+    }
+    total += len;
+    while (index < count && static_cast<size_t>(len) >= iov[index].iov_len) {
+      len -= iov[index].iov_len;
+      ++index;
+    }
+    if (index < count) {
+      iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + len;
+      iov[index].iov_len -= len;
+    }
+  }
+  return total;
+}
+
+bool File::Allocate(size_t bytes) {
+  if (impl_->fd_ < 0) {
+    LOGW("File::Allocate: file not open");
+    return false;
+  }
+  int res = posix_fallocate(impl_->fd_, 0, bytes);
+  if (res != 0) {
+    LOGW("File::Allocate: posix_fallocate failed: %d", res);
+    return false;
+  }
+  return true;
+}
+
+bool File::Sync() {
+  if (impl_->fd_ < 0) {
+    LOGW("File::Sync: file not open");
+    return false;
+  }
+  WaitForPendingIo();
+  if (fsync(impl_->fd_)) {
+    LOGW("File::Sync: fsync failed: %d", errno);
+    return false;
+  }
+  return true;
+}
+
+bool File::DataSync() {
+  if (impl_->fd_ < 0) {
+    LOGW("File::DataSync: file not open");
+    return false;
+  }
+  WaitForPendingIo();
+  if (fdatasync(impl_->fd_)) {
+    LOGW("File::DataSync: fdatasync failed: %d", errno);
+    return false;
+  }
+  return true;
+}
+
+bool File::SubmitReadAt(char* buffer, size_t bytes, off_t offset,
+                        FileIoHandler* handler, void* context) {
+  if (impl_->fd_ < 0 || offset < 0) {
+    LOGW("File::SubmitReadAt: file not open or invalid offset");
+    return false;
+  }
+  return impl_->Submit(false, buffer, bytes, offset, handler, context);
+}
+
+bool File::SubmitWriteAt(const char* buffer, size_t bytes, off_t offset,
+                         FileIoHandler* handler, void* context) {
+  if (impl_->fd_ < 0 || offset < 0) {
+    LOGW("File::SubmitWriteAt: file not open or invalid offset");
+    return false;
+  }
+  return impl_->Submit(true, const_cast<char*>(buffer), bytes, offset,
+                       handler, context);
+}
+
+void File::WaitForPendingIo() {
+  impl_->pending_io_.Wait();
+}
+
 bool File::Exists(const std::string& path) {
   struct stat buf;
   int res = stat(path.c_str(), &buf) == 0;
@@ -190,7 +514,7 @@ bool File::Copy(const std::string& src, const std::string& dest) {
     return false;
   }
 
-  int fd_dest = open(dest.c_str(), O_WRONLY|O_CREAT, stat_buf.st_mode);
+  int fd_dest = open(dest.c_str(), O_WRONLY|O_CREAT|O_TRUNC, stat_buf.st_mode);
   if (fd_dest < 0) {
     LOGV("File::Copy: unable to open file %s: %d", dest.c_str(), errno);
     close(fd_src);
@@ -203,6 +527,9 @@ bool File::Copy(const std::string& src, const std::string& dest) {
     LOGV("File::Copy: unable to copy %s to %s: %d", src.c_str(), dest.c_str(),
          errno);
     sts = false;
+  } else if (fsync(fd_dest)) {
+    LOGV("File::Copy: unable to sync %s: %d", dest.c_str(), errno);
+    sts = false;
   }
 
   close(fd_src);
@@ -210,6 +537,16 @@ bool File::Copy(const std::string& src, const std::string& dest) {
   return sts;
 }
 
+bool File::Rename(const std::string& old_path,
+                  const std::string& new_path) {
+  if (rename(old_path.c_str(), new_path.c_str())) {
+    LOGW("File::Rename: unable to rename %s to %s: %d", old_path.c_str(),
+         new_path.c_str(), errno);
+    return false;
+  }
+  return true;
+}
+
 bool File::List(const std::string& path, std::vector<std::string>* files) {
   if (NULL == files) {
     LOGV("File::List: files destination not provided");
@@ -2,9 +2,11 @@
 //
 // Timer class - provides a simple Android specific timer implementation
 
-#include <unistd.h>
+#include <pthread.h>
 
 #include "timer.h"
+#include "utils/Condition.h"
+#include "utils/Mutex.h"
 #include "utils/RefBase.h"
 #include "utils/StrongPointer.h"
 #include "utils/Thread.h"
@@ -15,7 +17,8 @@ class Timer::Impl : virtual public android::RefBase {
  private:
   class ImplThread : public android::Thread {
    public:
-    ImplThread() : Thread(false), handler_(NULL), period_(0) {}
+    ImplThread()
+        : Thread(false), handler_(NULL), period_(0), thread_started_(false) {}
     virtual ~ImplThread() {};
 
     bool Start(TimerHandler *handler, uint32_t time_in_secs) {
@@ -24,18 +27,42 @@ class Timer::Impl : virtual public android::RefBase {
       return run() == android::NO_ERROR;
     }
 
+    // Waking the thread lets Stop return without waiting out the period
+    void Stop() {
+      {
+        android::Mutex::Autolock auto_lock(lock_);
+        requestExit();
+        condition_.signal();
+      }
+      if (!IsTimerThread()) requestExitAndWait();
+    }
+
+    bool IsTimerThread() {
+      android::Mutex::Autolock auto_lock(lock_);
+      return thread_started_ && pthread_equal(thread_, pthread_self());
+    }
+
    private:
     virtual bool threadLoop() {
-      struct timeval timeout;
-      timeout.tv_sec = period_;
-      timeout.tv_usec = 0;
-      TEMP_FAILURE_RETRY(select(0, NULL, NULL, NULL, &timeout));
+      {
+        android::Mutex::Autolock auto_lock(lock_);
+        thread_ = pthread_self();
+        thread_started_ = true;
+        if (!exitPending()) {
+          condition_.waitRelative(lock_, period_ * 1000000000LL);
+        }
+        if (exitPending()) return false;
+      }
       handler_->OnTimerEvent();
       return true;
     }
 
     TimerHandler *handler_;
     uint32_t period_;
+    android::Mutex lock_;
+    android::Condition condition_;
+    pthread_t thread_;
+    bool thread_started_;
 
     CORE_DISALLOW_COPY_AND_ASSIGN(ImplThread);
   };
@@ -51,8 +78,10 @@ class Timer::Impl : virtual public android::RefBase {
     return impl_thread_->Start(handler, time_in_secs);
   }
 
+  // When called by the handler, the timer thread exits once the handler
+  // returns. The thread holds a reference to itself until then.
   void Stop() {
-    impl_thread_->requestExitAndWait();
+    impl_thread_->Stop();
     impl_thread_.clear();
   }
 
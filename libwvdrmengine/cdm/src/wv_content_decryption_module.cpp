@@ -22,11 +22,7 @@ CdmResponseType WvContentDecryptionModule::OpenSession(
     const CdmKeySystem& key_system,
     CdmClientPropertySet* property_set,
     CdmSessionId* session_id) {
-  if (property_set && property_set->is_session_sharing_enabled()) {
-    if (property_set->session_sharing_id() == 0)
-      property_set->set_session_sharing_id(GenerateSessionSharingId());
-  }
-
+  SetUpSessionSharing(property_set);
   return cdm_engine_->OpenSession(key_system, property_set, session_id);
 }
 
@@ -60,6 +56,18 @@ CdmResponseType WvContentDecryptionModule::GenerateKeyRequest(
   return sts;
 }
 
+CdmResponseType WvContentDecryptionModule::GenerateKeyRequest(
+    const CdmSessionId& session_id,
+    const CdmInitDataList& init_data,
+    const CdmLicenseType license_type,
+    CdmAppParameterMap& app_parameters,
+    CdmKeyMessage* key_request,
+    std::string* server_url) {
+  return cdm_engine_->GenerateKeyRequest(session_id, init_data, license_type,
+                                         app_parameters, key_request,
+                                         server_url);
+}
+
 CdmResponseType WvContentDecryptionModule::AddKey(
     const CdmSessionId& session_id,
     const CdmKeyResponse& key_data,
@@ -76,6 +84,32 @@ CdmResponseType WvContentDecryptionModule::RestoreKey(
   return cdm_engine_->RestoreKey(session_id, key_set_id);
 }
 
+CdmResponseType WvContentDecryptionModule::RestoreKeys(
+    CdmClientPropertySet* property_set,
+    const CdmKeySetIdList& key_set_ids,
+    CdmKeySetSessionMap* sessions,
+    CdmKeySetResponseMap* results) {
+  SetUpSessionSharing(property_set);
+  return cdm_engine_->RestoreKeys(property_set, key_set_ids, sessions,
+                                  results);
+}
+
+CdmResponseType WvContentDecryptionModule::QueryOfflineLicenseStates(
+    CdmClientPropertySet* property_set,
+    const CdmKeySetIdList& key_set_ids,
+    CdmOfflineLicenseStateMap* states) {
+  return cdm_engine_->QueryOfflineLicenseStates(property_set, key_set_ids,
+                                                states);
+}
+
+CdmResponseType WvContentDecryptionModule::DeleteOfflineLicenses(
+    CdmClientPropertySet* property_set,
+    const CdmKeySetIdList& key_set_ids,
+    CdmKeySetResponseMap* results) {
+  return cdm_engine_->DeleteOfflineLicenses(property_set, key_set_ids,
+                                            results);
+}
+
 CdmResponseType WvContentDecryptionModule::CancelKeyRequest(
     const CdmSessionId& session_id) {
   return cdm_engine_->CancelKeyRequest(session_id);
@@ -95,6 +129,11 @@ CdmResponseType WvContentDecryptionModule::QueryKeyStatus(
   return cdm_engine_->QueryKeyStatus(session_id, key_info);
 }
 
+CdmResponseType WvContentDecryptionModule::QueryKeyStatus(
+    const CdmSessionId& session_id, CdmKeyStatus* key_status) {
+  return cdm_engine_->QueryKeyStatus(session_id, key_status);
+}
+
 CdmResponseType WvContentDecryptionModule::QueryKeyControlInfo(
     const CdmSessionId& session_id, CdmQueryMap* key_info) {
   return cdm_engine_->QueryKeyControlInfo(session_id, key_info);
@@ -145,6 +184,15 @@ bool WvContentDecryptionModule::DetachEventListener(
   return cdm_engine_->DetachEventListener(session_id, listener);
 }
 
+// Sessions opened with the same property set share one sharing id
+void WvContentDecryptionModule::SetUpSessionSharing(
+    CdmClientPropertySet* property_set) {
+  if (property_set && property_set->is_session_sharing_enabled()) {
+    if (property_set->session_sharing_id() == 0)
+      property_set->set_session_sharing_id(GenerateSessionSharingId());
+  }
+}
+
 uint32_t WvContentDecryptionModule::GenerateSessionSharingId() {
   static int next_session_sharing_id = 0;
   return ++next_session_sharing_id;
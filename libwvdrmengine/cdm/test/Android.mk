@@ -11,10 +11,26 @@ test_name := cdm_engine_test
 test_src_dir := ../core/test
 include $(LOCAL_PATH)/unit-test.mk
 
+test_name := crypto_session_pool_unittest
+test_src_dir := ../core/test
+include $(LOCAL_PATH)/unit-test.mk
+
+test_name := crypto_session_unittest
+test_src_dir := ../core/test
+include $(LOCAL_PATH)/unit-test.mk
+
+test_name := device_files_benchmark
+test_src_dir := ../core/test
+include $(LOCAL_PATH)/unit-test.mk
+
 test_name := device_files_unittest
 test_src_dir := ../core/test
 include $(LOCAL_PATH)/unit-test.mk
 
+test_name := event_dispatcher_unittest
+test_src_dir := ../core/test
+include $(LOCAL_PATH)/unit-test.mk
+
 test_name := file_store_unittest
 test_src_dir := ../core/test
 include $(LOCAL_PATH)/unit-test.mk
@@ -27,6 +43,10 @@ test_name := license_unittest
 test_src_dir := ../core/test
 include $(LOCAL_PATH)/unit-test.mk
 
+test_name := message_cache_unittest
+test_src_dir := ../core/test
+include $(LOCAL_PATH)/unit-test.mk
+
 test_name := policy_engine_unittest
 test_src_dir := ../core/test
 include $(LOCAL_PATH)/unit-test.mk
@@ -35,6 +55,10 @@ test_name := request_license_test
 test_src_dir := .
 include $(LOCAL_PATH)/unit-test.mk
 
+test_name := service_certificate_cache_unittest
+test_src_dir := ../core/test
+include $(LOCAL_PATH)/unit-test.mk
+
 test_name := timer_unittest
 test_src_dir := ../core/test
 include $(LOCAL_PATH)/unit-test.mk
@@ -212,7 +212,7 @@ class TestWvCdmClientPropertySet : public CdmClientPropertySet {
   virtual ~TestWvCdmClientPropertySet() {}
 
   virtual std::string security_level() const { return security_level_; }
-  virtual std::vector<uint8_t> service_certificate() const {
+  virtual const std::vector<uint8_t>& service_certificate() const {
     return service_certificate_;
   }
   virtual bool use_privacy_mode() const { return use_privacy_mode_; }
@@ -637,6 +637,36 @@ TEST_F(WvCdmRequestLicenseTest, RestoreOfflineKeyTest) {
   decryptor_.CloseSession(session_id_);
 }
 
+TEST_F(WvCdmRequestLicenseTest, MultiplePsshOfflineKeyTest) {
+  decryptor_.OpenSession(g_key_system, NULL, &session_id_);
+  wvcdm::CdmAppParameterMap app_parameters;
+  std::string server_url;
+  CdmInitDataList init_data;
+  init_data.push_back(g_key_id);
+  init_data.push_back("");
+  EXPECT_EQ(wvcdm::KEY_ERROR,
+            decryptor_.GenerateKeyRequest(session_id_, init_data,
+                                          kLicenseTypeOffline, app_parameters,
+                                          &key_msg_, &server_url));
+
+  // Both PSSHs go into one request and are kept with the offline license
+  init_data.back() = g_key_id;
+  EXPECT_EQ(wvcdm::KEY_MESSAGE,
+            decryptor_.GenerateKeyRequest(session_id_, init_data,
+                                          kLicenseTypeOffline, app_parameters,
+                                          &key_msg_, &server_url));
+  VerifyKeyRequestResponse(g_license_server, g_client_auth, g_key_id, false);
+
+  CdmKeySetId key_set_id = key_set_id_;
+  EXPECT_FALSE(key_set_id_.empty());
+  decryptor_.CloseSession(session_id_);
+
+  session_id_.clear();
+  decryptor_.OpenSession(g_key_system, NULL, &session_id_);
+  EXPECT_EQ(wvcdm::KEY_ADDED, decryptor_.RestoreKey(session_id_, key_set_id));
+  decryptor_.CloseSession(session_id_);
+}
+
 TEST_F(WvCdmRequestLicenseTest, ReleaseOfflineKeyTest) {
   decryptor_.OpenSession(g_key_system, NULL, &session_id_);
   GenerateKeyRequest(g_key_system, g_key_id, kLicenseTypeOffline);
@@ -689,6 +719,82 @@ TEST_F(WvCdmRequestLicenseTest, ExpiryOnReleaseOfflineKeyTest) {
   decryptor_.CloseSession(restore_session_id);
 }
 
+TEST_F(WvCdmRequestLicenseTest, BulkOfflineLicenseTest) {
+  CdmKeySetIdList key_set_ids;
+  for (size_t i = 0; i < 2; ++i) {
+    session_id_.clear();
+    key_set_id_.clear();
+    decryptor_.OpenSession(g_key_system, NULL, &session_id_);
+    GenerateKeyRequest(g_key_system, g_key_id, kLicenseTypeOffline);
+    VerifyKeyRequestResponse(g_license_server, g_client_auth, g_key_id, false);
+    EXPECT_FALSE(key_set_id_.empty());
+    key_set_ids.push_back(key_set_id_);
+    decryptor_.CloseSession(session_id_);
+  }
+  session_id_.clear();
+  key_set_id_.clear();
+
+  TestWvCdmClientPropertySet property_set;
+  property_set.set_session_sharing_mode(true);
+
+  CdmKeySetIdList query_key_set_ids(key_set_ids);
+  CdmKeySetId missing_key_set_id("ksid00000000");
+  query_key_set_ids.push_back(missing_key_set_id);
+  CdmOfflineLicenseStateMap states;
+  EXPECT_EQ(NO_ERROR, decryptor_.QueryOfflineLicenseStates(
+                          &property_set, query_key_set_ids, &states));
+  EXPECT_EQ(kOfflineLicenseStateActive, states[key_set_ids[0]]);
+  EXPECT_EQ(kOfflineLicenseStateActive, states[key_set_ids[1]]);
+  EXPECT_EQ(kOfflineLicenseStateNotFound, states[missing_key_set_id]);
+
+  CdmKeySetSessionMap sessions;
+  CdmKeySetResponseMap results;
+  EXPECT_EQ(NO_ERROR, decryptor_.RestoreKeys(&property_set, key_set_ids,
+                                             &sessions, &results));
+  EXPECT_EQ(KEY_ADDED, results[key_set_ids[0]]);
+  EXPECT_EQ(KEY_ADDED, results[key_set_ids[1]]);
+  ASSERT_EQ(2u, sessions.size());
+
+  // Restored sessions share keys with other sessions of the property set
+  EXPECT_NE(0u, property_set.session_sharing_id());
+  CdmSessionId sharing_session_id;
+  decryptor_.OpenSession(g_key_system, &property_set, &sharing_session_id);
+
+  SubSampleInfo* data = &single_encrypted_sub_sample;
+  std::vector<uint8_t> decrypt_buffer(data->encrypt_data.size());
+  CdmDecryptionParameters decryption_parameters(&data->key_id,
+                                                &data->encrypt_data.front(),
+                                                data->encrypt_data.size(),
+                                                &data->iv,
+                                                data->block_offset,
+                                                &decrypt_buffer[0]);
+  decryption_parameters.is_encrypted = data->is_encrypted;
+  decryption_parameters.is_secure = data->is_secure;
+  EXPECT_EQ(NO_ERROR, decryptor_.Decrypt(sharing_session_id,
+                                         decryption_parameters));
+  EXPECT_TRUE(std::equal(data->decrypt_data.begin(), data->decrypt_data.end(),
+                         decrypt_buffer.begin()));
+
+  decryptor_.CloseSession(sharing_session_id);
+  for (CdmKeySetSessionMap::iterator iter = sessions.begin();
+       iter != sessions.end(); ++iter) {
+    decryptor_.CloseSession(iter->second);
+  }
+
+  results.clear();
+  EXPECT_EQ(NO_ERROR, decryptor_.DeleteOfflineLicenses(
+                          &property_set, query_key_set_ids, &results));
+  EXPECT_EQ(NO_ERROR, results[key_set_ids[0]]);
+  EXPECT_EQ(NO_ERROR, results[key_set_ids[1]]);
+  EXPECT_EQ(KEY_ERROR, results[missing_key_set_id]);
+
+  states.clear();
+  EXPECT_EQ(NO_ERROR, decryptor_.QueryOfflineLicenseStates(
+                          &property_set, key_set_ids, &states));
+  EXPECT_EQ(kOfflineLicenseStateNotFound, states[key_set_ids[0]]);
+  EXPECT_EQ(kOfflineLicenseStateNotFound, states[key_set_ids[1]]);
+}
+
 TEST_F(WvCdmRequestLicenseTest, StreamingLicenseRenewal) {
   decryptor_.OpenSession(g_key_system, NULL, &session_id_);
   GenerateKeyRequest(g_key_system, g_key_id, kLicenseTypeStreaming);
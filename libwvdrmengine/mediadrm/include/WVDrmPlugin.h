@@ -181,7 +181,7 @@ class WVDrmPlugin : public android::DrmPlugin,
       mUsePrivacyMode = usePrivacyMode;
     }
 
-    virtual std::vector<uint8_t> service_certificate() const {
+    virtual const std::vector<uint8_t>& service_certificate() const {
       return mServiceCertificate;
     }
 
@@ -219,6 +219,41 @@ class WVDrmPlugin : public android::DrmPlugin,
   WVGenericCryptoInterface* mCrypto;
   map<CdmSessionId, CryptoSession> mCryptoSessions;
 
+  CryptoSession* findCryptoSession(const Vector<uint8_t>& sessionId);
+
+  status_t selectKey(const Vector<uint8_t>& sessionId,
+                     CryptoSession* cryptoSession,
+                     const Vector<uint8_t>& keyId);
+
+  status_t encryptBuffer(const Vector<uint8_t>& sessionId,
+                         CryptoSession* cryptoSession,
+                         const Vector<uint8_t>& input,
+                         const Vector<uint8_t>& iv,
+                         Vector<uint8_t>& output);
+
+  status_t decryptBuffer(const Vector<uint8_t>& sessionId,
+                         CryptoSession* cryptoSession,
+                         const Vector<uint8_t>& input,
+                         const Vector<uint8_t>& iv,
+                         Vector<uint8_t>& output);
+
+  status_t querySignatureSize(const Vector<uint8_t>& sessionId,
+                              CryptoSession* cryptoSession,
+                              const Vector<uint8_t>& message,
+                              size_t* signatureSize);
+
+  status_t signBuffer(const Vector<uint8_t>& sessionId,
+                      CryptoSession* cryptoSession,
+                      const Vector<uint8_t>& message,
+                      size_t signatureSize,
+                      Vector<uint8_t>& signature);
+
+  status_t verifyBuffer(const Vector<uint8_t>& sessionId,
+                        CryptoSession* cryptoSession,
+                        const Vector<uint8_t>& message,
+                        const Vector<uint8_t>& signature,
+                        bool& match);
+
   status_t mapAndNotifyOfCdmResponseType(const Vector<uint8_t>& sessionId,
                                          CdmResponseType res);
 
@@ -29,6 +29,14 @@ static const char* const kResetSecurityLevel = "";
 static const char* const kEnable = "enable";
 static const char* const kDisable = "disable";
 
+static String8 toString8(const string& value) {
+  return String8(value.data(), value.size());
+}
+
+static String8 toQueryValue(bool value) {
+  return toString8(value ? QUERY_VALUE_TRUE : QUERY_VALUE_FALSE);
+}
+
 WVDrmPlugin::WVDrmPlugin(WvContentDecryptionModule* cdm,
                          WVGenericCryptoInterface* crypto)
   : mCDM(cdm), mCrypto(crypto) {}
@@ -270,23 +278,29 @@ status_t WVDrmPlugin::queryKeyStatus(
     const Vector<uint8_t>& sessionId,
     KeyedVector<String8, String8>& infoMap) const {
   CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
-  CdmQueryMap cdmLicenseInfo;
+  CdmKeyStatus cdmKeyStatus;
 
-  CdmResponseType res = mCDM->QueryKeyStatus(cdmSessionId, &cdmLicenseInfo);
+  CdmResponseType res = mCDM->QueryKeyStatus(cdmSessionId, &cdmKeyStatus);
 
   if (isCdmResponseTypeSuccess(res)) {
     infoMap.clear();
-    for (CdmQueryMap::const_iterator iter = cdmLicenseInfo.begin();
-         iter != cdmLicenseInfo.end();
-         ++iter) {
-      const string& cdmKey = iter->first;
-      const string& cdmValue = iter->second;
-
-      String8 key(cdmKey.data(), cdmKey.size());
-      String8 value(cdmValue.data(), cdmValue.size());
-
-      infoMap.add(key, value);
-    }
+    infoMap.add(toString8(QUERY_KEY_LICENSE_TYPE),
+                toString8(cdmKeyStatus.license_type == kLicenseTypeStreaming ?
+                          QUERY_VALUE_STREAMING : QUERY_VALUE_OFFLINE));
+    infoMap.add(toString8(QUERY_KEY_PLAY_ALLOWED),
+                toQueryValue(cdmKeyStatus.play_allowed));
+    infoMap.add(toString8(QUERY_KEY_PERSIST_ALLOWED),
+                toQueryValue(cdmKeyStatus.persist_allowed));
+    infoMap.add(toString8(QUERY_KEY_RENEW_ALLOWED),
+                toQueryValue(cdmKeyStatus.renew_allowed));
+    infoMap.add(toString8(QUERY_KEY_LICENSE_DURATION_REMAINING),
+                String8::format("%lld", static_cast<long long>(
+                    cdmKeyStatus.license_duration_remaining)));
+    infoMap.add(toString8(QUERY_KEY_PLAYBACK_DURATION_REMAINING),
+                String8::format("%lld", static_cast<long long>(
+                    cdmKeyStatus.playback_duration_remaining)));
+    infoMap.add(toString8(QUERY_KEY_RENEWAL_SERVER_URL),
+                toString8(cdmKeyStatus.renewal_server_url));
   }
 
   return mapCdmResponseType(res);
@@ -518,16 +532,14 @@ status_t WVDrmPlugin::setPropertyByteArray(const String8& name,
 
 status_t WVDrmPlugin::setCipherAlgorithm(const Vector<uint8_t>& sessionId,
                                          const String8& algorithm) {
-  CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
+  CryptoSession* cryptoSession = findCryptoSession(sessionId);
 
-  if (!mCryptoSessions.count(cdmSessionId)) {
+  if (cryptoSession == NULL) {
     return android::ERROR_DRM_SESSION_NOT_OPENED;
   }
 
-  CryptoSession& cryptoSession = mCryptoSessions[cdmSessionId];
-
   if (algorithm == "AES/CBC/NoPadding") {
-    cryptoSession.setCipherAlgorithm(OEMCrypto_AES_CBC_128_NO_PADDING);
+    cryptoSession->setCipherAlgorithm(OEMCrypto_AES_CBC_128_NO_PADDING);
   } else {
     return android::ERROR_DRM_CANNOT_HANDLE;
   }
@@ -537,16 +549,14 @@ status_t WVDrmPlugin::setCipherAlgorithm(const Vector<uint8_t>& sessionId,
 
 status_t WVDrmPlugin::setMacAlgorithm(const Vector<uint8_t>& sessionId,
                                       const String8& algorithm) {
-  CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
+  CryptoSession* cryptoSession = findCryptoSession(sessionId);
 
-  if (!mCryptoSessions.count(cdmSessionId)) {
+  if (cryptoSession == NULL) {
     return android::ERROR_DRM_SESSION_NOT_OPENED;
   }
 
-  CryptoSession& cryptoSession = mCryptoSessions[cdmSessionId];
-
   if (algorithm == "HmacSHA256") {
-    cryptoSession.setMacAlgorithm(OEMCrypto_HMAC_SHA256);
+    cryptoSession->setMacAlgorithm(OEMCrypto_HMAC_SHA256);
   } else {
     return android::ERROR_DRM_CANNOT_HANDLE;
   }
@@ -559,38 +569,23 @@ status_t WVDrmPlugin::encrypt(const Vector<uint8_t>& sessionId,
                               const Vector<uint8_t>& input,
                               const Vector<uint8_t>& iv,
                               Vector<uint8_t>& output) {
-  CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
+  CryptoSession* cryptoSession = findCryptoSession(sessionId);
 
-  if (!mCryptoSessions.count(cdmSessionId)) {
+  if (cryptoSession == NULL) {
     return android::ERROR_DRM_SESSION_NOT_OPENED;
   }
 
-  const CryptoSession& cryptoSession = mCryptoSessions[cdmSessionId];
-
-  if (cryptoSession.cipherAlgorithm() == kInvalidCrytpoAlgorithm) {
+  if (cryptoSession->cipherAlgorithm() == kInvalidCrytpoAlgorithm) {
     return android::NO_INIT;
   }
 
-  OEMCryptoResult res = mCrypto->selectKey(cryptoSession.oecSessionId(),
-                                           keyId.array(), keyId.size());
+  status_t status = selectKey(sessionId, cryptoSession, keyId);
 
-  if (res != OEMCrypto_SUCCESS) {
-    ALOGE("OEMCrypto_SelectKey failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  if (status != android::OK) {
+    return status;
   }
 
-  output.resize(input.size());
-
-  res = mCrypto->encrypt(cryptoSession.oecSessionId(), input.array(),
-                         input.size(), iv.array(),
-                         cryptoSession.cipherAlgorithm(), output.editArray());
-
-  if (res == OEMCrypto_SUCCESS) {
-    return android::OK;
-  } else {
-    ALOGE("OEMCrypto_Generic_Encrypt failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
-  }
+  return encryptBuffer(sessionId, cryptoSession, input, iv, output);
 }
 
 status_t WVDrmPlugin::decrypt(const Vector<uint8_t>& sessionId,
@@ -598,92 +593,55 @@ status_t WVDrmPlugin::decrypt(const Vector<uint8_t>& sessionId,
                               const Vector<uint8_t>& input,
                               const Vector<uint8_t>& iv,
                               Vector<uint8_t>& output) {
-  CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
+  CryptoSession* cryptoSession = findCryptoSession(sessionId);
 
-  if (!mCryptoSessions.count(cdmSessionId)) {
+  if (cryptoSession == NULL) {
     return android::ERROR_DRM_SESSION_NOT_OPENED;
   }
 
-  const CryptoSession& cryptoSession = mCryptoSessions[cdmSessionId];
-
-  if (cryptoSession.cipherAlgorithm() == kInvalidCrytpoAlgorithm) {
+  if (cryptoSession->cipherAlgorithm() == kInvalidCrytpoAlgorithm) {
     return android::NO_INIT;
   }
 
-  OEMCryptoResult res = mCrypto->selectKey(cryptoSession.oecSessionId(),
-                                           keyId.array(), keyId.size());
+  status_t status = selectKey(sessionId, cryptoSession, keyId);
 
-  if (res != OEMCrypto_SUCCESS) {
-    ALOGE("OEMCrypto_SelectKey failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  if (status != android::OK) {
+    return status;
   }
 
-  output.resize(input.size());
-
-  res = mCrypto->decrypt(cryptoSession.oecSessionId(), input.array(),
-                         input.size(), iv.array(),
-                         cryptoSession.cipherAlgorithm(), output.editArray());
-
-  if (res == OEMCrypto_SUCCESS) {
-    return android::OK;
-  } else {
-    ALOGE("OEMCrypto_Generic_Decrypt failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
-  }
+  return decryptBuffer(sessionId, cryptoSession, input, iv, output);
 }
 
 status_t WVDrmPlugin::sign(const Vector<uint8_t>& sessionId,
                            const Vector<uint8_t>& keyId,
                            const Vector<uint8_t>& message,
                            Vector<uint8_t>& signature) {
-  CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
+  CryptoSession* cryptoSession = findCryptoSession(sessionId);
 
-  if (!mCryptoSessions.count(cdmSessionId)) {
+  if (cryptoSession == NULL) {
     return android::ERROR_DRM_SESSION_NOT_OPENED;
   }
 
-  const CryptoSession& cryptoSession = mCryptoSessions[cdmSessionId];
-
-  if (cryptoSession.macAlgorithm() == kInvalidCrytpoAlgorithm) {
+  if (cryptoSession->macAlgorithm() == kInvalidCrytpoAlgorithm) {
     return android::NO_INIT;
   }
 
-  OEMCryptoResult res = mCrypto->selectKey(cryptoSession.oecSessionId(),
-                                           keyId.array(), keyId.size());
+  status_t status = selectKey(sessionId, cryptoSession, keyId);
 
-  if (res != OEMCrypto_SUCCESS) {
-    ALOGE("OEMCrypto_SelectKey failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  if (status != android::OK) {
+    return status;
   }
 
   size_t signatureSize = 0;
+  status = querySignatureSize(sessionId, cryptoSession, message,
+                              &signatureSize);
 
-  res = mCrypto->sign(cryptoSession.oecSessionId(), message.array(),
-                      message.size(), cryptoSession.macAlgorithm(),
-                      signature.editArray(), &signatureSize);
-
-  if (res != OEMCrypto_ERROR_SHORT_BUFFER) {
-    ALOGE("OEMCrypto_Generic_Sign failed with %u when requesting signature "
-          "size", res);
-    if (res != OEMCrypto_SUCCESS) {
-      return mapAndNotifyOfOEMCryptoResult(sessionId, res);
-    } else {
-      return android::ERROR_DRM_UNKNOWN;
-    }
+  if (status != android::OK) {
+    return status;
   }
 
-  signature.resize(signatureSize);
-
-  res = mCrypto->sign(cryptoSession.oecSessionId(), message.array(),
-                      message.size(), cryptoSession.macAlgorithm(),
-                      signature.editArray(), &signatureSize);
-
-  if (res == OEMCrypto_SUCCESS) {
-    return android::OK;
-  } else {
-    ALOGE("OEMCrypto_Generic_Sign failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
-  }
+  return signBuffer(sessionId, cryptoSession, message, signatureSize,
+                    signature);
 }
 
 status_t WVDrmPlugin::verify(const Vector<uint8_t>& sessionId,
@@ -691,40 +649,23 @@ status_t WVDrmPlugin::verify(const Vector<uint8_t>& sessionId,
                              const Vector<uint8_t>& message,
                              const Vector<uint8_t>& signature,
                              bool& match) {
-  CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
+  CryptoSession* cryptoSession = findCryptoSession(sessionId);
 
-  if (!mCryptoSessions.count(cdmSessionId)) {
+  if (cryptoSession == NULL) {
     return android::ERROR_DRM_SESSION_NOT_OPENED;
   }
 
-  const CryptoSession& cryptoSession = mCryptoSessions[cdmSessionId];
-
-  if (cryptoSession.macAlgorithm() == kInvalidCrytpoAlgorithm) {
+  if (cryptoSession->macAlgorithm() == kInvalidCrytpoAlgorithm) {
     return android::NO_INIT;
   }
 
-  OEMCryptoResult res = mCrypto->selectKey(cryptoSession.oecSessionId(),
-                                           keyId.array(), keyId.size());
+  status_t status = selectKey(sessionId, cryptoSession, keyId);
 
-  if (res != OEMCrypto_SUCCESS) {
-    ALOGE("OEMCrypto_SelectKey failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  if (status != android::OK) {
+    return status;
   }
 
-  res = mCrypto->verify(cryptoSession.oecSessionId(), message.array(),
-                        message.size(), cryptoSession.macAlgorithm(),
-                        signature.array(), signature.size());
-
-  if (res == OEMCrypto_SUCCESS) {
-    match = true;
-    return android::OK;
-  } else if (res == OEMCrypto_ERROR_SIGNATURE_FAILURE) {
-    match = false;
-    return android::OK;
-  } else {
-    ALOGE("OEMCrypto_Generic_Verify failed with %u", res);
-    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
-  }
+  return verifyBuffer(sessionId, cryptoSession, message, signature, match);
 }
 
 void WVDrmPlugin::onEvent(const CdmSessionId& cdmSessionId,
@@ -748,6 +689,141 @@ void WVDrmPlugin::onEvent(const CdmSessionId& cdmSessionId,
   sendEvent(eventType, 0, &sessionId, NULL);
 }
 
+WVDrmPlugin::CryptoSession* WVDrmPlugin::findCryptoSession(
+    const Vector<uint8_t>& sessionId) {
+  CdmSessionId cdmSessionId(sessionId.begin(), sessionId.end());
+  map<CdmSessionId, CryptoSession>::iterator iter =
+      mCryptoSessions.find(cdmSessionId);
+
+  if (iter == mCryptoSessions.end()) {
+    return NULL;
+  }
+
+  return &iter->second;
+}
+
+status_t WVDrmPlugin::selectKey(const Vector<uint8_t>& sessionId,
+                                CryptoSession* cryptoSession,
+                                const Vector<uint8_t>& keyId) {
+  OEMCryptoResult res = mCrypto->selectKey(cryptoSession->oecSessionId(),
+                                           keyId.array(), keyId.size());
+
+  if (res != OEMCrypto_SUCCESS) {
+    ALOGE("OEMCrypto_SelectKey failed with %u", res);
+    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  }
+
+  return android::OK;
+}
+
+status_t WVDrmPlugin::encryptBuffer(const Vector<uint8_t>& sessionId,
+                                    CryptoSession* cryptoSession,
+                                    const Vector<uint8_t>& input,
+                                    const Vector<uint8_t>& iv,
+                                    Vector<uint8_t>& output) {
+  output.resize(input.size());
+
+  OEMCryptoResult res = mCrypto->encrypt(cryptoSession->oecSessionId(),
+                                         input.array(), input.size(),
+                                         iv.array(),
+                                         cryptoSession->cipherAlgorithm(),
+                                         output.editArray());
+
+  if (res == OEMCrypto_SUCCESS) {
+    return android::OK;
+  } else {
+    ALOGE("OEMCrypto_Generic_Encrypt failed with %u", res);
+    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  }
+}
+
+status_t WVDrmPlugin::decryptBuffer(const Vector<uint8_t>& sessionId,
+                                    CryptoSession* cryptoSession,
+                                    const Vector<uint8_t>& input,
+                                    const Vector<uint8_t>& iv,
+                                    Vector<uint8_t>& output) {
+  output.resize(input.size());
+
+  OEMCryptoResult res = mCrypto->decrypt(cryptoSession->oecSessionId(),
+                                         input.array(), input.size(),
+                                         iv.array(),
+                                         cryptoSession->cipherAlgorithm(),
+                                         output.editArray());
+
+  if (res == OEMCrypto_SUCCESS) {
+    return android::OK;
+  } else {
+    ALOGE("OEMCrypto_Generic_Decrypt failed with %u", res);
+    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  }
+}
+
+status_t WVDrmPlugin::querySignatureSize(const Vector<uint8_t>& sessionId,
+                                         CryptoSession* cryptoSession,
+                                         const Vector<uint8_t>& message,
+                                         size_t* signatureSize) {
+  *signatureSize = 0;
+
+  OEMCryptoResult res = mCrypto->sign(cryptoSession->oecSessionId(),
+                                      message.array(), message.size(),
+                                      cryptoSession->macAlgorithm(), NULL,
+                                      signatureSize);
+
+  if (res != OEMCrypto_ERROR_SHORT_BUFFER) {
+    ALOGE("OEMCrypto_Generic_Sign failed with %u when requesting signature "
+          "size", res);
+    if (res != OEMCrypto_SUCCESS) {
+      return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+    } else {
+      return android::ERROR_DRM_UNKNOWN;
+    }
+  }
+
+  return android::OK;
+}
+
+status_t WVDrmPlugin::signBuffer(const Vector<uint8_t>& sessionId,
+                                 CryptoSession* cryptoSession,
+                                 const Vector<uint8_t>& message,
+                                 size_t signatureSize,
+                                 Vector<uint8_t>& signature) {
+  signature.resize(signatureSize);
+
+  OEMCryptoResult res = mCrypto->sign(cryptoSession->oecSessionId(),
+                                      message.array(), message.size(),
+                                      cryptoSession->macAlgorithm(),
+                                      signature.editArray(), &signatureSize);
+
+  if (res == OEMCrypto_SUCCESS) {
+    return android::OK;
+  } else {
+    ALOGE("OEMCrypto_Generic_Sign failed with %u", res);
+    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  }
+}
+
+status_t WVDrmPlugin::verifyBuffer(const Vector<uint8_t>& sessionId,
+                                   CryptoSession* cryptoSession,
+                                   const Vector<uint8_t>& message,
+                                   const Vector<uint8_t>& signature,
+                                   bool& match) {
+  OEMCryptoResult res = mCrypto->verify(cryptoSession->oecSessionId(),
+                                        message.array(), message.size(),
+                                        cryptoSession->macAlgorithm(),
+                                        signature.array(), signature.size());
+
+  if (res == OEMCrypto_SUCCESS) {
+    match = true;
+    return android::OK;
+  } else if (res == OEMCrypto_ERROR_SIGNATURE_FAILURE) {
+    match = false;
+    return android::OK;
+  } else {
+    ALOGE("OEMCrypto_Generic_Verify failed with %u", res);
+    return mapAndNotifyOfOEMCryptoResult(sessionId, res);
+  }
+}
+
 status_t WVDrmPlugin::mapAndNotifyOfCdmResponseType(
     const Vector<uint8_t>& sessionId,
     CdmResponseType res) {
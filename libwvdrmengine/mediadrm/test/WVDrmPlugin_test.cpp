@@ -52,6 +52,9 @@ class MockCDM : public WvContentDecryptionModule {
   MOCK_METHOD2(QueryKeyStatus, CdmResponseType(const CdmSessionId&,
                                                CdmQueryMap*));
 
+  MOCK_METHOD2(QueryKeyStatus, CdmResponseType(const CdmSessionId&,
+                                               CdmKeyStatus*));
+
   MOCK_METHOD2(QueryKeyControlInfo, CdmResponseType(const CdmSessionId&,
                                                     CdmQueryMap*));
 
@@ -426,17 +429,35 @@ TEST_F(WVDrmPluginTest, QueriesKeyStatus) {
   WVDrmPlugin plugin(&cdm, &crypto);
 
   KeyedVector<String8, String8> expectedLicenseStatus;
-  CdmQueryMap cdmLicenseStatus;
-
-  expectedLicenseStatus.add(String8("areTheKeysAllRight"), String8("yes"));
-  cdmLicenseStatus["areTheKeysAllRight"] = "yes";
-  expectedLicenseStatus.add(String8("isGMockAwesome"), String8("ohhhhhhYeah"));
-  cdmLicenseStatus["isGMockAwesome"] = "ohhhhhhYeah";
-  expectedLicenseStatus.add(String8("answer"), String8("42"));
-  cdmLicenseStatus["answer"] = "42";
-
-  EXPECT_CALL(cdm, QueryKeyStatus(cdmSessionId, _))
-      .WillOnce(DoAll(SetArgPointee<1>(cdmLicenseStatus),
+  CdmKeyStatus cdmKeyStatus;
+  static const char* kRenewalServerUrl = "http://example.com/renewal";
+
+  cdmKeyStatus.license_type = kLicenseTypeOffline;
+  expectedLicenseStatus.add(String8(QUERY_KEY_LICENSE_TYPE.c_str()),
+                            String8(QUERY_VALUE_OFFLINE.c_str()));
+  cdmKeyStatus.play_allowed = true;
+  expectedLicenseStatus.add(String8(QUERY_KEY_PLAY_ALLOWED.c_str()),
+                            String8(QUERY_VALUE_TRUE.c_str()));
+  cdmKeyStatus.persist_allowed = true;
+  expectedLicenseStatus.add(String8(QUERY_KEY_PERSIST_ALLOWED.c_str()),
+                            String8(QUERY_VALUE_TRUE.c_str()));
+  cdmKeyStatus.renew_allowed = false;
+  expectedLicenseStatus.add(String8(QUERY_KEY_RENEW_ALLOWED.c_str()),
+                            String8(QUERY_VALUE_FALSE.c_str()));
+  cdmKeyStatus.license_duration_remaining = 604800;
+  expectedLicenseStatus.add(
+      String8(QUERY_KEY_LICENSE_DURATION_REMAINING.c_str()),
+      String8("604800"));
+  cdmKeyStatus.playback_duration_remaining = 42;
+  expectedLicenseStatus.add(
+      String8(QUERY_KEY_PLAYBACK_DURATION_REMAINING.c_str()),
+      String8("42"));
+  cdmKeyStatus.renewal_server_url = kRenewalServerUrl;
+  expectedLicenseStatus.add(String8(QUERY_KEY_RENEWAL_SERVER_URL.c_str()),
+                            String8(kRenewalServerUrl));
+
+  EXPECT_CALL(cdm, QueryKeyStatus(cdmSessionId, A<CdmKeyStatus*>()))
+      .WillOnce(DoAll(SetArgPointee<1>(cdmKeyStatus),
                       Return(wvcdm::NO_ERROR)));
 
   KeyedVector<String8, String8> licenseStatus;
@@ -1035,6 +1056,79 @@ TEST_F(WVDrmPluginTest, CallsGenericVerify) {
   EXPECT_FALSE(match);
 }
 
+TEST_F(WVDrmPluginTest, SelectsKeyForEachOperation) {
+  StrictMock<MockCDM> cdm;
+  StrictMock<MockCrypto> crypto;
+  WVDrmPlugin plugin(&cdm, &crypto);
+
+  static const size_t kDataSize = 64;
+  uint8_t keyIdRaw[KEY_ID_SIZE];
+  uint8_t inputRaw[kDataSize];
+  uint8_t ivRaw[KEY_IV_SIZE];
+
+  FILE* fp = fopen("/dev/urandom", "r");
+  fread(keyIdRaw, sizeof(uint8_t), KEY_ID_SIZE, fp);
+  fread(inputRaw, sizeof(uint8_t), kDataSize, fp);
+  fread(ivRaw, sizeof(uint8_t), KEY_IV_SIZE, fp);
+  fclose(fp);
+
+  Vector<uint8_t> keyId;
+  keyId.appendArray(keyIdRaw, KEY_ID_SIZE);
+  Vector<uint8_t> input;
+  input.appendArray(inputRaw, kDataSize);
+  Vector<uint8_t> iv;
+  iv.appendArray(ivRaw, KEY_IV_SIZE);
+  Vector<uint8_t> output;
+
+  {
+    InSequence calls;
+
+    // The CDM selects keys on the same OEMCrypto session when decrypting
+    // content, so the key is selected again even when it is unchanged
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_CALL(crypto, selectKey(4, _, KEY_ID_SIZE))
+          .With(Args<1, 2>(ElementsAreArray(keyIdRaw, KEY_ID_SIZE)))
+          .Times(1);
+
+      EXPECT_CALL(crypto, encrypt(4, _, kDataSize, IsIV(ivRaw),
+                                  OEMCrypto_AES_CBC_128_NO_PADDING, _))
+          .Times(1);
+    }
+  }
+
+  // Provide expected behavior to support session creation
+  EXPECT_CALL(cdm, OpenSession(StrEq("com.widevine"), _, _))
+      .Times(AtLeast(1))
+      .WillRepeatedly(DoAll(SetArgPointee<2>(cdmSessionId),
+                            Return(wvcdm::NO_ERROR)));
+
+  EXPECT_CALL(cdm, QueryKeyControlInfo(cdmSessionId, _))
+      .Times(AtLeast(1))
+      .WillRepeatedly(Invoke(setSessionIdOnMap<4>));
+
+  // Let gMock know these calls will happen but we aren't interested in them.
+  EXPECT_CALL(cdm, AttachEventListener(_, _))
+      .Times(AtLeast(0));
+
+  EXPECT_CALL(cdm, DetachEventListener(_, _))
+      .Times(AtLeast(0));
+
+  EXPECT_CALL(cdm, CloseSession(_))
+      .Times(AtLeast(0));
+
+  status_t res = plugin.openSession(sessionId);
+  ASSERT_EQ(OK, res);
+
+  res = plugin.setCipherAlgorithm(sessionId, String8("AES/CBC/NoPadding"));
+  ASSERT_EQ(OK, res);
+
+  res = plugin.encrypt(sessionId, keyId, input, iv, output);
+  ASSERT_EQ(OK, res);
+
+  res = plugin.encrypt(sessionId, keyId, input, iv, output);
+  ASSERT_EQ(OK, res);
+}
+
 TEST_F(WVDrmPluginTest, RegistersForEvents) {
   StrictMock<MockCDM> cdm;
   StrictMock<MockCrypto> crypto;
@@ -38,6 +38,17 @@ void ctr128_inc(uint8_t* counter) {
     if (++counter[--n] != 0) return;
   } while (n>8);
 }
+// Seconds on a clock that wall clock changes do not move. Key durations
+// are checked for each sample, so the coarse clock is used when available.
+time_t monotonic_seconds() {
+  struct timespec ts;
+  ts.tv_sec = ts.tv_nsec = 0;
+#if defined(CLOCK_MONOTONIC_COARSE)
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) return ts.tv_sec;
+#endif
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
 void dump_openssl_error() {
   while (unsigned long err = ERR_get_error()) {
     char buffer[120];
@@ -232,10 +243,8 @@ bool SessionContext::GenerateSignature(const uint8_t* message,
     return false;
   }
 
-  unsigned int md_len = *signature_length;
-  if (HMAC(EVP_sha256(), &mac_key_client_[0], SHA256_DIGEST_LENGTH,
-           message, message_length, signature, &md_len)) {
-    *signature_length = md_len;
+  if (mac_hmac_client_.Sign(message, message_length, signature)) {
+    *signature_length = SHA256_DIGEST_LENGTH;
     return true;
   }
   return false;
@@ -305,18 +314,14 @@ bool SessionContext::ValidateMessage(const uint8_t* given_message,
   if (signature_length != SHA256_DIGEST_LENGTH) {
     return false;
   }
-  uint8_t computed_signature[SHA256_DIGEST_LENGTH];
-  unsigned int md_len = SHA256_DIGEST_LENGTH;
-  if (!HMAC(EVP_sha256(), &mac_key_server_[0], SHA256_DIGEST_LENGTH,
-            given_message, message_length, computed_signature, &md_len)) {
+  if (!mac_hmac_server_.valid()) {
     LOGE("ValidateMessage: Could not compute signature.");
     return false;
   }
-  if (memcmp(given_signature, computed_signature, signature_length)) {
+  if (!mac_hmac_server_.Verify(given_message, message_length,
+                               given_signature, signature_length)) {
     LOGE("Invalid signature    given: %s",
          wvcdm::HexEncode(given_signature, signature_length).c_str());
-    LOGE("Invalid signature computed: %s",
-         wvcdm::HexEncode(computed_signature, signature_length).c_str());
     return false;
   }
   return true;
@@ -380,12 +385,11 @@ bool SessionContext::ParseKeyControl(
 }
 
 void SessionContext::StartTimer() {
-  timer_start_ = time(NULL);
+  timer_start_ = monotonic_seconds();
 }
 
 uint32_t SessionContext::CurrentTimer() {
-  time_t now = time(NULL);
-  return now - timer_start_;
+  return monotonic_seconds() - timer_start_;
 }
 
 bool SessionContext::InstallKey(const KeyId& key_id,
@@ -670,10 +674,9 @@ bool SessionContext::Generic_Sign(const uint8_t* in_buffer,
     LOGE("[Generic_Sign(): bad algorithm.");
     return false;
   }
-  unsigned int md_len = *signature_length;
-  if (HMAC(EVP_sha256(), &key[0], SHA256_DIGEST_LENGTH,
-           in_buffer, buffer_length, signature, &md_len)) {
-    *signature_length = md_len;
+  if (current_content_key()->hmac().Sign(in_buffer, buffer_length,
+                                         signature)) {
+    *signature_length = SHA256_DIGEST_LENGTH;
     return true;
   }
   LOGE("[Generic_Sign(): hmac failed.");
@@ -714,15 +717,12 @@ bool SessionContext::Generic_Verify(const uint8_t* in_buffer,
     LOGE("[Generic_Verify(): bad algorithm.");
     return false;
   }
-  unsigned int md_len = signature_length;
-  uint8_t computed_signature[SHA256_DIGEST_LENGTH];
-  if (HMAC(EVP_sha256(), &key[0], SHA256_DIGEST_LENGTH,
-           in_buffer, buffer_length, computed_signature, &md_len)) {
-    return (0 == memcmp( signature, computed_signature, SHA256_DIGEST_LENGTH));
+  if (!current_content_key()->hmac().valid()) {
+    LOGE("[Generic_Verify(): HMAC failed.");
+    return false;
   }
-  LOGE("[Generic_Verify(): HMAC failed.");
-  dump_openssl_error();
-  return false;
+  return current_content_key()->hmac().Verify(in_buffer, buffer_length,
+                                              signature, signature_length);
 }
 
 bool SessionContext::RefreshKey(const KeyId& key_id,
@@ -792,10 +792,10 @@ bool SessionContext::UpdateMacKeys(const std::vector<uint8_t>& enc_mac_keys,
                            enc_mac_keys, &mac_keys)) {
     return false;
   }
-  mac_key_server_ = std::vector<uint8_t>(mac_keys.begin(),
-                                         mac_keys.begin()+wvcdm::MAC_KEY_SIZE);
-  mac_key_client_ = std::vector<uint8_t>(mac_keys.begin()+wvcdm::MAC_KEY_SIZE,
-                                         mac_keys.end());
+  set_mac_key_server(std::vector<uint8_t>(
+      mac_keys.begin(), mac_keys.begin() + wvcdm::MAC_KEY_SIZE));
+  set_mac_key_client(std::vector<uint8_t>(
+      mac_keys.begin() + wvcdm::MAC_KEY_SIZE, mac_keys.end()));
   return true;
 }
 
@@ -165,12 +165,16 @@ class SessionContext {
                      const std::vector<uint8_t>& iv);
   bool SelectContentKey(const KeyId& key_id);
   const Key* current_content_key(void) {return current_content_key_;}
+  // The HMAC states for the MAC keys are built as the keys are installed.
   void set_mac_key_server(const std::vector<uint8_t>& mac_key_server) {
     mac_key_server_ = mac_key_server;
+    mac_hmac_server_.Init(mac_key_server_);
   }
   const std::vector<uint8_t>& mac_key_server() { return mac_key_server_; }
   void set_mac_key_client(const std::vector<uint8_t>& mac_key_client) {
-    mac_key_client_ = mac_key_client; }
+    mac_key_client_ = mac_key_client;
+    mac_hmac_client_.Init(mac_key_client_);
+  }
   const std::vector<uint8_t>& mac_key_client() { return mac_key_client_; }
 
   void set_encryption_key(const std::vector<uint8_t>& enc_key) {
@@ -192,6 +196,8 @@ class SessionContext {
   SessionId id_;
   std::vector<uint8_t> mac_key_server_;
   std::vector<uint8_t> mac_key_client_;
+  HmacSha256 mac_hmac_server_;
+  HmacSha256 mac_hmac_client_;
   std::vector<uint8_t> encryption_key_;
   std::vector<uint8_t> session_key_;
   const Key* current_content_key_;
@@ -11,10 +11,68 @@
 #include <cstring>
 
 #include "log.h"
+#include "openssl/crypto.h"
 #include "wv_cdm_constants.h"
 
 namespace wvoec_mock {
 
+bool HmacSha256::Init(const std::vector<uint8_t>& key) {
+  Clear();
+  if (key.empty()) return false;
+
+  // Keys longer than a block are hashed first, as RFC 2104 requires.
+  uint8_t key_block[SHA256_CBLOCK];
+  memset(key_block, 0, sizeof(key_block));
+  if (key.size() > SHA256_CBLOCK) {
+    SHA256(&key[0], key.size(), key_block);
+  } else {
+    memcpy(key_block, &key[0], key.size());
+  }
+
+  uint8_t pad[SHA256_CBLOCK];
+  for (size_t i = 0; i < SHA256_CBLOCK; ++i) pad[i] = key_block[i] ^ 0x36;
+  bool ok = SHA256_Init(&inner_) && SHA256_Update(&inner_, pad, sizeof(pad));
+  for (size_t i = 0; i < SHA256_CBLOCK; ++i) pad[i] = key_block[i] ^ 0x5c;
+  ok = ok && SHA256_Init(&outer_) && SHA256_Update(&outer_, pad, sizeof(pad));
+
+  OPENSSL_cleanse(key_block, sizeof(key_block));
+  OPENSSL_cleanse(pad, sizeof(pad));
+  valid_ = ok;
+  return valid_;
+}
+
+void HmacSha256::Clear() {
+  OPENSSL_cleanse(&inner_, sizeof(inner_));
+  OPENSSL_cleanse(&outer_, sizeof(outer_));
+  valid_ = false;
+}
+
+bool HmacSha256::Sign(const uint8_t* message, size_t message_length,
+                      uint8_t* signature) const {
+  if (!valid_) return false;
+
+  uint8_t inner_digest[SHA256_DIGEST_LENGTH];
+  SHA256_CTX ctx = inner_;
+  if (!SHA256_Update(&ctx, message, message_length) ||
+      !SHA256_Final(inner_digest, &ctx)) {
+    return false;
+  }
+  ctx = outer_;
+  return SHA256_Update(&ctx, inner_digest, sizeof(inner_digest)) &&
+         SHA256_Final(signature, &ctx);
+}
+
+bool HmacSha256::Verify(const uint8_t* message, size_t message_length,
+                        const uint8_t* signature,
+                        size_t signature_length) const {
+  uint8_t computed_signature[SHA256_DIGEST_LENGTH];
+  if (signature_length < SHA256_DIGEST_LENGTH ||
+      !Sign(message, message_length, computed_signature)) {
+    return false;
+  }
+  return memcmp(signature, computed_signature, SHA256_DIGEST_LENGTH) == 0;
+}
+
 bool KeyControlBlock::Validate() {
   valid_ = false;
   if (0x6b63746c != verification_) {  // kctl.
@@ -69,6 +127,7 @@ Key::Key(KeyType ktype, const std::vector<uint8_t>& key_string,
   valid_(true), type_(ktype),
   value_(key_string), has_control_(true),
   control_(control) {
+  if (value_.size() == SHA256_DIGEST_LENGTH) hmac_.Init(value_);
 }
 
 bool Key::setValue(const char* key_string, size_t key_string_length) {
@@ -78,6 +137,11 @@ bool Key::setValue(const char* key_string, size_t key_string_length) {
   }
 
   value_.assign(key_string, key_string + key_string_length);
+  if (value_.size() == SHA256_DIGEST_LENGTH) {
+    hmac_.Init(value_);
+  } else {
+    hmac_.Clear();
+  }
 
   if (isValidType() && has_control_) {
     valid_ = true;
@@ -13,6 +13,8 @@
 #include <string>
 #include <vector>
 
+#include "openssl/sha.h"
+
 namespace wvoec_mock {
 
 enum KeyType {
@@ -69,6 +71,31 @@ class KeyControlBlock {
   uint32_t control_bits_;
 };
 
+// HMAC-SHA256 with the key padding already run through the inner and outer
+// hashes. One-shot HMAC() redoes that for every message; here each message
+// only copies the two states.
+class HmacSha256 {
+ public:
+  HmacSha256() : valid_(false) {}
+  ~HmacSha256() { Clear(); }
+
+  bool Init(const std::vector<uint8_t>& key);
+  // Wipes the key dependent hash states
+  void Clear();
+  bool valid() const { return valid_; }
+
+  // |signature| must hold SHA256_DIGEST_LENGTH bytes.
+  bool Sign(const uint8_t* message, size_t message_length,
+            uint8_t* signature) const;
+  bool Verify(const uint8_t* message, size_t message_length,
+              const uint8_t* signature, size_t signature_length) const;
+
+ private:
+  bool valid_;
+  SHA256_CTX inner_;
+  SHA256_CTX outer_;
+};
+
 // AES-128 crypto key
 class Key {
  public:
@@ -76,7 +103,8 @@ class Key {
   Key(const Key& key) : valid_(key.valid_), type_(key.type_),
     value_(key.value_),
     has_control_(key.has_control_),
-    control_(key.control_) {}
+    control_(key.control_),
+    hmac_(key.hmac_) {}
   Key(KeyType type, const std::vector<uint8_t>& key_string,
       const KeyControlBlock& control);
 
@@ -91,6 +119,8 @@ class Key {
   KeyType keyType() { return type_; }
   const std::vector<uint8_t>& value() const { return value_; }
   const KeyControlBlock& control() const { return control_; }
+  // Valid for keys that are the size of an HMAC-SHA256 key.
+  const HmacSha256& hmac() const { return hmac_; }
 
   bool isDeviceKey() { return (KEYTYPE_DEVICE == type_); }
   bool isRootKey() { return (KEYTYPE_ROOT == type_); }
@@ -106,7 +136,7 @@ class Key {
   }
   bool isValid() { return valid_; }
 
-  void clear() { value_.clear(); valid_ = false; }
+  void clear() { value_.clear(); hmac_.Clear(); valid_ = false; }
 
  private:
   bool valid_;
@@ -114,6 +144,7 @@ class Key {
   std::vector<uint8_t> value_;
   bool has_control_;
   KeyControlBlock control_;
+  HmacSha256 hmac_;
 };
 
 };   // namespace wvoec_eng
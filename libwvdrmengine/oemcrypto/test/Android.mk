@@ -37,3 +37,38 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_MODULE:=oemcrypto_test
 
 include $(BUILD_EXECUTABLE)
+
+# HMAC-SHA256 of the mock keys, built from the mock sources:
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+  oemcrypto_key_mock_unittest.cpp \
+  ../mock/src/oemcrypto_key_mock.cpp \
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES += \
+  bionic \
+  external/gtest/include \
+  external/openssl/include \
+  external/stlport/stlport \
+  $(LOCAL_PATH)/../include \
+  $(LOCAL_PATH)/../mock/src \
+  vendor/widevine/libwvdrmengine/cdm/core/include \
+  vendor/widevine/libwvdrmengine/third_party/stringencoders/src \
+
+LOCAL_STATIC_LIBRARIES := \
+  libgtest \
+  libgtest_main \
+  libcdm_utils \
+
+LOCAL_SHARED_LIBRARIES := \
+  libcrypto \
+  libcutils \
+  liblog \
+  libstlport \
+  libutils \
+
+LOCAL_MODULE:=oemcrypto_key_mock_unittest
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,137 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+
+#include "oemcrypto_key_mock.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "openssl/sha.h"
+#include "string_conversions.h"
+
+namespace {
+
+// HMAC-SHA256 test cases of RFC 4231, section 4. Test case 5, which
+// truncates the output, is left out.
+struct HmacTestCase {
+  size_t key_size;
+  const char* key_hex;  // NULL when the key repeats |key_byte|
+  uint8_t key_byte;
+  size_t data_size;
+  const char* data;  // NULL when the data repeats |data_byte|
+  uint8_t data_byte;
+  const char* mac_hex;
+};
+
+const HmacTestCase kRfc4231TestCases[] = {
+  // Test case 1
+  { 20, NULL, 0x0b, 8, "Hi There", 0,
+    "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" },
+  // Test case 2, a key shorter than the output
+  { 4, "4a656665", 0, 28, "what do ya want for nothing?", 0,
+    "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" },
+  // Test case 3
+  { 20, NULL, 0xaa, 50, NULL, 0xdd,
+    "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe" },
+  // Test case 4
+  { 25, "0102030405060708090a0b0c0d0e0f10111213141516171819", 0, 50, NULL,
+    0xcd,
+    "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b" },
+  // Test case 6, a key longer than a block
+  { 131, NULL, 0xaa, 54,
+    "Test Using Larger Than Block-Size Key - Hash Key First", 0,
+    "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" },
+  // Test case 7, a key and data longer than a block
+  { 131, NULL, 0xaa, 152,
+    "This is a test using a larger than block-size key and a larger than "
+    "block-size data. The key needs to be hashed before being used by the "
+    "HMAC algorithm.", 0,
+    "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2" },
+};
+
+std::vector<uint8_t> TestCaseKey(const HmacTestCase& test_case) {
+  if (test_case.key_hex == NULL)
+    return std::vector<uint8_t>(test_case.key_size, test_case.key_byte);
+  return wvcdm::a2b_hex(test_case.key_hex);
+}
+
+std::vector<uint8_t> TestCaseData(const HmacTestCase& test_case) {
+  if (test_case.data == NULL)
+    return std::vector<uint8_t>(test_case.data_size, test_case.data_byte);
+  return std::vector<uint8_t>(test_case.data,
+                              test_case.data + test_case.data_size);
+}
+
+}  // namespace
+
+namespace wvoec_mock {
+
+class HmacSha256Test : public ::testing::TestWithParam<HmacTestCase> {};
+
+TEST_P(HmacSha256Test, SignsKnownAnswer) {
+  const HmacTestCase& test_case = GetParam();
+  std::vector<uint8_t> key = TestCaseKey(test_case);
+  ASSERT_EQ(test_case.key_size, key.size());
+  std::vector<uint8_t> data = TestCaseData(test_case);
+
+  HmacSha256 hmac;
+  ASSERT_TRUE(hmac.Init(key));
+  std::vector<uint8_t> signature(SHA256_DIGEST_LENGTH);
+  ASSERT_TRUE(hmac.Sign(&data[0], data.size(), &signature[0]));
+  EXPECT_EQ(wvcdm::a2b_hex(test_case.mac_hex), signature);
+
+  // The precomputed states are left untouched by signing
+  std::vector<uint8_t> again(SHA256_DIGEST_LENGTH);
+  ASSERT_TRUE(hmac.Sign(&data[0], data.size(), &again[0]));
+  EXPECT_EQ(signature, again);
+}
+
+TEST_P(HmacSha256Test, VerifiesKnownAnswer) {
+  const HmacTestCase& test_case = GetParam();
+  std::vector<uint8_t> data = TestCaseData(test_case);
+  std::vector<uint8_t> mac = wvcdm::a2b_hex(test_case.mac_hex);
+
+  HmacSha256 hmac;
+  ASSERT_TRUE(hmac.Init(TestCaseKey(test_case)));
+  EXPECT_TRUE(hmac.Verify(&data[0], data.size(), &mac[0], mac.size()));
+
+  EXPECT_FALSE(hmac.Verify(&data[0], data.size(), &mac[0], mac.size() - 1));
+  mac[mac.size() - 1] ^= 0x01;
+  EXPECT_FALSE(hmac.Verify(&data[0], data.size(), &mac[0], mac.size()));
+}
+
+INSTANTIATE_TEST_CASE_P(Rfc4231, HmacSha256Test,
+                        ::testing::ValuesIn(kRfc4231TestCases));
+
+TEST(HmacSha256UninitializedTest, RejectsEmptyKey) {
+  HmacSha256 hmac;
+  EXPECT_FALSE(hmac.Init(std::vector<uint8_t>()));
+  EXPECT_FALSE(hmac.valid());
+
+  uint8_t buffer[SHA256_DIGEST_LENGTH] = {0};
+  EXPECT_FALSE(hmac.Sign(buffer, sizeof(buffer), buffer));
+  EXPECT_FALSE(hmac.Verify(buffer, sizeof(buffer), buffer, sizeof(buffer)));
+}
+
+TEST(HmacSha256ClearTest, ClearInvalidates) {
+  const HmacTestCase& test_case = kRfc4231TestCases[0];
+  std::vector<uint8_t> data = TestCaseData(test_case);
+  std::vector<uint8_t> signature(SHA256_DIGEST_LENGTH);
+
+  HmacSha256 hmac;
+  ASSERT_TRUE(hmac.Init(TestCaseKey(test_case)));
+  hmac.Clear();
+  EXPECT_FALSE(hmac.valid());
+  EXPECT_FALSE(hmac.Sign(&data[0], data.size(), &signature[0]));
+
+  // A failed Init leaves no usable key behind
+  ASSERT_TRUE(hmac.Init(TestCaseKey(test_case)));
+  EXPECT_FALSE(hmac.Init(std::vector<uint8_t>()));
+  EXPECT_FALSE(hmac.Sign(&data[0], data.size(), &signature[0]));
+
+  ASSERT_TRUE(hmac.Init(TestCaseKey(test_case)));
+  ASSERT_TRUE(hmac.Sign(&data[0], data.size(), &signature[0]));
+  EXPECT_EQ(wvcdm::a2b_hex(test_case.mac_hex), signature);
+}
+
+}  // namespace wvoec_mock
@@ -9,6 +9,7 @@ echo "waiting for device"
 adb root && adb wait-for-device remount && adb sync
 
 adb shell /system/bin/oemcrypto_test
+adb shell /system/bin/oemcrypto_key_mock_unittest
 adb shell /system/bin/request_license_test
 adb shell /system/bin/request_license_test -icp --gtest_filter=WvCdmRequestLicenseTest.DISABLED_PrivacyModeTest --gtest_also_run_disabled_tests
 adb shell /system/bin/request_license_test -icp --gtest_filter=WvCdmRequestLicenseTest.DISABLED_PrivacyModeWithServiceCertificateTest --gtest_also_run_disabled_tests
@@ -16,8 +17,13 @@ adb shell /system/bin/policy_engine_unittest
 adb shell /system/bin/libwvdrmmediacrypto_test
 adb shell /system/bin/libwvdrmdrmplugin_test
 adb shell /system/bin/cdm_engine_test
+adb shell /system/bin/crypto_session_pool_unittest
+adb shell /system/bin/crypto_session_unittest
 adb shell /system/bin/file_store_unittest
 adb shell /system/bin/device_files_unittest
+adb shell /system/bin/event_dispatcher_unittest
+adb shell /system/bin/message_cache_unittest
+adb shell /system/bin/service_certificate_cache_unittest
 adb shell /system/bin/timer_unittest
 adb shell LD_LIBRARY_PATH=/system/vendor/lib/mediadrm/ /system/bin/libwvdrmengine_test
 
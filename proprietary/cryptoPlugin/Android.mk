@@ -16,3 +16,6 @@ LOCAL_MODULE:= libwvdecryptcommon
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_STATIC_LIBRARY)
+
+# invoke Android.mk files in subdirs
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -44,8 +44,11 @@ const uint8_t WVCryptoFactory::kUUIDWidevine[16] = {
 };
 
 WVCryptoPlugin::WVCryptoPlugin(const void *data, size_t size)
-    : mInitCheck(NO_INIT)
+    : mInitCheck(NO_INIT),
+      mKeyCacheClock(0)
 {
+    memset(mKeyCache, 0, sizeof(mKeyCache));
+
     // not using data at this time, require
     // size to be zero.
     if (size > 0) {
@@ -59,11 +62,34 @@ WVCryptoPlugin::WVCryptoPlugin(const void *data, size_t size)
             ALOGE("OEMCrypto_Initialize failed: %d", res);
             mInitCheck = -EINVAL;
         }
+#else
+        // The device key only depends on the serial number, derive it once
+        uint8_t hash[MD5_DIGEST_LENGTH];
+        char value[PROPERTY_VALUE_MAX] = {0};
+        char seed[] = "34985woeirsdlkfjxc";
+
+        property_get("ro.serialno", value, NULL);
+
+        MD5_CTX ctx;
+        MD5_Init(&ctx);
+        MD5_Update(&ctx, (uint8_t *)seed, sizeof(seed));
+        MD5_Update(&ctx, (uint8_t *)value, strlen(value));
+        MD5_Final(hash, &ctx);
+
+        if (AES_set_decrypt_key(hash, sizeof(hash) * 8, &mDeviceKey) != 0) {
+            ALOGE("unable to set up the device key");
+            mInitCheck = -EINVAL;
+        }
 #endif
     }
 }
 
 WVCryptoPlugin::~WVCryptoPlugin() {
+    for (size_t i = 0; i < kKeyCacheSize; ++i) {
+        if (mKeyCache[i].mCipher != NULL) {
+            EVP_CIPHER_CTX_free(mKeyCache[i].mCipher);
+        }
+    }
 
 #ifdef REQUIRE_SECURE_BUFFERS
     if (mInitCheck == OK) {
@@ -87,6 +113,29 @@ bool WVCryptoPlugin::requiresSecureDecoderComponent(const char *mime) const {
 #endif
 }
 
+#ifndef REQUIRE_SECURE_BUFFERS
+namespace {
+
+struct ScopedCipherCtx {
+    ScopedCipherCtx() : mCtx(EVP_CIPHER_CTX_new()) {}
+    ~ScopedCipherCtx() {
+        if (mCtx != NULL) {
+            EVP_CIPHER_CTX_free(mCtx);
+        }
+    }
+
+    EVP_CIPHER_CTX *get() const { return mCtx; }
+
+private:
+    EVP_CIPHER_CTX *mCtx;
+
+    ScopedCipherCtx(const ScopedCipherCtx &);
+    ScopedCipherCtx &operator=(const ScopedCipherCtx &);
+};
+
+}  // namespace
+#endif
+
 // Returns negative values for error code and
 // positive values for the size of decrypted data, which can be larger
 // than the input length.
@@ -99,11 +148,27 @@ ssize_t WVCryptoPlugin::decrypt(
         const SubSample *subSamples, size_t numSubSamples,
         void *dstPtr,
         AString *errorDetailMsg) {
+#ifdef REQUIRE_SECURE_BUFFERS
     Mutex::Autolock autoLock(mLock);
-
+#endif
 
     CHECK(mode == kMode_Unencrypted || mode == kMode_AES_WV);
 
+#ifndef REQUIRE_SECURE_BUFFERS
+    // All subsamples share the key, set up the cipher once per call
+    ScopedCipherCtx cipher;
+    if (mode != kMode_Unencrypted) {
+        if (cipher.get() == NULL) {
+            return -ENOMEM;
+        }
+        status_t status = getCipher(key, cipher.get());
+        if (status != OK) {
+            ALOGE("unable to set up the content key: %d", status);
+            return status;
+        }
+    }
+#endif
+
     size_t srcOffset = 0;
     size_t dstOffset = 0;
     for (size_t i = 0; i < numSubSamples; ++i) {
@@ -167,10 +232,10 @@ ssize_t WVCryptoPlugin::decrypt(
         if (mode == kMode_Unencrypted) {
             memcpy((char *)dstPtr + dstOffset, (char *)srcPtr + srcOffset, srcSize);
         } else {
-            status_t status = decryptSW(key, (uint8_t *)dstPtr + dstOffset,
-                                        (const uint8_t *)srcPtr + srcOffset, srcSize);
+            status_t status = decryptCTS(cipher.get(), (uint8_t *)dstPtr + dstOffset,
+                                         (const uint8_t *)srcPtr + srcOffset, srcSize);
             if (status != OK) {
-                ALOGE("decryptSW returned %d", status);
+                ALOGE("decryptCTS returned %d", status);
                 return status;
             }
         }
@@ -183,40 +248,90 @@ ssize_t WVCryptoPlugin::decrypt(
     return static_cast<ssize_t>(dstOffset);
 }
 
-// SW AES CTS decrypt, used only for L3 devices
-status_t WVCryptoPlugin::decryptSW(const uint8_t *key, uint8_t *out,
-                                   const uint8_t *in, size_t length)
+// Sets up |ctx| for the content key encrypted as |key|, deriving the key
+// schedule when it is not cached. The schedule is copied into the caller's
+// context so it can decrypt without holding the lock.
+status_t WVCryptoPlugin::getCipher(const uint8_t *key, EVP_CIPHER_CTX *ctx)
 {
-#ifndef REQUIRE_SECURE_BUFFERS
-    unsigned char iv[kAES128BlockSize] = {0};
+    {
+        Mutex::Autolock autoLock(mLock);
+        for (size_t i = 0; i < kKeyCacheSize; ++i) {
+            KeyCacheEntry &entry = mKeyCache[i];
+            if (entry.mValid &&
+                    memcmp(key, entry.mEncKey, sizeof(entry.mEncKey)) == 0) {
+                entry.mLastUse = ++mKeyCacheClock;
+                return EVP_CIPHER_CTX_copy(ctx, entry.mCipher) ? OK : -ENOMEM;
+            }
+        }
+    }
 
-    if (memcmp(key, mEncKey, sizeof(mEncKey)) != 0) {
-        // key has changed, recompute mAesKey from key
-        uint8_t hash[MD5_DIGEST_LENGTH];
-        char value[PROPERTY_VALUE_MAX] = {0};
-        char seed[] = "34985woeirsdlkfjxc";
+    status_t status = deriveCipher(key, ctx);
+    if (status != OK) {
+        return status;
+    }
 
-        property_get("ro.serialno", value, NULL);
+    Mutex::Autolock autoLock(mLock);
+    KeyCacheEntry *victim = &mKeyCache[0];
+    for (size_t i = 0; i < kKeyCacheSize; ++i) {
+        KeyCacheEntry &entry = mKeyCache[i];
+        if (entry.mValid &&
+                memcmp(key, entry.mEncKey, sizeof(entry.mEncKey)) == 0) {
+            // derived by another thread meanwhile
+            return OK;
+        }
+        if (!entry.mValid) {
+            victim = &entry;
+        } else if (victim->mValid && entry.mLastUse < victim->mLastUse) {
+            victim = &entry;
+        }
+    }
+    if (victim->mCipher == NULL) {
+        victim->mCipher = EVP_CIPHER_CTX_new();
+    }
+    victim->mValid = victim->mCipher != NULL &&
+            EVP_CIPHER_CTX_copy(victim->mCipher, ctx);
+    victim->mLastUse = ++mKeyCacheClock;
+    memcpy(victim->mEncKey, key, sizeof(victim->mEncKey));
+    return OK;
+}
 
-        MD5_CTX ctx;
-        MD5_Init(&ctx);
-        MD5_Update(&ctx, (uint8_t *)seed, sizeof(seed));
-        MD5_Update(&ctx, (uint8_t *)value, strlen(value));
-        MD5_Final(hash, &ctx);
+status_t WVCryptoPlugin::deriveCipher(const uint8_t *key, EVP_CIPHER_CTX *ctx) const
+{
+    uint8_t clearKey[kAES128BlockSize];
+    AES_ecb_encrypt(key, clearKey, &mDeviceKey, 0);
+
+    status_t status = OK;
+    if (!EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, clearKey, NULL) ||
+            !EVP_CIPHER_CTX_set_padding(ctx, 0)) {
+        status = -EINVAL;
+    }
+    memset(clearKey, 0, sizeof(clearKey));
+    return status;
+}
 
-        AES_KEY aesKey;
-        if (AES_set_decrypt_key(hash, sizeof(hash) * 8, &aesKey) == 0) {
-            uint8_t clearKey[kAES128BlockSize];
-            AES_ecb_encrypt(key, clearKey, &aesKey, 0);
+// Runs |length| bytes, a multiple of the block size, through the cipher.
+// The EVP interface picks the AES-NI or ARMv8 crypto extension CBC routines
+// when the CPU has them, these decrypt several blocks in parallel.
+// static
+status_t WVCryptoPlugin::cbcDecrypt(EVP_CIPHER_CTX *ctx, const uint8_t *iv,
+                                    uint8_t *out, const uint8_t *in, size_t length)
+{
+    int outLength = 0;
+    if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
+            !EVP_DecryptUpdate(ctx, out, &outLength, in, length) ||
+            (size_t)outLength != length) {
+        return -EINVAL;
+    }
+    return OK;
+}
 
-            if (AES_set_decrypt_key(clearKey, sizeof(hash) * 8, &mAesKey) == 0) {
-                memcpy(mEncKey, key, sizeof(mEncKey));
-            } else {
-                return -EINVAL;
-            }
-        } else {
-            return -EINVAL;
-        }
+// SW AES CTS decrypt, used only for L3 devices
+// static
+status_t WVCryptoPlugin::decryptCTS(EVP_CIPHER_CTX *ctx, uint8_t *out,
+                                    const uint8_t *in, size_t length)
+{
+    if (length < kAES128BlockSize) {
+        return -EINVAL;
     }
 
     size_t k, r = length % kAES128BlockSize;
@@ -227,25 +342,36 @@ status_t WVCryptoPlugin::decryptSW(const uint8_t *key, uint8_t *out,
         k = length;
     }
 
-    AES_cbc_encrypt(in, out, k, &mAesKey, iv, 0);
+    // The tail is chained to the last block of the bulk, which in-place
+    // decryption overwrites
+    uint8_t iv[kAES128BlockSize] = {0};
+    if (r && k) {
+        memcpy(iv, in + k - kAES128BlockSize, kAES128BlockSize);
+    }
+
+    static const uint8_t zeroIv[kAES128BlockSize] = {0};
+    if (k && cbcDecrypt(ctx, zeroIv, out, in, k) != OK) {
+        return -EINVAL;
+    }
 
     if (r) {
         // cipher text stealing - Schneier Figure 9.5 p 196
-        unsigned char peniv[kAES128BlockSize] = {0};
+        uint8_t peniv[kAES128BlockSize] = {0};
         memcpy(peniv, in + k + kAES128BlockSize, r);
 
-        AES_cbc_encrypt(in + k, out + k, kAES128BlockSize, &mAesKey, peniv, 0);
+        uint8_t block[kAES128BlockSize];
+        if (cbcDecrypt(ctx, peniv, block, in + k, kAES128BlockSize) != OK) {
+            return -EINVAL;
+        }
 
         // exchange the final plaintext and ciphertext
-        for (size_t i = 0; i < r; i++) {
-            *(out + k + kAES128BlockSize + i) = *(out + k + i);
-            *(out + k + i) = *(in + k + kAES128BlockSize + i);
+        memcpy(out + k + kAES128BlockSize, block, r);
+        memcpy(block, peniv, r);
+        if (cbcDecrypt(ctx, iv, out + k, block, kAES128BlockSize) != OK) {
+            return -EINVAL;
         }
-        AES_cbc_encrypt(out + k, out + k, kAES128BlockSize, &mAesKey, iv, 0);
     }
-#endif
     return OK;
 }
 
 }  // namespace android
-
@@ -21,6 +21,7 @@
 #include <media/hardware/CryptoAPI.h>
 #include <utils/threads.h>
 #include <openssl/aes.h>
+#include <openssl/evp.h>
 
 namespace android {
 
@@ -44,14 +45,38 @@ struct WVCryptoPlugin : public CryptoPlugin {
             void *dstPtr,
             AString *errorDetailMsg);
 
-private:
-    status_t decryptSW(const uint8_t *key, uint8_t *out, const uint8_t *in, size_t length);
+    // AES-128-CBC decryption with cipher text stealing and a zero IV, as
+    // used by WVM content. |ctx| must be set up for AES-128-CBC decryption
+    // without padding. |length| must be at least one block.
+    static status_t decryptCTS(EVP_CIPHER_CTX *ctx, uint8_t *out,
+                               const uint8_t *in, size_t length);
 
+private:
+    // Number of content key schedules kept, enough for the audio and video
+    // keys of a title plus a key rotation
+    enum { kKeyCacheSize = 4 };
+
+    struct KeyCacheEntry {
+        bool mValid;
+        uint32_t mLastUse;
+        uint8_t mEncKey[kAES128BlockSize];
+        EVP_CIPHER_CTX *mCipher;
+    };
+
+    status_t getCipher(const uint8_t *key, EVP_CIPHER_CTX *ctx);
+    status_t deriveCipher(const uint8_t *key, EVP_CIPHER_CTX *ctx) const;
+    static status_t cbcDecrypt(EVP_CIPHER_CTX *ctx, const uint8_t *iv,
+                               uint8_t *out, const uint8_t *in, size_t length);
+
+    // Serializes OEMCrypto calls on L1 devices; for software decryption it
+    // only guards the key cache, so decrypts with different keys run in
+    // parallel
     Mutex mLock;
 
     status_t mInitCheck;
-    AES_KEY mAesKey;
-    uint8_t mEncKey[kAES128BlockSize];
+    AES_KEY mDeviceKey;
+    KeyCacheEntry mKeyCache[kKeyCacheSize];
+    uint32_t mKeyCacheClock;
 
     WVCryptoPlugin(const WVCryptoPlugin &);
     WVCryptoPlugin &operator=(const WVCryptoPlugin &);
@@ -0,0 +1,36 @@
+ifneq ($(filter arm x86,$(TARGET_ARCH)),)
+
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# decryptCTS is the software (L3) path, build the plugin without
+# REQUIRE_SECURE_BUFFERS
+LOCAL_SRC_FILES:= \
+    TestCryptoPlugin.cpp \
+    ../WVCryptoPlugin.cpp
+
+LOCAL_C_INCLUDES+= \
+    bionic \
+    vendor/widevine/proprietary/cryptoPlugin \
+    external/openssl/include \
+    external/stlport/stlport
+
+ifeq ($(TARGET_ARCH),x86)
+LOCAL_C_INCLUDES += $(TOP)/system/core/include/arch/linux-x86
+endif
+
+LOCAL_SHARED_LIBRARIES := \
+    libstlport                \
+    libcrypto                 \
+    libcutils                 \
+    liblog                    \
+    libutils                  \
+    libstagefright_foundation
+
+LOCAL_MODULE:=test-wvcryptoplugin
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+endif
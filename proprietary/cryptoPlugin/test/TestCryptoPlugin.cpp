@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2013 Google, Inc.  All Rights Reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <openssl/aes.h>
+#include <openssl/evp.h>
+
+#include "WVCryptoPlugin.h"
+
+using namespace android;
+
+static const size_t kBlockSize = WVCryptoPlugin::kAES128BlockSize;
+
+// RFC 3962 appendix B, AES 128 key "chicken teriyaki"
+static const uint8_t kKey[kBlockSize] = {
+    0x63, 0x68, 0x69, 0x63, 0x6b, 0x65, 0x6e, 0x20,
+    0x74, 0x65, 0x72, 0x69, 0x79, 0x61, 0x6b, 0x69
+};
+
+struct KnownAnswer {
+    size_t length;
+    uint8_t plaintext[31];
+    uint8_t ciphertext[31];
+};
+
+static const KnownAnswer kKnownAnswers[] = {
+    { 17,
+      { 0x49, 0x20, 0x77, 0x6f, 0x75, 0x6c, 0x64, 0x20,
+        0x6c, 0x69, 0x6b, 0x65, 0x20, 0x74, 0x68, 0x65,
+        0x20 },
+      { 0xc6, 0x35, 0x35, 0x68, 0xf2, 0xbf, 0x8c, 0xb4,
+        0xd8, 0xa5, 0x80, 0x36, 0x2d, 0xa7, 0xff, 0x7f,
+        0x97 } },
+    { 31,
+      { 0x49, 0x20, 0x77, 0x6f, 0x75, 0x6c, 0x64, 0x20,
+        0x6c, 0x69, 0x6b, 0x65, 0x20, 0x74, 0x68, 0x65,
+        0x20, 0x47, 0x65, 0x6e, 0x65, 0x72, 0x61, 0x6c,
+        0x20, 0x47, 0x61, 0x75, 0x27, 0x73, 0x20 },
+      { 0xfc, 0x00, 0x78, 0x3e, 0x0e, 0xfd, 0xb2, 0xc1,
+        0xd4, 0x45, 0xd4, 0xc8, 0xef, 0xf7, 0xed, 0x22,
+        0x97, 0x68, 0x72, 0x68, 0xd6, 0xec, 0xcc, 0xc0,
+        0xc0, 0x7b, 0x25, 0xe2, 0x5e, 0xcf, 0xe5 } },
+};
+
+class TestCryptoPlugin
+{
+public:
+    TestCryptoPlugin() : mCtx(NULL), mFailures(0) {}
+    ~TestCryptoPlugin() {
+        if (mCtx != NULL) {
+            EVP_CIPHER_CTX_free(mCtx);
+        }
+    }
+
+    bool Init();
+
+    // Tests
+    void KnownAnswers();
+    void MatchesReference();
+    void DecryptsInPlace();
+    void Throughput();
+
+    int failures() const { return mFailures; }
+
+private:
+    void ReferenceDecrypt(uint8_t *out, const uint8_t *in, size_t length);
+    void Fill(uint8_t *buffer, size_t length);
+    void Check(bool condition, const char *test, size_t length);
+
+    EVP_CIPHER_CTX *mCtx;
+    AES_KEY mAesKey;
+    int mFailures;
+};
+
+bool TestCryptoPlugin::Init()
+{
+    mCtx = EVP_CIPHER_CTX_new();
+    return mCtx != NULL &&
+        EVP_DecryptInit_ex(mCtx, EVP_aes_128_cbc(), NULL, kKey, NULL) &&
+        EVP_CIPHER_CTX_set_padding(mCtx, 0) &&
+        AES_set_decrypt_key(kKey, sizeof(kKey) * 8, &mAesKey) == 0;
+}
+
+// The block at a time implementation the plugin used before
+void TestCryptoPlugin::ReferenceDecrypt(uint8_t *out, const uint8_t *in,
+                                        size_t length)
+{
+    unsigned char iv[kBlockSize] = {0};
+    size_t k, r = length % kBlockSize;
+
+    if (r) {
+        k = length - r - kBlockSize;
+    } else {
+        k = length;
+    }
+
+    AES_cbc_encrypt(in, out, k, &mAesKey, iv, 0);
+
+    if (r) {
+        unsigned char peniv[kBlockSize] = {0};
+        memcpy(peniv, in + k + kBlockSize, r);
+
+        AES_cbc_encrypt(in + k, out + k, kBlockSize, &mAesKey, peniv, 0);
+
+        for (size_t i = 0; i < r; i++) {
+            *(out + k + kBlockSize + i) = *(out + k + i);
+            *(out + k + i) = *(in + k + kBlockSize + i);
+        }
+        AES_cbc_encrypt(out + k, out + k, kBlockSize, &mAesKey, iv, 0);
+    }
+}
+
+void TestCryptoPlugin::Fill(uint8_t *buffer, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        buffer[i] = rand() & 0xff;
+    }
+}
+
+void TestCryptoPlugin::Check(bool condition, const char *test, size_t length)
+{
+    if (!condition) {
+        printf("%s failed, length %zu\n", test, length);
+        ++mFailures;
+    }
+}
+
+void TestCryptoPlugin::KnownAnswers()
+{
+    printf("TestCryptoPlugin::KnownAnswers\n");
+
+    for (size_t i = 0; i < sizeof(kKnownAnswers) / sizeof(kKnownAnswers[0]); ++i) {
+        const KnownAnswer &answer = kKnownAnswers[i];
+        uint8_t out[sizeof(answer.plaintext)];
+
+        status_t status = WVCryptoPlugin::decryptCTS(mCtx, out,
+                answer.ciphertext, answer.length);
+        Check(status == OK && !memcmp(out, answer.plaintext, answer.length),
+              "KnownAnswers", answer.length);
+
+        ReferenceDecrypt(out, answer.ciphertext, answer.length);
+        Check(!memcmp(out, answer.plaintext, answer.length),
+              "KnownAnswers (reference)", answer.length);
+    }
+
+    uint8_t out[kBlockSize];
+    Check(WVCryptoPlugin::decryptCTS(mCtx, out, kKnownAnswers[0].ciphertext,
+                                     kBlockSize - 1) != OK,
+          "KnownAnswers (short)", kBlockSize - 1);
+}
+
+void TestCryptoPlugin::MatchesReference()
+{
+    printf("TestCryptoPlugin::MatchesReference\n");
+
+    const size_t kMaxLength = 70000;
+    uint8_t *in = new uint8_t[kMaxLength];
+    uint8_t *out = new uint8_t[kMaxLength];
+    uint8_t *expected = new uint8_t[kMaxLength];
+
+    // every tail length, then sizes of typical audio and video samples
+    for (size_t length = kBlockSize; length < kMaxLength;
+            length += (length < 1024) ? 1 : 997) {
+        Fill(in, length);
+        ReferenceDecrypt(expected, in, length);
+        status_t status = WVCryptoPlugin::decryptCTS(mCtx, out, in, length);
+        Check(status == OK && !memcmp(out, expected, length),
+              "MatchesReference", length);
+    }
+
+    delete[] in;
+    delete[] out;
+    delete[] expected;
+}
+
+void TestCryptoPlugin::DecryptsInPlace()
+{
+    printf("TestCryptoPlugin::DecryptsInPlace\n");
+
+    const size_t kLengths[] = { 16, 17, 31, 32, 33, 255, 256, 4096, 4111 };
+    uint8_t buffer[4111];
+    uint8_t expected[4111];
+
+    for (size_t i = 0; i < sizeof(kLengths) / sizeof(kLengths[0]); ++i) {
+        size_t length = kLengths[i];
+        Fill(buffer, length);
+        ReferenceDecrypt(expected, buffer, length);
+        status_t status = WVCryptoPlugin::decryptCTS(mCtx, buffer, buffer, length);
+        Check(status == OK && !memcmp(buffer, expected, length),
+              "DecryptsInPlace", length);
+    }
+}
+
+static double Now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void TestCryptoPlugin::Throughput()
+{
+    printf("TestCryptoPlugin::Throughput\n");
+
+    // about the size of an HD video access unit
+    const size_t kLength = 128 * 1024 + 5;
+    const int kIterations = 500;
+    uint8_t *in = new uint8_t[kLength];
+    uint8_t *out = new uint8_t[kLength];
+    Fill(in, kLength);
+
+    double start = Now();
+    for (int i = 0; i < kIterations; ++i) {
+        ReferenceDecrypt(out, in, kLength);
+    }
+    double reference = Now() - start;
+
+    start = Now();
+    for (int i = 0; i < kIterations; ++i) {
+        WVCryptoPlugin::decryptCTS(mCtx, out, in, kLength);
+    }
+    double elapsed = Now() - start;
+
+    double megabytes = (double)kLength * kIterations / (1024 * 1024);
+    printf("  block at a time: %.1f MB/s\n", megabytes / reference);
+    printf("  decryptCTS:      %.1f MB/s\n", megabytes / elapsed);
+
+    delete[] in;
+    delete[] out;
+}
+
+int main(int argc, char **argv)
+{
+    TestCryptoPlugin test;
+    if (!test.Init()) {
+        fprintf(stderr, "Unable to set up the cipher\n");
+        exit(-1);
+    }
+
+    srand(1);
+    test.KnownAnswers();
+    test.MatchesReference();
+    test.DecryptsInPlace();
+    test.Throughput();
+
+    if (test.failures()) {
+        printf("%d failures\n", test.failures());
+        exit(-1);
+    }
+    printf("Test successful!\n");
+    exit(0);
+}
@@ -186,7 +186,7 @@ void WVMExtractorImpl::Initialize()
                               WV_OutputFormat_ES, getStreamCacheSize(), mClientContext.get());
         } else {
             // No URI supplied or not adaptive, pull data from the stagefright data source.
-            mFileSource = new WVMFileSource(mDataSource);
+            mFileSource = new WVMFileSource(mDataSource, mClientContext);
             result = WV_Setup(mSession, mFileSource.get(),
                               "RAW/RAW/RAW;destination=getdata", credentials,
                               WV_OutputFormat_ES, getStreamCacheSize(), mClientContext.get());
@@ -389,6 +389,7 @@ status_t WVMExtractorImpl::readMetaData()
     mClientContext->setAudioSource(mAudioSource);
     mClientContext->setVideoSource(mVideoSource);
     mVideoSource->delegateClientContext(mClientContext);
+    mAudioSource->delegateClientContext(mClientContext);
 
     mHaveMetaData = true;
 
@@ -6,16 +6,66 @@
 #include <utils/Log.h>
 
 #include "WVMFileSource.h"
+#include "WVMMediaSource.h"
+#include "ClientContext.h"
 #include "media/stagefright/MediaErrors.h"
 #include "media/stagefright/MediaDefs.h"
 
 namespace android {
 
 
-WVMFileSource::WVMFileSource(sp<DataSource> &dataSource)
+class WVMFileSource::ReadAheadThread : public Thread {
+public:
+    ReadAheadThread(WVMFileSource *fileSource)
+        : Thread(false),
+          mFileSource(fileSource) {}
+
+private:
+    virtual bool threadLoop() { return mFileSource->readAhead(); }
+
+    WVMFileSource *mFileSource;
+
+    ReadAheadThread(const ReadAheadThread &);
+    ReadAheadThread &operator=(const ReadAheadThread &);
+};
+
+WVMFileSource::WVMFileSource(sp<DataSource> &dataSource,
+                             const sp<ClientContext> &clientContext)
     : mDataSource(dataSource),
-      mOffset(0), mLogOnce(true)
+      mClientContext(clientContext),
+      mOffset(0), mLogOnce(true),
+      mBlockData(new uint8_t[kBlockSize * kNumBlocks]),
+      mLastReadEnd(0),
+      mLastReadDirect(false),
+      mSequentialReads(0),
+      mReadAheadFrom(0),
+      mReadAheadTo(0)
+{
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+        mBlocks[i].mState = kBlockEmpty;
+        mBlocks[i].mIndex = -1;
+        mBlocks[i].mLength = 0;
+        mBlocks[i].mData = mBlockData + i * kBlockSize;
+    }
+}
+
+WVMFileSource::~WVMFileSource()
 {
+    sp<ReadAheadThread> thread;
+    {
+        Mutex::Autolock autoLock(mLock);
+        thread = mReadAheadThread;
+        mReadAheadThread.clear();
+        if (thread != NULL) {
+            thread->requestExit();
+        }
+        mReadAheadRequested.signal();
+    }
+    if (thread != NULL) {
+        thread->requestExitAndWait();
+    }
+
+    delete[] mBlockData;
 }
 
 unsigned long long WVMFileSource::GetSize()
@@ -27,30 +77,201 @@ unsigned long long WVMFileSource::GetSize()
 
 unsigned long long WVMFileSource::GetOffset()
 {
+    Mutex::Autolock autoLock(mLock);
     return mOffset;
 }
 
 void WVMFileSource::Seek(unsigned long long offset)
 {
-    mOffset = offset;
+    Mutex::Autolock autoLock(mLock);
+    if (offset != mOffset) {
+        // Stop reading ahead until reads are sequential again
+        mOffset = offset;
+        mSequentialReads = 0;
+        mReadAheadTo = mReadAheadFrom;
+    }
 }
 
 size_t WVMFileSource::Read(size_t amount, unsigned char *buffer)
 {
-    ssize_t result = mDataSource->readAt(mOffset, buffer, amount);
+    Mutex::Autolock autoLock(mLock);
 
-    if (result < 0) {
+    size_t copied = 0;
+    ssize_t result = 0;
+    off64_t refilled = -1;
+
+    bool direct = isDirectRead(amount);
+    if (direct) {
+        // Read into the caller's buffer, copying through a block would only
+        // add a copy
+        off64_t position = mOffset;
+        mLock.unlock();
+        result = mDataSource->readAt(position, buffer, amount);
+        mLock.lock();
+        if (result > 0) {
+            copied = result;
+        }
+    }
+
+    while (!direct && copied < amount) {
+        off64_t position = mOffset + copied;
+        off64_t index = position / kBlockSize;
+        Block &block = mBlocks[index % kNumBlocks];
+
+        if (block.mState == kBlockFilling) {
+            mBlockFilled.wait(mLock);
+            continue;
+        }
+
+        size_t blockOffset = position - index * kBlockSize;
+        if (block.mState != kBlockValid || block.mIndex != index ||
+                (blockOffset >= block.mLength && refilled != index)) {
+            // Not cached, or a short block that may have grown since
+            result = fillBlock(block, index);
+            if (result < 0) {
+                break;
+            }
+            refilled = index;
+            continue;
+        }
+
+        if (blockOffset >= block.mLength) {
+            break;  // end of the data
+        }
+
+        size_t length = block.mLength - blockOffset;
+        if (length > amount - copied) {
+            length = amount - copied;
+        }
+        memcpy(buffer + copied, block.mData + blockOffset, length);
+        copied += length;
+    }
+
+    if (result < 0 && copied == 0) {
         if (mLogOnce) {
             ALOGE("mDataSource-readAt returned error %d\n", (int)result );
             mLogOnce = false;
         }
-        result = 0;
-    } else  {
-        mOffset += result;
-        mLogOnce = true;
+        return 0;
+    }
+    mLogOnce = true;
+
+    if (mOffset == mLastReadEnd) {
+        ++mSequentialReads;
+    } else {
+        mSequentialReads = 0;
+    }
+    mOffset += copied;
+    mLastReadEnd = mOffset;
+    mLastReadDirect = direct;
+
+    // Only reads served from the ring benefit from reading ahead
+    if (!direct && mSequentialReads >= kSequentialReads && copied > 0) {
+        // The ring holds the block being read and the ones following it,
+        // the thread only needs waking when reading moved to a new block
+        off64_t index = mOffset / kBlockSize;
+        if (index != mReadAheadFrom || mReadAheadTo <= mReadAheadFrom) {
+            mReadAheadFrom = index;
+            mReadAheadTo = index + kNumBlocks - 1;
+            startReadAhead();
+        }
+    }
+
+    if (copied > 0 && mClientContext != NULL) {
+        mClientContext->notifyDataAvailable();
+    }
+
+    return copied;
+}
+
+// Returns true if a read of |amount| bytes at mOffset should bypass the ring.
+// That is a read of at least kBlockSize, or of at least kMinDirectRead that
+// starts on a block boundary or where the previous direct read ended, which
+// overlaps no block that is cached or being filled. Such reads gain nothing
+// from the ring but a copy. Caller must hold mLock.
+bool WVMFileSource::isDirectRead(size_t amount)
+{
+    if (amount < kMinDirectRead) {
+        return false;
+    }
+    if (amount < kBlockSize && mOffset % kBlockSize != 0 &&
+            !(mLastReadDirect && mOffset == mLastReadEnd)) {
+        return false;
+    }
+
+    off64_t first = mOffset / kBlockSize;
+    off64_t last = (mOffset + amount - 1) / kBlockSize;
+    for (off64_t index = first; index <= last; ++index) {
+        const Block &block = mBlocks[index % kNumBlocks];
+        if (block.mIndex == index && block.mState != kBlockEmpty) {
+            return false;
+        }
     }
+    return true;
+}
+
+// Reads block |index| into |block| with mLock released during the read,
+// caller must hold mLock
+ssize_t WVMFileSource::fillBlock(Block &block, off64_t index)
+{
+    block.mState = kBlockFilling;
+    block.mIndex = index;
 
+    mLock.unlock();
+    ssize_t result = mDataSource->readAt(index * kBlockSize, block.mData, kBlockSize);
+    mLock.lock();
+
+    if (result < 0) {
+        block.mState = kBlockEmpty;
+        block.mLength = 0;
+    } else {
+        block.mState = kBlockValid;
+        block.mLength = result;
+    }
+    mBlockFilled.broadcast();
     return result;
 }
 
+// Starts the read ahead thread if not running, caller must hold mLock
+void WVMFileSource::startReadAhead()
+{
+    if (mReadAheadThread == NULL) {
+        sp<ReadAheadThread> thread = new ReadAheadThread(this);
+        if (thread->run("WVMReadAhead") != OK) {
+            ALOGW("unable to start read ahead thread");
+            return;
+        }
+        mReadAheadThread = thread;
+    }
+    mReadAheadRequested.signal();
+}
+
+// Fetches the next block missing from the read ahead range, runs on the read
+// ahead thread. Returns false when the file source is going away.
+bool WVMFileSource::readAhead()
+{
+    Mutex::Autolock autoLock(mLock);
+
+    while (mReadAheadThread != NULL) {
+        for (off64_t index = mReadAheadFrom + 1; index <= mReadAheadTo; ++index) {
+            Block &block = mBlocks[index % kNumBlocks];
+            if (block.mIndex == index && block.mState != kBlockEmpty) {
+                continue;
+            }
+            if (block.mState == kBlockFilling) {
+                break;  // the reader is filling this slot
+            }
+
+            ssize_t result = fillBlock(block, index);
+            if (result < kBlockSize) {
+                // error or end of the data, nothing further to read ahead
+                mReadAheadTo = index;
+            }
+            return true;
+        }
+        mReadAheadRequested.wait(mLock);
+    }
+    return false;
+}
+
 } // namespace android
@@ -5,6 +5,8 @@
 #define LOG_TAG "WVMMediaSource"
 #include <utils/Log.h>
 
+#include <pthread.h>
+
 #include "WVMMediaSource.h"
 #include "WVMFileSource.h"
 #include "WVMExtractorImpl.h"
@@ -18,13 +20,45 @@
 
 namespace android {
 
+// The stream control library reports errors through a process wide hook.
+// While in WV_GetEsData a read records the client context it reads for, so
+// that errors reported on that thread reach that session only. Errors
+// reported on other threads can't be attributed to a session and are
+// returned by the next read of any session.
+static pthread_once_t sReadContextOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sReadContextKey;
+
+static Mutex sUnroutedErrorLock;
+static status_t sUnroutedError = NO_ERROR;
+
+static void createReadContextKey()
+{
+    pthread_key_create(&sReadContextKey, NULL);
+}
+
 static void _cb(int code)
 {
-    WVMMediaSource::sLastError = (status_t)code;
+    ClientContext *context = (ClientContext *)pthread_getspecific(sReadContextKey);
+    if (context != NULL) {
+        context->setError((status_t)code);
+    } else {
+        Mutex::Autolock autoLock(sUnroutedErrorLock);
+        sUnroutedError = (status_t)code;
+    }
 }
 
-status_t WVMMediaSource::sLastError = NO_ERROR;
-int64_t WVMMediaSource::sLastSeekTimeUs = -1;
+// How long read waits for ES data before giving up, longer after a seek
+// since a new connection may have to be set up
+static const nsecs_t kReadTimeoutNs = 5000000000LL;
+static const nsecs_t kSeekReadTimeoutNs = 15000000000LL;
+
+// The file source signals when it delivers data, streaming sources don't
+// so waits are also bounded by this interval
+static const nsecs_t kDataPollIntervalNs = 10000000LL;
+
+// Buffer sizes used until enough access units have been seen
+static const size_t kDefaultVideoBufferSize = 256 * 1024;
+static const size_t kDefaultAudioBufferSize = 64 * 1024;
 
 WVMMediaSource::WVMMediaSource(WVSession *session, WVEsSelector esSelector,
                                const sp<MetaData> &metaData, bool isLive,
@@ -33,16 +67,32 @@ WVMMediaSource::WVMMediaSource(WVSession *session, WVEsSelector esSelector,
       mESSelector(esSelector),
       mTrackMetaData(metaData),
       mStarted(false),
+      mReading(false),
+      mStopping(false),
       mIsLiveStream(isLive),
       mNewSegment(false),
       mCryptoInitialized(cryptoInitialized),
       mStripADTS(false),
       mCryptoPluginMode(cryptoPluginMode),
       mGroup(NULL),
+      mAuSizeSamples(0),
+      mLargestAuSize(0),
+      mBufferSize(0),
+      mUsingCodecBuffers(false),
       mKeyTime(0),
       mDts(0),
-      mPts(0)
+      mPts(0),
+      mEncryptedSizes(new size_t[kInitialSubsamples]),
+      mClearSizes(new size_t[kInitialSubsamples]),
+      mZeroSizes(new size_t[kInitialSubsamples]),
+      mNumEncryptedSizes(0),
+      mNumClearSizes(0),
+      mMaxSubsamples(kInitialSubsamples)
 {
+    memset(mAuSizeHistogram, 0, sizeof(mAuSizeHistogram));
+    memset(mZeroSizes, 0, mMaxSubsamples * sizeof(size_t));
+
+    pthread_once(&sReadContextOnce, createReadContextKey);
     _ah010(_cb);
 #ifdef REQUIRE_SECURE_BUFFERS
     mStripADTS = true;
@@ -71,20 +121,110 @@ void WVMMediaSource::delegateClientContext(sp<ClientContext> context)
     mClientContext = context;
 }
 
-void WVMMediaSource::allocBufferGroup()
+void WVMMediaSource::allocBufferGroup(size_t size)
 {
     if (mGroup)
         delete mGroup;
 
     mGroup = new MediaBufferGroup;
 
-    size_t size;
-    if (mESSelector == WV_EsSelector_Video)
-        size = 256 * 1024;
-    else
-        size = 64 * 1024;
+    MediaBuffer *buffer = new MediaBuffer(size);
+    mGroup->add_buffer(buffer);
+
+    mBuffers.clear();
+    mBuffers.push_back(buffer);
+    mBufferSize = size;
+}
+
+// Replaces the buffer group when the buffers no longer match the access
+// unit sizes: buffers grown for an oversized access unit are dropped, and
+// the buffer is enlarged or shrunk when the sizes seen have moved. This can
+// only be done once the buffers have all been returned.
+void WVMMediaSource::resizeBufferGroup()
+{
+    if (mUsingCodecBuffers) {
+        return;
+    }
+
+    size_t targetSize = getTargetBufferSize();
+    bool grow = targetSize > mBufferSize;
+    bool shrink = targetSize < mBufferSize / 2;
+
+    if (!grow && !shrink && mBuffers.size() <= 1) {
+        return;
+    }
+
+    for (size_t i = 0; i < mBuffers.size(); ++i) {
+        if (mBuffers[i]->refcount() > 0) {
+            return;
+        }
+    }
+
+    if (!grow && !shrink) {
+        targetSize = mBufferSize;
+    }
+
+    //ALOGD("%s buffer size %d -> %d",
+    //     (mESSelector == WV_EsSelector_Video) ? "video" : "audio",
+    //     mBufferSize, targetSize);
 
-    mGroup->add_buffer(new MediaBuffer(size));
+    allocBufferGroup(targetSize);
+}
+
+void WVMMediaSource::recordAuSize(size_t size)
+{
+    size_t bucket = size / kAuSizeBucketSize;
+    if (bucket >= kAuSizeBuckets) {
+        bucket = kAuSizeBuckets - 1;
+        if (size > mLargestAuSize) {
+            mLargestAuSize = size;
+        }
+    }
+    mAuSizeHistogram[bucket] += kAuSizeWeight;
+
+    // Let old samples fade out so the sizes follow bitrate changes
+    if (++mAuSizeSamples % kAuSizeWindow == 0) {
+        for (size_t i = 0; i < kAuSizeBuckets; ++i) {
+            mAuSizeHistogram[i] /= 2;
+        }
+        if (mAuSizeHistogram[kAuSizeBuckets - 1] == 0) {
+            mLargestAuSize = 0;
+        }
+    }
+}
+
+// Returns a buffer size that holds all but the largest access units seen
+size_t WVMMediaSource::getTargetBufferSize() const
+{
+    if (mAuSizeSamples < kAuSizeMinSamples) {
+        if (mBufferSize > 0) {
+            return mBufferSize;
+        }
+        if (mESSelector == WV_EsSelector_Video) {
+            return kDefaultVideoBufferSize;
+        }
+        return kDefaultAudioBufferSize;
+    }
+
+    uint32_t total = 0;
+    for (size_t i = 0; i < kAuSizeBuckets; ++i) {
+        total += mAuSizeHistogram[i];
+    }
+
+    uint32_t threshold = total - total / 1000 * (1000 - kAuSizePerMille);
+    uint32_t count = 0;
+    size_t bucket = 0;
+    for (; bucket < kAuSizeBuckets - 1; ++bucket) {
+        count += mAuSizeHistogram[bucket];
+        if (count >= threshold) {
+            break;
+        }
+    }
+
+    if (bucket == kAuSizeBuckets - 1) {
+        return (mLargestAuSize / kAuSizeBucketSize + 1) * kAuSizeBucketSize;
+    }
+    return (bucket + 1) * kAuSizeBucketSize;
 }
 
 
@@ -95,6 +235,8 @@ status_t WVMMediaSource::setBuffers(const Vector<MediaBuffer *> &buffers) {
 
       delete mGroup;
       mGroup = new MediaBufferGroup;
+      mBuffers.clear();
+      mUsingCodecBuffers = true;
       for (size_t i = 0; i < buffers.size(); ++i) {
         mGroup->add_buffer(buffers.itemAt(i));
       }
@@ -131,7 +273,7 @@ status_t WVMMediaSource::start(MetaData *)
     }
 
     if (!mGroup)
-        allocBufferGroup();
+        allocBufferGroup(getTargetBufferSize());
 
     return OK;
 }
@@ -144,6 +286,14 @@ status_t WVMMediaSource::stop()
 
     CHECK(mStarted);
 
+    // A read in progress gives up at its next check, the buffers can only
+    // be freed once it has returned
+    mStopping = true;
+    while (mReading) {
+        mReadDone.wait(mLock);
+    }
+    mStopping = false;
+
     status_t status = OK;
 
     // Let video stream control play/pause
@@ -157,6 +307,8 @@ status_t WVMMediaSource::stop()
 
     delete mGroup;
     mGroup = NULL;
+    mBuffers.clear();
+    mUsingCodecBuffers = false;
 
     mStarted = false;
 
@@ -204,7 +356,52 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
     Mutex::Autolock autoLock(mLock);
 
     CHECK(mStarted);
+    CHECK(!mReading);
+
+    mReading = true;
+    status_t err = readAccessUnit(buffer, options);
+    mReading = false;
+    mReadDone.broadcast();
+
+    return err;
+}
+
+// Returns true if this source should perform a seek to seekTimeUs
+bool WVMMediaSource::claimSeek(int64_t seekTimeUs)
+{
+    // If we are not in Crypto Plugin Mode, let the video stream
+    // control the seek.
+    // If we are in Crypto Plugin Mode, obey the first seek we get to a
+    // given point, then ignore the subsequent one.
+    if (!mCryptoPluginMode) {
+        return mESSelector == WV_EsSelector_Video;
+    }
+    if (mClientContext == NULL) {
+        return true;
+    }
+    return mClientContext->claimSeek(seekTimeUs);
+}
+
+// Returns and clears an error the stream control library has reported
+status_t WVMMediaSource::takeError()
+{
+    status_t error = NO_ERROR;
+    if (mClientContext != NULL) {
+        error = mClientContext->takeError();
+    }
+    if (error == NO_ERROR) {
+        Mutex::Autolock autoLock(sUnroutedErrorLock);
+        error = sUnroutedError;
+        sUnroutedError = NO_ERROR;
+    }
+    return error;
+}
 
+// Reads the next access unit. Called with mLock held, the lock is released
+// while blocked in the stream control library or waiting for data so that
+// the source can be queried or stopped meanwhile.
+status_t WVMMediaSource::readAccessUnit(MediaBuffer **buffer, const ReadOptions *options)
+{
     *buffer = NULL;
     bool seekNextSync = false;
 
@@ -219,13 +416,13 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
 
     int64_t seekTimeUs;
 
-    int retryLimit = 500;  // Limit on number of retries before timeout, 10ms per retry
+    nsecs_t timeoutNs = kReadTimeoutNs;
 
     ReadOptions::SeekMode mode;
     if (options && options->getSeekTo(&seekTimeUs, &mode)) {
 
         // When doing a seek, use a longer timeout since we need to set up a new connection
-        retryLimit = 1500;
+        timeoutNs = kSeekReadTimeoutNs;
 
         //ALOGD("%s seek mode=%d, seek time=%lld lateby=%lld",
         //    (mESSelector == WV_EsSelector_Video) ? "video" : "audio",
@@ -234,49 +431,48 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
             // Handle seek next sync by dropping frames on this track that are
             // prior to the specified time.
             seekNextSync = true;
-        } else {
-            // If we are not in Crypto Plugin Mode, let the video stream
-            // control the seek.
-            // If we are in Crypto Plugin Mode, obey the first seek we get to a
-            // given point, then ignore the subsequent one.
-            if ((!mCryptoPluginMode && mESSelector == WV_EsSelector_Video) ||
-                (mCryptoPluginMode && seekTimeUs != sLastSeekTimeUs)) {
-                float scaleUsed;
-                std::string when = usecToNPT(seekTimeUs) + std::string("-");
-
-                WVStatus result = WV_Play(mSession, 1.0, &scaleUsed, when );
-
-                if (result != WV_Status_OK) {
-                    ALOGE("WV_Play returned status %d in WVMMediaSource::read\n", result);
-                    return ERROR_IO;
-                }
+        } else if (claimSeek(seekTimeUs)) {
+            float scaleUsed;
+            std::string when = usecToNPT(seekTimeUs) + std::string("-");
+
+            mLock.unlock();
+            WVStatus result = WV_Play(mSession, 1.0, &scaleUsed, when );
+            mLock.lock();
 
-                sLastSeekTimeUs = seekTimeUs;
-            } else if (mCryptoPluginMode) {
-                sLastSeekTimeUs = -1;
+            if (result != WV_Status_OK) {
+                ALOGE("WV_Play returned status %d in WVMMediaSource::read\n", result);
+                return ERROR_IO;
             }
         }
     }
 
+    resizeBufferGroup();
+
     MediaBuffer *mediaBuf;
 
+    // Blocks until the codec has returned a buffer
+    mLock.unlock();
     status_t err = mGroup->acquire_buffer(&mediaBuf);
+    mLock.lock();
 
     if (err != OK) {
         CHECK(mediaBuf == NULL);
         return err;
     }
 
-    mDecryptContext.Initialize(mediaBuf);
-    mEncryptedSizes.clear();
-    mClearSizes.clear();
+    if (mStopping) {
+        mediaBuf->release();
+        return ERROR_END_OF_STREAM;
+    }
+
+    resetDecryptContext(mediaBuf);
 
     size_t bytesRead;
     bool auStart;
     size_t offset = 0;
 
     bool syncFrame;
-    int retryCount = 0;
+    nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + timeoutNs;
 
     // Pull full access units. Since we aren't sure how big they might be,
     // start with initial buffer size, then allocate a larger buffer if we
@@ -286,8 +482,19 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
     while (true) {
         size_t size = mediaBuf->size() - offset;
 
+        // Taken before asking for data so a delivery that lands during the
+        // call is not missed
+        uint32_t dataGeneration = 0;
+        if (mClientContext != NULL) {
+            dataGeneration = mClientContext->getDataGeneration();
+        }
+
+        mLock.unlock();
+        pthread_setspecific(sReadContextKey, mClientContext.get());
         WVStatus result = WV_GetEsData(mSession, mESSelector, (uint8_t *)mediaBuf->data() + offset,
                                        size, bytesRead, auStart, mDts, mPts, syncFrame);
+        pthread_setspecific(sReadContextKey, NULL);
+        mLock.lock();
 
         if (result != WV_Status_OK &&
             result != WV_Status_Warning_Need_Key &&
@@ -321,11 +528,15 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
             return status;
         }
 
-        if (sLastError != NO_ERROR) {
+        status_t error = takeError();
+        if (error != NO_ERROR) {
             mediaBuf->release();
-            status_t status = sLastError;
-            sLastError = NO_ERROR;
-            return status;
+            return error;
+        }
+
+        if (mStopping) {
+            mediaBuf->release();
+            return ERROR_END_OF_STREAM;
         }
 
 #ifdef REQUIRE_SECURE_BUFFERS
@@ -335,16 +546,13 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
 #endif
 
         if (bytesRead == 0) {
-            if (retryCount++ >= retryLimit) {
-                // If no data received within the retry limit, return ERROR_IO
+            if (!waitForData(dataGeneration, deadline)) {
+                // If no data received within the timeout, return ERROR_IO
                 // This prevents the player from becoming unresponsive
                 mediaBuf->release();
                 return ERROR_IO;
-            } else {
-                // Didn't get anything, sleep a bit so we don't hog the CPU then try again
-                usleep(10000);
-                continue;
             }
+            continue;
         }
 
 
@@ -352,11 +560,9 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
         mKeyTime = (int64_t)mPts * 1000000 / PCR_HZ;
 
         if (seekNextSync && ((mKeyTime < seekTimeUs) || !syncFrame)) {
-            // drop frames up to next sync if requested
-            usleep(10000);
-            mDecryptContext.Initialize(mediaBuf);
-            mEncryptedSizes.clear();
-            mClearSizes.clear();
+            // drop frames up to next sync if requested, the next frame
+            // is usually available right away
+            resetDecryptContext(mediaBuf);
             continue;
         }
 
@@ -376,6 +582,7 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
         // This buffer is too small, allocate a larger buffer twice the size
         // and copy the data from the current buffer into the first part of
         // the new buffer, then set offset to where the next read should go.
+        // The larger buffer is dropped by resizeBufferGroup once returned.
 
         MediaBuffer *newBuffer = new MediaBuffer(mediaBuf->size() * 2);
         newBuffer->add_ref();
@@ -384,21 +591,24 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
         offset = mediaBuf->size();
 
         mGroup->add_buffer(newBuffer);
+        mBuffers.push_back(newBuffer);
 
         mediaBuf->release();
         mediaBuf = newBuffer;
+        mDecryptContext.mMediaBuf = newBuffer;
     }
 
     mediaBuf->meta_data()->clear();
     mediaBuf->meta_data()->setInt64(kKeyTime, mKeyTime);
 
     mediaBuf->set_range(0, bytesRead + offset);
+    recordAuSize(bytesRead + offset);
 
     if (!mIsLiveStream) {
-        if (mEncryptedSizes.size()) {
+        if (mNumEncryptedSizes) {
             mediaBuf->meta_data()->setData(kKeyEncryptedSizes, 0,
-                                           &mEncryptedSizes[0],
-                                           mEncryptedSizes.size() * sizeof(size_t));
+                                           mEncryptedSizes,
+                                           mNumEncryptedSizes * sizeof(size_t));
             mediaBuf->meta_data()->setInt32(kKeyCryptoMode,
                                             CryptoPlugin::kMode_AES_WV);
 
@@ -409,17 +619,13 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
 #endif
         } else {
             // Fixes b/9261447: GTS crashed on Nexus 10
-            Vector<size_t> zeroEncryptedSizes;
-            size_t zeroValue = 0;
-            zeroEncryptedSizes.insertAt(zeroValue, 0,
-                                        mClearSizes.size());
             mediaBuf->meta_data()->setData(kKeyEncryptedSizes, 0,
-                                           &zeroEncryptedSizes[0],
-                                           zeroEncryptedSizes.size() * sizeof(size_t));
+                                           mZeroSizes,
+                                           mNumClearSizes * sizeof(size_t));
 
             mediaBuf->meta_data()->setData(kKeyPlainSizes, 0,
-                                           &mClearSizes[0],
-                                           mClearSizes.size() * sizeof(size_t));
+                                           mClearSizes,
+                                           mNumClearSizes * sizeof(size_t));
             mediaBuf->meta_data()->setInt32(kKeyCryptoMode,
                                             CryptoPlugin::kMode_Unencrypted);
         }
@@ -455,6 +661,60 @@ status_t WVMMediaSource::read(MediaBuffer **buffer, const ReadOptions *options)
     return OK;
 }
 
+// Waits for the stream control library to receive more data, with mLock
+// released. Returns false once the deadline has passed.
+bool WVMMediaSource::waitForData(uint32_t dataGeneration, nsecs_t deadline)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (now >= deadline) {
+        return false;
+    }
+
+    nsecs_t timeoutNs = deadline - now;
+    if (timeoutNs > kDataPollIntervalNs) {
+        timeoutNs = kDataPollIntervalNs;
+    }
+
+    mLock.unlock();
+    if (mClientContext != NULL) {
+        mClientContext->waitForData(dataGeneration, timeoutNs);
+    } else {
+        usleep(timeoutNs / 1000);
+    }
+    mLock.lock();
+    return true;
+}
+
+// Starts a new access unit in mediaBuf
+void WVMMediaSource::resetDecryptContext(MediaBuffer *mediaBuf)
+{
+    mDecryptContext.Initialize(mediaBuf);
+    mNumEncryptedSizes = 0;
+    mNumClearSizes = 0;
+}
+
+// Doubles the room for crypto unit sizes, the arrays keep their new size
+void WVMMediaSource::growSubsampleSizes()
+{
+    size_t maxSubsamples = mMaxSubsamples * 2;
+
+    size_t *encryptedSizes = new size_t[maxSubsamples];
+    size_t *clearSizes = new size_t[maxSubsamples];
+    size_t *zeroSizes = new size_t[maxSubsamples];
+
+    memcpy(encryptedSizes, mEncryptedSizes, mNumEncryptedSizes * sizeof(size_t));
+    memcpy(clearSizes, mClearSizes, mNumClearSizes * sizeof(size_t));
+    memset(zeroSizes, 0, maxSubsamples * sizeof(size_t));
+
+    delete[] mEncryptedSizes;
+    delete[] mClearSizes;
+    delete[] mZeroSizes;
+
+    mEncryptedSizes = encryptedSizes;
+    mClearSizes = clearSizes;
+    mZeroSizes = zeroSizes;
+    mMaxSubsamples = maxSubsamples;
+}
 
 void WVMMediaSource::DecryptCallback(WVEsSelector esType, void* input, void* output,
                                      size_t length, int key, void *obj)
@@ -478,13 +738,19 @@ void WVMMediaSource::DecryptCallback(WVEsSelector esType, void* input, void* out
     uint32_t copied = length;
 
     if (clientContext->getCryptoPluginMode()) {
-        // just determine crypto unit boundaries
+        // just determine crypto unit boundaries, the crypto plugin decrypts
         if (key) {
             source->addEncryptedSize(length);
         } else {
             source->addClearSize(length);
         }
-        memcpy((uint8_t *)context.mMediaBuf->data() + context.mOffset, input, length);
+
+        // Data handed over in place in the buffer passed to WV_GetEsData
+        // doesn't need to be copied
+        uint8_t *dest = (uint8_t *)context.mMediaBuf->data() + context.mOffset;
+        if (input != dest) {
+            memcpy(dest, input, length);
+        }
     } else {
 
 #ifdef REQUIRE_SECURE_BUFFERS
@@ -533,6 +799,10 @@ WVMMediaSource::~WVMMediaSource()
         }
         WVMExtractorImpl::cleanup();
     }
+
+    delete[] mEncryptedSizes;
+    delete[] mClearSizes;
+    delete[] mZeroSizes;
 }
 
 } // namespace android
@@ -5,7 +5,10 @@
 #ifndef CLIENTCONTEXT_H_
 #define CLIENTCONTEXT_H_
 
+#include <utils/Errors.h>
 #include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
 #include <media/stagefright/foundation/ABase.h>
 
 namespace android {
@@ -14,7 +17,9 @@ namespace android {
 
     class ClientContext : public RefBase {
     public:
-        ClientContext() : mUIDIsSet(false), mCryptoPluginMode(false) {}
+        ClientContext()
+            : mUIDIsSet(false), mCryptoPluginMode(false), mDataGeneration(0),
+              mLastSeekTimeUs(-1), mLastError(NO_ERROR) {}
 
         void setUID(uid_t uid) { mUID = uid; mUIDIsSet = true; }
         uid_t getUID() const { return mUID; }
@@ -29,6 +34,55 @@ namespace android {
         sp<WVMMediaSource> getAudioSource() const { return mAudioSource.promote(); }
         sp<WVMMediaSource> getVideoSource() const { return mVideoSource.promote(); }
 
+        // Called when the file source has handed data to the stream control
+        // library, wakes up media sources waiting for ES data
+        void notifyDataAvailable() {
+            Mutex::Autolock autoLock(mDataLock);
+            ++mDataGeneration;
+            mDataCondition.broadcast();
+        }
+
+        uint32_t getDataGeneration() {
+            Mutex::Autolock autoLock(mDataLock);
+            return mDataGeneration;
+        }
+
+        // Waits up to timeoutNs for data to arrive after getDataGeneration
+        // returned generation
+        void waitForData(uint32_t generation, nsecs_t timeoutNs) {
+            Mutex::Autolock autoLock(mDataLock);
+            if (generation == mDataGeneration) {
+                mDataCondition.waitRelative(mDataLock, timeoutNs);
+            }
+        }
+
+        // In crypto plugin mode both media sources are asked to seek, the
+        // first one to see a seek to a given time performs it and the other
+        // ignores it. Returns true if the caller should perform the seek.
+        bool claimSeek(int64_t seekTimeUs) {
+            Mutex::Autolock autoLock(mStateLock);
+            if (seekTimeUs != mLastSeekTimeUs) {
+                mLastSeekTimeUs = seekTimeUs;
+                return true;
+            }
+            mLastSeekTimeUs = -1;
+            return false;
+        }
+
+        // Errors the stream control library reports for this session, they
+        // are returned by the next read of either media source
+        void setError(status_t error) {
+            Mutex::Autolock autoLock(mStateLock);
+            mLastError = error;
+        }
+
+        status_t takeError() {
+            Mutex::Autolock autoLock(mStateLock);
+            status_t error = mLastError;
+            mLastError = NO_ERROR;
+            return error;
+        }
+
     private:
         bool mUIDIsSet;;
         uid_t mUID;
@@ -38,6 +92,14 @@ namespace android {
         wp<WVMMediaSource> mAudioSource;
         wp<WVMMediaSource> mVideoSource;
 
+        Mutex mDataLock;
+        Condition mDataCondition;
+        uint32_t mDataGeneration;
+
+        Mutex mStateLock;
+        int64_t mLastSeekTimeUs;
+        status_t mLastError;
+
         DISALLOW_EVIL_CONSTRUCTORS(ClientContext);
     };
 };
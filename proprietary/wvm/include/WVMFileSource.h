@@ -9,18 +9,28 @@
 #include "WVStreamControlAPI.h"
 #include <media/stagefright/DataSource.h>
 #include <utils/RefBase.h>
+#include <utils/threads.h>
 
 //
 // Supports reading data from local file descriptor instead of URI-based streaming
 // as we normally do.
 //
+// Data is read from the data source in aligned blocks held in a ring, block n
+// in slot n % kNumBlocks. Once reads are sequential, the blocks following the
+// read position are fetched ahead on a background thread. Reads of at least
+// kBlockSize, and runs of reads of at least kMinDirectRead starting on a
+// block boundary, go straight to the data source when none of the blocks
+// they cover is cached.
+//
 
 namespace android {
 
+class ClientContext;
+
 class WVMFileSource : public WVFileSource, public RefBase {
 public:
-    WVMFileSource(sp<DataSource> &dataSource);
-    virtual ~WVMFileSource() {}
+    WVMFileSource(sp<DataSource> &dataSource, const sp<ClientContext> &clientContext);
+    virtual ~WVMFileSource();
 
     virtual unsigned long long GetSize();
     virtual unsigned long long GetOffset();
@@ -29,9 +39,53 @@ public:
     virtual size_t Read(size_t amount, unsigned char *buffer);
 
 private:
+    enum {
+        kBlockSize = 64 * 1024,
+        kNumBlocks = 8,
+        kSequentialReads = 2,   // sequential reads seen before reading ahead
+        kMinDirectRead = 16 * 1024
+    };
+
+    enum BlockState {
+        kBlockEmpty,
+        kBlockFilling,
+        kBlockValid
+    };
+
+    struct Block {
+        BlockState mState;
+        off64_t mIndex;
+        size_t mLength;     // less than kBlockSize at the end of the data
+        uint8_t *mData;
+    };
+
+    class ReadAheadThread;
+
+    bool isDirectRead(size_t amount);
+    ssize_t fillBlock(Block &block, off64_t index);
+    void startReadAhead();
+    bool readAhead();
+
     sp<DataSource> mDataSource;
+    sp<ClientContext> mClientContext;
     unsigned long long mOffset;
     bool mLogOnce;
+
+    Mutex mLock;
+    Condition mBlockFilled;
+    Condition mReadAheadRequested;
+    Block mBlocks[kNumBlocks];
+    uint8_t *mBlockData;
+
+    unsigned long long mLastReadEnd;
+    bool mLastReadDirect;
+    int mSequentialReads;
+    off64_t mReadAheadFrom;     // blocks after this one up to mReadAheadTo
+    off64_t mReadAheadTo;       // are read ahead
+    sp<ReadAheadThread> mReadAheadThread;
+
+    WVMFileSource(const WVMFileSource &);
+    WVMFileSource &operator=(const WVMFileSource &);
 };
 
 };
@@ -41,10 +41,16 @@ public:
     virtual status_t setBuffers(const Vector<MediaBuffer *> &buffers);
     virtual status_t read(MediaBuffer **buffer, const ReadOptions *options = NULL);
 
-    void addEncryptedSize(size_t size) { mEncryptedSizes.push_back(size); }
-    void addClearSize(size_t size) { mClearSizes.push_back(size); }
-
-    static int sLastError;
+    void addEncryptedSize(size_t size) {
+        if (mNumEncryptedSizes == mMaxSubsamples)
+            growSubsampleSizes();
+        mEncryptedSizes[mNumEncryptedSizes++] = size;
+    }
+    void addClearSize(size_t size) {
+        if (mNumClearSizes == mMaxSubsamples)
+            growSubsampleSizes();
+        mClearSizes[mNumClearSizes++] = size;
+    }
 
     int64_t getTime() { return mKeyTime; };  // usec.
 
@@ -78,7 +84,7 @@ protected:
 
 private:
     Mutex mLock;
-    static int64_t sLastSeekTimeUs;
+    Condition mReadDone;
 
     WVSession *mSession;
     WVEsSelector mESSelector;  // indicates audio vs. video
@@ -86,6 +92,8 @@ private:
     sp<MetaData> mTrackMetaData;
 
     bool mStarted;
+    bool mReading;                  // read is in progress, mLock may be released
+    bool mStopping;                 // stop is waiting for the read to return
     bool mLogOnce;
     bool mIsLiveStream;
     bool mNewSegment;
@@ -95,6 +103,26 @@ private:
 
     MediaBufferGroup *mGroup;
 
+    // Buffers are sized from a histogram of recent access unit sizes so
+    // that most access units fit without growing the buffer
+    enum {
+        kAuSizeBucketSize = 16 * 1024,
+        kAuSizeBuckets = 64,
+        kAuSizeWindow = 128,        // counts are halved after this many samples
+        kAuSizeWeight = 256,        // count added per sample, so halving keeps
+                                    // rare sizes such as sync frames
+        kAuSizeMinSamples = 32,     // samples needed before resizing
+        kAuSizePerMille = 998       // share of access units the buffer holds
+    };
+
+    uint32_t mAuSizeHistogram[kAuSizeBuckets];
+    uint32_t mAuSizeSamples;
+    size_t mLargestAuSize;          // largest one in the last bucket
+
+    size_t mBufferSize;             // size of the buffers allocated for mGroup
+    Vector<MediaBuffer *> mBuffers; // buffers allocated for mGroup
+    bool mUsingCodecBuffers;
+
     int64_t mKeyTime;
     unsigned long long mDts;
     unsigned long long mPts;
@@ -103,11 +131,33 @@ private:
     sp<DataSource> mDataSource;
     sp<ClientContext> mClientContext;
 
-    Vector<size_t> mEncryptedSizes;
-    Vector<size_t> mClearSizes;
+    // Crypto unit sizes of the access unit being read, recorded by
+    // DecryptCallback in crypto plugin mode. The arrays are allocated once
+    // and only grow for an access unit with more units than they hold.
+    enum {
+        kInitialSubsamples = 256
+    };
+
+    size_t *mEncryptedSizes;
+    size_t *mClearSizes;
+    size_t *mZeroSizes;             // all zero, encrypted sizes of a clear AU
+    size_t mNumEncryptedSizes;
+    size_t mNumClearSizes;
+    size_t mMaxSubsamples;
     char mCryptoPluginKey[kCryptoBlockSize];
 
-    void allocBufferGroup();
+    void growSubsampleSizes();
+    void resetDecryptContext(MediaBuffer *mediaBuf);
+
+    void allocBufferGroup(size_t size);
+    void resizeBufferGroup();
+    void recordAuSize(size_t size);
+    size_t getTargetBufferSize() const;
+    bool waitForData(uint32_t dataGeneration, nsecs_t deadline);
+
+    status_t readAccessUnit(MediaBuffer **buffer, const ReadOptions *options);
+    bool claimSeek(int64_t seekTimeUs);
+    status_t takeError();
 
     WVMMediaSource(const WVMMediaSource &);
     WVMMediaSource &operator=(const WVMMediaSource &);
@@ -32,4 +32,50 @@ LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_EXECUTABLE)
 
+# WVMMediaSource against a fake stream control library, L3 path only
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+        TestWVMMediaSource.cpp \
+        ../WVMMediaSource.cpp \
+        ../WVMFileSource.cpp
+
+include $(TOP)/vendor/widevine/proprietary/wvm/common.mk
+
+LOCAL_SHARED_LIBRARIES := \
+    libstlport            \
+    libstagefright        \
+    libstagefright_foundation \
+    libdrmframework       \
+    liblog                \
+    libutils
+
+LOCAL_MODULE:=test-wvmmediasource
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# WVMFileSource read ahead over a local file, with throughput figures
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+        TestWVMFileSource.cpp \
+        ../WVMFileSource.cpp
+
+include $(TOP)/vendor/widevine/proprietary/wvm/common.mk
+
+LOCAL_SHARED_LIBRARIES := \
+    libstlport            \
+    libstagefright        \
+    libdrmframework       \
+    liblog                \
+    libutils
+
+LOCAL_MODULE:=test-wvmfilesource
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
 endif
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2013 Google, Inc.  All Rights Reserved
+ */
+
+// Checks the data returned by WVMFileSource and compares its throughput with
+// reading the data source directly, over a local file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "WVMFileSource.h"
+#include "WVMMediaSource.h"
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/FileSource.h>
+
+using namespace android;
+
+static const char *kPath = "/data/local/tmp/test-wvmfilesource.dat";
+static const size_t kFileSize = 32 * 1024 * 1024;
+
+static uint8_t fileByte(unsigned long long offset)
+{
+    return (uint8_t)(offset * 31 + (offset >> 12));
+}
+
+// Counts the reads that reach the file
+class CountingDataSource : public DataSource {
+public:
+    CountingDataSource(const sp<DataSource> &source) : mSource(source), mReads(0) {}
+
+    virtual status_t initCheck() const { return mSource->initCheck(); }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        __sync_fetch_and_add(&mReads, 1);
+        return mSource->readAt(offset, data, size);
+    }
+
+    virtual status_t getSize(off64_t *size) { return mSource->getSize(size); }
+
+    int reads() const { return mReads; }
+    void reset() { mReads = 0; }
+
+private:
+    sp<DataSource> mSource;
+    volatile int mReads;
+};
+
+class TestWVMFileSource
+{
+public:
+    TestWVMFileSource() : mFailures(0) {}
+
+    bool Init();
+
+    // Tests
+    void SequentialReads();
+    void Seeks();
+    void Throughput();
+
+    int failures() const { return mFailures; }
+
+private:
+    bool Verify(const uint8_t *data, unsigned long long offset, size_t length);
+    void Check(bool condition, const char *what);
+
+    sp<CountingDataSource> mDataSource;
+    int mFailures;
+};
+
+bool TestWVMFileSource::Init()
+{
+    FILE *f = fopen(kPath, "w");
+    if (!f) {
+        fprintf(stderr, "Can't create %s\n", kPath);
+        return false;
+    }
+    uint8_t block[4096];
+    for (unsigned long long offset = 0; offset < kFileSize; offset += sizeof(block)) {
+        for (size_t i = 0; i < sizeof(block); ++i) {
+            block[i] = fileByte(offset + i);
+        }
+        fwrite(block, sizeof(block), 1, f);
+    }
+    fclose(f);
+
+    mDataSource = new CountingDataSource(new FileSource(kPath));
+    return mDataSource->initCheck() == OK;
+}
+
+bool TestWVMFileSource::Verify(const uint8_t *data, unsigned long long offset,
+                               size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        if (data[i] != fileByte(offset + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TestWVMFileSource::Check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("  FAILED: %s\n", what);
+        ++mFailures;
+    }
+}
+
+void TestWVMFileSource::SequentialReads()
+{
+    printf("TestWVMFileSource::SequentialReads\n");
+
+    sp<DataSource> dataSource = mDataSource;
+    sp<WVMFileSource> fileSource = new WVMFileSource(dataSource, NULL);
+    Check(fileSource->GetSize() == kFileSize, "size");
+
+    uint8_t buffer[100000];
+    unsigned long long offset = 0;
+    bool intact = true;
+    size_t amount = 1;
+    while (intact && offset < kFileSize) {
+        // a mix of small and large reads, crossing block boundaries
+        amount = (amount * 7 + 1) % sizeof(buffer) + 1;
+        size_t expected = amount;
+        if (expected > kFileSize - offset) {
+            expected = kFileSize - offset;
+        }
+        size_t bytesRead = fileSource->Read(amount, buffer);
+        intact = (bytesRead == expected) && Verify(buffer, offset, bytesRead);
+        offset += bytesRead;
+        intact = intact && (fileSource->GetOffset() == offset);
+    }
+    Check(intact, "data read in sequence");
+    Check(fileSource->Read(sizeof(buffer), buffer) == 0, "read at end of file");
+}
+
+void TestWVMFileSource::Seeks()
+{
+    printf("TestWVMFileSource::Seeks\n");
+
+    sp<DataSource> dataSource = mDataSource;
+    sp<WVMFileSource> fileSource = new WVMFileSource(dataSource, NULL);
+
+    uint8_t buffer[20000];
+    bool intact = true;
+    srand(1);
+    for (int i = 0; intact && i < 2000; ++i) {
+        unsigned long long offset = ((unsigned long long)rand() * 4096 + rand()) % kFileSize;
+        size_t amount = rand() % sizeof(buffer) + 1;
+        if (amount > kFileSize - offset) {
+            amount = kFileSize - offset;
+        }
+        fileSource->Seek(offset);
+
+        // a few sequential reads so read ahead starts before the next seek
+        for (int j = 0; intact && j < 4 && offset < kFileSize; ++j) {
+            size_t length = amount;
+            if (length > kFileSize - offset) {
+                length = kFileSize - offset;
+            }
+            intact = (fileSource->Read(length, buffer) == length) &&
+                Verify(buffer, offset, length);
+            offset += length;
+        }
+    }
+    Check(intact, "data read after seeks");
+}
+
+static double Now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void TestWVMFileSource::Throughput()
+{
+    printf("TestWVMFileSource::Throughput\n");
+
+    const size_t kReadSizes[] = { 188, 4096, 32 * 1024, 256 * 1024 };
+    static uint8_t buffer[256 * 1024];
+    double megabytes = (double)kFileSize / (1024 * 1024);
+
+    for (size_t i = 0; i < sizeof(kReadSizes) / sizeof(kReadSizes[0]); ++i) {
+        size_t amount = kReadSizes[i];
+
+        mDataSource->reset();
+        double start = Now();
+        for (unsigned long long offset = 0; offset < kFileSize; ) {
+            ssize_t result = mDataSource->readAt(offset, buffer, amount);
+            if (result <= 0) {
+                break;
+            }
+            offset += result;
+        }
+        double direct = Now() - start;
+        int directReads = mDataSource->reads();
+
+        sp<DataSource> dataSource = mDataSource;
+        sp<WVMFileSource> fileSource = new WVMFileSource(dataSource, NULL);
+        mDataSource->reset();
+        start = Now();
+        while (fileSource->Read(amount, buffer) > 0) {
+        }
+        double cached = Now() - start;
+        int cachedReads = mDataSource->reads();
+
+        printf("  %6d byte reads: direct %7.1f MB/s in %7d reads, "
+               "WVMFileSource %7.1f MB/s in %4d reads\n",
+               (int)amount, megabytes / direct, directReads,
+               megabytes / cached, cachedReads);
+        // WVMFileSource reads once more to find the end of the data
+        Check(cachedReads <= directReads + 1, "no more data source reads");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    TestWVMFileSource test;
+    if (!test.Init()) {
+        exit(-1);
+    }
+
+    test.SequentialReads();
+    test.Seeks();
+    test.Throughput();
+    unlink(kPath);
+
+    if (test.failures()) {
+        printf("%d failures\n", test.failures());
+        exit(-1);
+    }
+    printf("Test successful!\n");
+    exit(0);
+}
@@ -0,0 +1,516 @@
+/*
+ * Copyright (C) 2013 Google, Inc.  All Rights Reserved
+ */
+
+// Runs WVMMediaSource against a fake stream control library that serves
+// elementary stream data with the size pattern of a video stream, and
+// checks how often access units overflow the source's buffers. In crypto
+// plugin mode it also checks the crypto unit sizes attached to each access
+// unit, and that seeks are coordinated per session. A read waiting for data
+// must not hold up other calls on the source.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "WVMMediaSource.h"
+#include "WVMExtractorImpl.h"
+#include "WVStreamControlAPI.h"
+#include "AndroidHooks.h"
+#include "ClientContext.h"
+#include <media/hardware/CryptoAPI.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// Fake elementary stream: a group of pictures is one large sync frame
+// followed by smaller frames
+class FakeEsSource
+{
+public:
+    FakeEsSource() : mClientContext(NULL), mStalled(false) { reset(0, 0, 0); }
+
+    void reset(size_t frames, size_t syncFrameSize, size_t frameSize) {
+        mFrames = frames;
+        mSyncFrameSize = syncFrameSize;
+        mFrameSize = frameSize;
+        mFrame = 0;
+        mOffset = 0;
+        mPartialReads = 0;
+    }
+
+    static const size_t kGopLength = 30;
+
+    // Crypto unit size in crypto plugin mode, sync frames span more units
+    // than WVMMediaSource initially has room for
+    static const size_t kCryptoUnitSize = 1000;
+
+    // Hands data to WVMMediaSource::DecryptCallback as the library does in
+    // crypto plugin mode. Odd frames are clear.
+    void setClientContext(ClientContext *clientContext) {
+        mClientContext = clientContext;
+    }
+
+    bool cryptoPluginMode() const { return mClientContext != NULL; }
+
+    // While stalled no data is delivered, as when the network is slow
+    void setStalled(bool stalled) { mStalled = stalled; }
+
+    static bool isEncrypted(size_t frame) { return (frame % 2) == 0; }
+
+    // Crypto units of the last access unit
+    const std::vector<size_t> &unitSizes() const { return mUnitSizes; }
+
+    size_t frameSize(size_t frame) const {
+        // vary sizes by up to a third, repeatably
+        size_t base = (frame % kGopLength == 0) ? mSyncFrameSize : mFrameSize;
+        return base - base / 3 + (frame * 7919) % (base / 3 + 1);
+    }
+
+    static uint8_t frameByte(size_t frame, size_t offset) {
+        return (uint8_t)(frame + offset / 4096);
+    }
+
+    WVStatus getEsData(unsigned char *buffer, size_t requestSize, size_t &returnSize,
+                       bool &auStart, unsigned long long &pts, bool &syncFrame) {
+        if (mStalled) {
+            returnSize = 0;
+            return WV_Status_OK;
+        }
+
+        if (mFrame >= mFrames) {
+            return WV_Status_End_Of_Media;
+        }
+
+        size_t size = frameSize(mFrame);
+        returnSize = size - mOffset;
+        if (returnSize > requestSize) {
+            // the access unit doesn't fit, the source has to copy and grow
+            returnSize = requestSize;
+            ++mPartialReads;
+        }
+        for (size_t i = 0; i < returnSize; ++i) {
+            buffer[i] = frameByte(mFrame, mOffset + i);
+        }
+
+        if (mClientContext != NULL) {
+            if (mOffset == 0) {
+                mUnitSizes.clear();
+            }
+            decrypt(buffer, returnSize);
+        }
+
+        auStart = (mOffset == 0);
+        pts = mFrame * 3000;
+        syncFrame = (mFrame % kGopLength == 0);
+
+        mOffset += returnSize;
+        if (mOffset == size) {
+            mOffset = 0;
+            ++mFrame;
+        }
+        return WV_Status_OK;
+    }
+
+    size_t partialReads() const { return mPartialReads; }
+
+private:
+    // Units don't span calls. Alternates between data handed over in place
+    // and data in a buffer of the library's own.
+    void decrypt(unsigned char *buffer, size_t length) {
+        for (size_t pos = 0, unit = 0; pos < length; pos += kCryptoUnitSize, ++unit) {
+            size_t size = length - pos;
+            if (size > kCryptoUnitSize) {
+                size = kCryptoUnitSize;
+            }
+            void *input = buffer + pos;
+            if (unit % 2) {
+                memcpy(mUnit, buffer + pos, size);
+                memset(buffer + pos, 0, size);
+                input = mUnit;
+            }
+            WVMMediaSource::DecryptCallback(WV_EsSelector_Video, input, NULL, size,
+                                            isEncrypted(mFrame), mClientContext);
+            mUnitSizes.push_back(size);
+        }
+    }
+
+    ClientContext *mClientContext;
+    volatile bool mStalled;
+    uint8_t mUnit[kCryptoUnitSize];
+    std::vector<size_t> mUnitSizes;
+    size_t mFrames;
+    size_t mSyncFrameSize;
+    size_t mFrameSize;
+    size_t mFrame;
+    size_t mOffset;
+    size_t mPartialReads;
+};
+
+static FakeEsSource sEsSource;
+static int sPlayCalls;
+
+// Stream control library entry points used by WVMMediaSource
+
+WVStatus WV_GetEsData(WVSession *session, WVEsSelector es_selector,
+                      unsigned char *buffer, size_t request_size, size_t& return_size,
+                      bool& au_start, unsigned long long& dts, unsigned long long& pts,
+                      bool& sync_frame)
+{
+    WVStatus status = sEsSource.getEsData(buffer, request_size, return_size,
+                                          au_start, pts, sync_frame);
+    dts = pts;
+    return status;
+}
+
+WVStatus WV_Play(WVSession *session, float scale_requested, float *scale_used,
+                 const std::string &range)
+{
+    *scale_used = scale_requested;
+    ++sPlayCalls;
+    return WV_Status_OK;
+}
+
+WVStatus WV_Pause(WVSession *session, const std::string &time)
+{
+    return WV_Status_OK;
+}
+
+WVStatus WV_Teardown(WVSession *&session)
+{
+    return WV_Status_OK;
+}
+
+void _ah010(_ah011 callback)
+{
+}
+
+void WVMExtractorImpl::cleanup()
+{
+}
+
+class TestWVMMediaSource
+{
+public:
+    TestWVMMediaSource() : mFailures(0) {}
+
+    // Tests
+    void BufferSizing();
+    void CryptoPluginMode();
+    void SeeksPerSession();
+    void ReadDoesNotBlockSource();
+
+    int failures() const { return mFailures; }
+
+private:
+    struct Stats {
+        size_t partialReads;
+        size_t largestBuffer;
+        size_t lastBuffer;
+    };
+
+    bool Play(sp<WVMMediaSource> source, size_t frames, size_t syncFrameSize,
+              size_t frameSize, Stats *stats);
+    bool CheckCryptoUnits(MediaBuffer *buffer, size_t frame);
+    bool Seek(sp<WVMMediaSource> source, int64_t seekTimeUs);
+    static void *ReadThread(void *source);
+    void Check(bool condition, const char *what);
+
+    int mFailures;
+};
+
+void TestWVMMediaSource::Check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("  FAILED: %s\n", what);
+        ++mFailures;
+    }
+}
+
+bool TestWVMMediaSource::Play(sp<WVMMediaSource> source, size_t frames,
+                              size_t syncFrameSize, size_t frameSize, Stats *stats)
+{
+    sEsSource.reset(frames, syncFrameSize, frameSize);
+    stats->largestBuffer = 0;
+
+    for (size_t frame = 0; frame < frames; ++frame) {
+        MediaBuffer *buffer;
+        status_t err = source->read(&buffer);
+        if (err != OK) {
+            printf("  read returned %d at frame %d\n", err, (int)frame);
+            return false;
+        }
+
+        const uint8_t *data = (const uint8_t *)buffer->data() + buffer->range_offset();
+        size_t length = buffer->range_length();
+        bool intact = (length == sEsSource.frameSize(frame));
+        for (size_t i = 0; intact && i < length; i += 1024) {
+            intact = (data[i] == FakeEsSource::frameByte(frame, i));
+        }
+        if (!intact) {
+            printf("  frame %d corrupted\n", (int)frame);
+            buffer->release();
+            return false;
+        }
+
+        if (sEsSource.cryptoPluginMode() && !CheckCryptoUnits(buffer, frame)) {
+            printf("  frame %d has wrong crypto units\n", (int)frame);
+            buffer->release();
+            return false;
+        }
+
+        if (buffer->size() > stats->largestBuffer) {
+            stats->largestBuffer = buffer->size();
+        }
+        stats->lastBuffer = buffer->size();
+        buffer->release();
+    }
+
+    stats->partialReads = sEsSource.partialReads();
+    printf("  %d frames: %d overflowed, largest buffer %dK, last buffer %dK\n",
+           (int)frames, (int)stats->partialReads, (int)stats->largestBuffer / 1024,
+           (int)stats->lastBuffer / 1024);
+    return true;
+}
+
+// In crypto plugin mode the access unit should be described by one size
+// per crypto unit, in the order they were delivered
+bool TestWVMMediaSource::CheckCryptoUnits(MediaBuffer *buffer, size_t frame)
+{
+    uint32_t type;
+    const void *data;
+    size_t size;
+    int32_t mode;
+    if (!buffer->meta_data()->findInt32(kKeyCryptoMode, &mode)) {
+        return false;
+    }
+
+    const std::vector<size_t> &unitSizes = sEsSource.unitSizes();
+    size_t units = unitSizes.size();
+    bool encrypted = FakeEsSource::isEncrypted(frame);
+    if (mode != (encrypted ? CryptoPlugin::kMode_AES_WV : CryptoPlugin::kMode_Unencrypted)) {
+        return false;
+    }
+
+    if (!buffer->meta_data()->findData(encrypted ? kKeyEncryptedSizes : kKeyPlainSizes,
+                                       &type, &data, &size) ||
+        size != units * sizeof(size_t)) {
+        return false;
+    }
+    if (memcmp(data, &unitSizes[0], size)) {
+        return false;
+    }
+
+    if (!encrypted) {
+        // clear access units carry matching zero encrypted sizes
+        if (!buffer->meta_data()->findData(kKeyEncryptedSizes, &type, &data, &size) ||
+            size != units * sizeof(size_t)) {
+            return false;
+        }
+        for (size_t i = 0; i < units; ++i) {
+            if (((const size_t *)data)[i] != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void TestWVMMediaSource::BufferSizing()
+{
+    printf("TestWVMMediaSource::BufferSizing\n");
+
+    sp<MetaData> metaData = new MetaData;
+    sp<WVMMediaSource> source = new WVMMediaSource(NULL, WV_EsSelector_Video,
+                                                   metaData, false, false, false);
+    if (source->start() != OK) {
+        Check(false, "start");
+        return;
+    }
+
+    const size_t kFrames = 900;
+    const size_t kHDSyncFrameSize = 600 * 1024;
+    const size_t kHDFrameSize = 60 * 1024;
+    Stats stats;
+
+    // Sync frames are larger than the initial buffer, once their size has
+    // been learned they should rarely overflow
+    if (Play(source, kFrames, kHDSyncFrameSize, kHDFrameSize, &stats)) {
+        Check(stats.partialReads < kFrames / FakeEsSource::kGopLength / 2,
+              "HD access units mostly fit");
+        Check(stats.lastBuffer <= kHDSyncFrameSize * 3 / 2,
+              "HD buffer stays near the largest access unit");
+    }
+
+    size_t hdBuffer = stats.lastBuffer;
+    if (Play(source, kFrames, kHDSyncFrameSize, kHDFrameSize, &stats)) {
+        Check(stats.partialReads <= kFrames / 100, "HD access units fit");
+        Check(stats.largestBuffer <= hdBuffer * 2, "no buffer growth in steady state");
+    }
+
+    // After switching to a lower bitrate the buffer should be trimmed
+    if (Play(source, kFrames, kHDSyncFrameSize / 8, kHDFrameSize / 8, &stats)) {
+        Check(stats.partialReads == 0, "SD access units fit");
+        Check(stats.lastBuffer < hdBuffer / 2, "buffer shrinks for SD");
+    }
+
+    source->stop();
+}
+
+void TestWVMMediaSource::CryptoPluginMode()
+{
+    printf("TestWVMMediaSource::CryptoPluginMode\n");
+
+    sp<MetaData> metaData = new MetaData;
+    sp<WVMMediaSource> source = new WVMMediaSource(NULL, WV_EsSelector_Video,
+                                                   metaData, false, true, false);
+    sp<ClientContext> clientContext = new ClientContext;
+    clientContext->setCryptoPluginMode(true);
+    clientContext->setVideoSource(source);
+    sEsSource.setClientContext(clientContext.get());
+
+    if (source->start() != OK) {
+        Check(false, "start");
+    } else {
+        // Sync frames overflow the initial buffer, so crypto units also
+        // have to continue into the grown buffer
+        const size_t kFrames = 300;
+        Stats stats;
+        Check(Play(source, kFrames, 600 * 1024, 60 * 1024, &stats),
+              "crypto units match the access units");
+        Check(stats.partialReads > 0, "access units overflowed the buffer");
+        source->stop();
+    }
+
+    sEsSource.setClientContext(NULL);
+}
+
+bool TestWVMMediaSource::Seek(sp<WVMMediaSource> source, int64_t seekTimeUs)
+{
+    MediaSource::ReadOptions options;
+    options.setSeekTo(seekTimeUs);
+
+    MediaBuffer *buffer;
+    if (source->read(&buffer, &options) != OK) {
+        return false;
+    }
+    buffer->release();
+    return true;
+}
+
+// In crypto plugin mode the audio and video source of a session both get a
+// seek and only one of them passes it on. Other sessions seeking to the
+// same point must not be affected.
+void TestWVMMediaSource::SeeksPerSession()
+{
+    printf("TestWVMMediaSource::SeeksPerSession\n");
+
+    sp<MetaData> metaData = new MetaData;
+    sp<WVMMediaSource> video = new WVMMediaSource(NULL, WV_EsSelector_Video,
+                                                  metaData, false, true, false);
+    sp<WVMMediaSource> audio = new WVMMediaSource(NULL, WV_EsSelector_Audio,
+                                                  metaData, false, true, false);
+    sp<WVMMediaSource> thumbnail = new WVMMediaSource(NULL, WV_EsSelector_Video,
+                                                      metaData, false, true, false);
+
+    sp<ClientContext> playerContext = new ClientContext;
+    playerContext->setCryptoPluginMode(true);
+    video->delegateClientContext(playerContext);
+    audio->delegateClientContext(playerContext);
+
+    sp<ClientContext> thumbnailContext = new ClientContext;
+    thumbnailContext->setCryptoPluginMode(true);
+    thumbnail->delegateClientContext(thumbnailContext);
+
+    sEsSource.reset(100, 4096, 1024);
+    if (video->start() != OK || audio->start() != OK || thumbnail->start() != OK) {
+        Check(false, "start");
+        return;
+    }
+
+    const int64_t kSeekTimeUs = 10000000;
+    sPlayCalls = 0;
+    Check(Seek(video, kSeekTimeUs), "player video seek");
+    Check(sPlayCalls == 1, "player seeks");
+
+    // lands between the player's video and audio seeks
+    Check(Seek(thumbnail, kSeekTimeUs), "thumbnail seek");
+    Check(sPlayCalls == 2, "thumbnail seeks independently");
+
+    Check(Seek(audio, kSeekTimeUs), "player audio seek");
+    Check(sPlayCalls == 2, "player seeks once");
+
+    video->stop();
+    audio->stop();
+    thumbnail->stop();
+}
+
+void *TestWVMMediaSource::ReadThread(void *source)
+{
+    MediaBuffer *buffer;
+    status_t err = ((WVMMediaSource *)source)->read(&buffer);
+    if (err == OK) {
+        buffer->release();
+    }
+    return (void *)(intptr_t)err;
+}
+
+// While a read waits for data the source's format can be queried, and
+// stopping the source ends the read
+void TestWVMMediaSource::ReadDoesNotBlockSource()
+{
+    printf("TestWVMMediaSource::ReadDoesNotBlockSource\n");
+
+    sp<MetaData> metaData = new MetaData;
+    sp<WVMMediaSource> source = new WVMMediaSource(NULL, WV_EsSelector_Video,
+                                                   metaData, false, false, false);
+    if (source->start() != OK) {
+        Check(false, "start");
+        return;
+    }
+
+    sEsSource.setStalled(true);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, ReadThread, source.get());
+    usleep(50000);
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    source->getFormat();
+    nsecs_t formatNs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    source->stop();
+    nsecs_t stopNs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    void *result;
+    pthread_join(thread, &result);
+    sEsSource.setStalled(false);
+
+    printf("  getFormat took %.1f ms, stop took %.1f ms\n", formatNs / 1E6, stopNs / 1E6);
+    Check(formatNs < 100000000LL, "getFormat during read");
+    Check(stopNs < 1000000000LL, "stop during read");
+    Check((status_t)(intptr_t)result == ERROR_END_OF_STREAM, "read ends on stop");
+}
+
+int main(int argc, char **argv)
+{
+    TestWVMMediaSource test;
+    test.BufferSizing();
+    test.CryptoPluginMode();
+    test.SeeksPerSession();
+    test.ReadDoesNotBlockSource();
+
+    if (test.failures()) {
+        printf("%d failures\n", test.failures());
+        exit(-1);
+    }
+    printf("Test successful!\n");
+    exit(0);
+}